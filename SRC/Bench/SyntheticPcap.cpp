@@ -0,0 +1,337 @@
+/**
+ * @file
+ * @brief Synthetic Capture Generator
+ */
+
+#include "SyntheticPcap.h"
+#include <fstream>
+
+namespace {
+    constexpr uint8_t tcpFin{0x01};
+    constexpr uint8_t tcpSyn{0x02};
+    constexpr uint8_t tcpPsh{0x08};
+    constexpr uint8_t tcpAck{0x10};
+
+    constexpr int ethHeaderLen{14};
+    constexpr int ipHeaderLen{20};
+    constexpr int tcpHeaderLen{20};
+    constexpr int udpHeaderLen{8};
+    constexpr time_t baseTime{1600000000};
+
+    void put16(std::vector<uint8_t> &out, uint16_t v) {
+        out.push_back(static_cast<uint8_t>(v >> 8));
+        out.push_back(static_cast<uint8_t>(v));
+    }
+
+    void put32(std::vector<uint8_t> &out, uint32_t v) {
+        put16(out, static_cast<uint16_t>(v >> 16));
+        put16(out, static_cast<uint16_t>(v));
+    }
+
+    uint16_t ipChecksum(const uint8_t *hdr, int len) {
+        uint32_t sum{0};
+        for (int i = 0; i < len; i += 2) sum += static_cast<uint32_t>(hdr[i] << 8 | hdr[i + 1]);
+        while (sum >> 16) sum = (sum & 0xffff) + (sum >> 16);
+        return static_cast<uint16_t>(~sum);
+    }
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Generate the frames of all conversations and interleave them into one capture
+ */
+SyntheticPcap::SyntheticPcap(const SyntheticConfig &config) : config(config), rng(config.seed) {
+    std::vector<std::vector<uint8_t>> flowBytes(static_cast<size_t>(std::max(config.flows, 0)));
+    std::vector<std::vector<Pending>> flowFrames(flowBytes.size());
+    size_t total{0};
+    size_t frameCount{0};
+    for (size_t f = 0; f < flowBytes.size(); f++) {
+        buildFlow(static_cast<int>(f), flowBytes[f], flowFrames[f]);
+        total += flowBytes[f].size();
+        frameCount += flowFrames[f].size();
+    }
+
+    // Round robin over the conversations. The buffer is sized up front so the frame pointers stay valid.
+    buffer.reserve(total);
+    frameList.reserve(frameCount);
+    std::vector<size_t> offsets;
+    offsets.reserve(frameCount);
+    for (size_t step = 0; frameList.size() < frameCount; step++) {
+        for (size_t f = 0; f < flowFrames.size(); f++) {
+            if (step >= flowFrames[f].size()) continue;
+            const Pending &p = flowFrames[f][step];
+            offsets.push_back(buffer.size());
+            buffer.insert(buffer.end(), flowBytes[f].begin() + static_cast<long>(p.offset),
+                          flowBytes[f].begin() + static_cast<long>(p.offset) + p.length);
+            RawFrame frame;
+            frame.length = p.length;
+            frame.frameLength = p.length;
+            long ns = static_cast<long>(frameList.size()) * config.packetGapNs;
+            frame.ts = {baseTime + ns / 1000000000L, ns % 1000000000L};
+            frameList.push_back(frame);
+        }
+    }
+    for (size_t i = 0; i < frameList.size(); i++) frameList[i].data = buffer.data() + offsets[i];
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @return      true with probability rate
+ */
+bool SyntheticPcap::chance(double rate) {
+    if (rate <= 0.0) return false;
+    return static_cast<double>(rng() >> 11) * 0x1.0p-53 < rate;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Build all frames of one conversation
+ *
+ * @param flow      Index of the conversation. Selects the addresses and ports.
+ * @param out       Receives the frame bytes
+ * @param frames    Receives the position of each frame in out
+ */
+void SyntheticPcap::buildFlow(int flow, std::vector<uint8_t> &out, std::vector<Pending> &frames) {
+    auto f = static_cast<uint32_t>(flow);
+    auto server = static_cast<uint32_t>(flow % std::max(config.servers, 1));
+    Endpoint client{{0x02, 0x00, static_cast<uint8_t>(f >> 16), static_cast<uint8_t>(f >> 8),
+                     static_cast<uint8_t>(f), 0x01},
+                    0x0a000001 + f, static_cast<uint16_t>(1024 + f % 64000), static_cast<uint32_t>(rng()), 1};
+    Endpoint srv{{0x02, 0x01, 0x00, static_cast<uint8_t>(server >> 8), static_cast<uint8_t>(server), 0x01},
+                 0xac100001 + server, 443, static_cast<uint32_t>(rng()), 1};
+
+    int span = std::max(config.maxPayload - config.minPayload, 0) + 1;
+    auto payloadSize = [&]() {
+        return config.minPayload + static_cast<int>(rng() % static_cast<uint64_t>(span));
+    };
+    // A lost segment only advances the sequence number. A retransmitted segment is added a second time.
+    auto data = [&](Endpoint &src, const Endpoint &dst, int payload) {
+        if (chance(config.lossRate)) {
+            src.seq += static_cast<uint32_t>(payload);
+            src.ipId++;
+            return;
+        }
+        uint32_t seq = src.seq;
+        addSegment(out, frames, src, dst, tcpPsh | tcpAck, payload);
+        if (chance(config.retransmitRate)) {
+            uint32_t next = src.seq;
+            src.seq = seq;
+            addSegment(out, frames, src, dst, tcpPsh | tcpAck, payload);
+            src.seq = next;
+        }
+    };
+
+    if (chance(config.handshakeRate)) {
+        addSegment(out, frames, client, srv, tcpSyn, 0);
+        addSegment(out, frames, srv, client, tcpSyn | tcpAck, 0);
+        addSegment(out, frames, client, srv, tcpAck, 0);
+    }
+    if (config.mixed) addOtherFrames(out, frames, client, srv);
+    for (int r = 0; r < config.requests; r++) {
+        data(client, srv, payloadSize());
+        data(srv, client, payloadSize());
+        addSegment(out, frames, client, srv, tcpAck, 0);
+    }
+    addSegment(out, frames, client, srv, tcpFin | tcpAck, 0);
+    addSegment(out, frames, srv, client, tcpFin | tcpAck, 0);
+    addSegment(out, frames, client, srv, tcpAck, 0);
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Append one Ethernet/IPv4/TCP frame and advance the sender's sequence number
+ *
+ * @param src       Sender
+ * @param dst       Receiver. Its sequence number is used as the ACK number.
+ * @param flags     TCP flags
+ * @param payload   TCP payload length
+ */
+void SyntheticPcap::addSegment(std::vector<uint8_t> &out, std::vector<Pending> &frames, Endpoint &src,
+                               const Endpoint &dst, uint8_t flags, int payload) {
+    size_t start = out.size();
+
+    out.insert(out.end(), dst.mac, dst.mac + 6);
+    out.insert(out.end(), src.mac, src.mac + 6);
+    put16(out, 0x0800);
+
+    size_t ip = out.size();
+    out.push_back(0x45);
+    out.push_back(0);
+    put16(out, static_cast<uint16_t>(ipHeaderLen + tcpHeaderLen + payload));
+    put16(out, src.ipId++);
+    put16(out, 0x4000);
+    out.push_back(64);
+    out.push_back(6);
+    put16(out, 0);
+    put32(out, src.ip);
+    put32(out, dst.ip);
+    uint16_t csum = ipChecksum(out.data() + ip, ipHeaderLen);
+    out[ip + 10] = static_cast<uint8_t>(csum >> 8);
+    out[ip + 11] = static_cast<uint8_t>(csum);
+
+    put16(out, src.port);
+    put16(out, dst.port);
+    put32(out, src.seq);
+    put32(out, (flags & tcpAck) != 0 ? dst.seq : 0);
+    out.push_back(static_cast<uint8_t>((tcpHeaderLen / 4) << 4));
+    out.push_back(flags);
+    put16(out, 65535);
+    put16(out, 0);
+    put16(out, 0);
+    for (int i = 0; i < payload; i++) out.push_back(static_cast<uint8_t>('a' + i % 26));
+
+    src.seq += static_cast<uint32_t>(payload);
+    if ((flags & (tcpSyn | tcpFin)) != 0) src.seq++;
+    frames.push_back({start, static_cast<int>(out.size() - start)});
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Append the frames of a mixed capture from the client of a conversation, with its addresses and ports
+ *
+ * An ARP request for the server, an 802.1Q tagged TCP segment, a UDP datagram, a TCP segment in two IPv4 fragments,
+ * and a TCP segment and a UDP datagram over IPv6 between fc00::<client> and fc00::<server>. The sequence numbers of
+ * the conversation are not changed.
+ */
+void SyntheticPcap::addOtherFrames(std::vector<uint8_t> &out, std::vector<Pending> &frames, Endpoint &client,
+                                   const Endpoint &srv) {
+    constexpr uint8_t broadcast[6]{0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+    constexpr int payload{16};
+    size_t start{0};
+
+    auto ethernet = [&](const uint8_t *dst, uint16_t etherType, bool vlan) {
+        start = out.size();
+        out.insert(out.end(), dst, dst + 6);
+        out.insert(out.end(), client.mac, client.mac + 6);
+        if (vlan) {
+            put16(out, 0x8100);
+            put16(out, 100);
+        }
+        put16(out, etherType);
+    };
+    auto ipv4 = [&](uint8_t protocol, uint16_t fragment, int length) {
+        size_t ip = out.size();
+        out.push_back(0x45);
+        out.push_back(0);
+        put16(out, static_cast<uint16_t>(ipHeaderLen + length));
+        put16(out, client.ipId);
+        put16(out, fragment);
+        out.push_back(64);
+        out.push_back(protocol);
+        put16(out, 0);
+        put32(out, client.ip);
+        put32(out, srv.ip);
+        uint16_t csum = ipChecksum(out.data() + ip, ipHeaderLen);
+        out[ip + 10] = static_cast<uint8_t>(csum >> 8);
+        out[ip + 11] = static_cast<uint8_t>(csum);
+    };
+    auto ipv6 = [&](uint8_t next, int length) {
+        put32(out, 0x60000000);
+        put16(out, static_cast<uint16_t>(length));
+        out.push_back(next);
+        out.push_back(64);
+        for (uint32_t ip: {client.ip, srv.ip}) {
+            put32(out, 0xfc000000);
+            put32(out, 0);
+            put32(out, 0);
+            put32(out, ip);
+        }
+    };
+    auto transport = [&](uint8_t protocol, int length) {
+        put16(out, client.port);
+        put16(out, srv.port);
+        if (protocol == 6) {
+            put32(out, client.seq);
+            put32(out, srv.seq);
+            out.push_back(static_cast<uint8_t>((tcpHeaderLen / 4) << 4));
+            out.push_back(tcpPsh | tcpAck);
+            put16(out, 65535);
+            put16(out, 0);
+            put16(out, 0);
+        } else {
+            put16(out, static_cast<uint16_t>(udpHeaderLen + length));
+            put16(out, 0);
+        }
+        for (int i = 0; i < length; i++) out.push_back(static_cast<uint8_t>('a' + i % 26));
+    };
+    auto done = [&]() {
+        frames.push_back({start, static_cast<int>(out.size() - start)});
+    };
+
+    ethernet(broadcast, 0x0806, false);
+    put16(out, 1);
+    put16(out, 0x0800);
+    out.push_back(6);
+    out.push_back(4);
+    put16(out, 1);
+    out.insert(out.end(), client.mac, client.mac + 6);
+    put32(out, client.ip);
+    out.insert(out.end(), 6, 0);
+    put32(out, srv.ip);
+    done();
+
+    ethernet(srv.mac, 0x0800, true);
+    ipv4(6, 0x4000, tcpHeaderLen + payload);
+    transport(6, payload);
+    client.ipId++;
+    done();
+
+    ethernet(srv.mac, 0x0800, false);
+    ipv4(17, 0x4000, udpHeaderLen + payload);
+    transport(17, payload);
+    client.ipId++;
+    done();
+
+    // First fragment: more fragments, the TCP header and 4 bytes of payload. Second: 8 byte offset 3, the rest.
+    ethernet(srv.mac, 0x0800, false);
+    ipv4(6, 0x2000, tcpHeaderLen + 4);
+    transport(6, 4);
+    done();
+    ethernet(srv.mac, 0x0800, false);
+    ipv4(6, (tcpHeaderLen + 4) / 8, payload);
+    for (int i = 0; i < payload; i++) out.push_back(static_cast<uint8_t>('a' + i % 26));
+    client.ipId++;
+    done();
+
+    ethernet(srv.mac, 0x86dd, false);
+    ipv6(6, tcpHeaderLen + payload);
+    transport(6, payload);
+    done();
+
+    ethernet(srv.mac, 0x86dd, false);
+    ipv6(17, udpHeaderLen + payload);
+    transport(17, payload);
+    done();
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Write the capture as a nanosecond resolution pcap file
+ * @return      false if the file could not be written
+ */
+bool SyntheticPcap::write(const std::string &fileName) const {
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+
+    auto put = [&file](uint32_t v) { file.write(reinterpret_cast<const char *>(&v), sizeof(v)); };
+    put(0xa1b23c4d);
+    put(2 | 4u << 16);
+    put(0);
+    put(0);
+    put(65535);
+    put(pcpp::LINKTYPE_ETHERNET);
+    for (auto const &frame: frameList) {
+        put(static_cast<uint32_t>(frame.ts.tv_sec));
+        put(static_cast<uint32_t>(frame.ts.tv_nsec));
+        put(static_cast<uint32_t>(frame.length));
+        put(static_cast<uint32_t>(frame.frameLength));
+        file.write(reinterpret_cast<const char *>(frame.data), frame.length);
+    }
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,95 @@
+/**
+ * @file
+ * @brief Synthetic Capture Generator
+ *
+ * Builds deterministic Ethernet/IPv4/TCP traffic for the benchmarks. Every flow is a client talking to a server:
+ * an optional three way handshake, a number of request/response exchanges where the client ACKs each response, and
+ * a FIN exchange. The flows are interleaved packet by packet, the way concurrent conversations appear in a real
+ * capture. A mixed capture also has the frames the --filter forms must handle like libpcap: ARP, VLAN tagged, UDP,
+ * IPv4 fragments and IPv6. The same configuration and seed always produce the same bytes, so results of different builds can be
+ * compared. The traffic can be kept in memory or written as a classic pcap file.
+ */
+
+#ifndef MACPCAP_SYNTHETICPCAP_H
+#define MACPCAP_SYNTHETICPCAP_H
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+#include "../Capture/PacketSource.h"
+
+/**
+ * @brief Shape of the generated traffic
+ */
+struct SyntheticConfig {
+    int flows{1000};                ///< Number of TCP conversations
+    int requests{20};               ///< Request/response exchanges per conversation
+    int servers{16};                ///< Number of distinct server addresses
+    int minPayload{64};             ///< Smallest TCP payload in bytes
+    int maxPayload{1400};           ///< Largest TCP payload in bytes
+    double handshakeRate{1.0};      ///< Fraction of conversations that start with SYN, SYN-ACK, ACK
+    double lossRate{0.0};           ///< Fraction of data segments missing from the capture
+    double retransmitRate{0.0};     ///< Fraction of data segments captured twice
+    long packetGapNs{10000};        ///< Time between consecutive packets of the capture
+    uint64_t seed{1};               ///< Random seed
+    bool mixed{false};              ///< Also add ARP, 802.1Q tagged, UDP, fragmented IPv4 and IPv6 frames per flow
+};
+
+class SyntheticPcap {
+public:
+    explicit SyntheticPcap(const SyntheticConfig &config);
+
+    /**
+     * @return  The generated frames. The frame bytes are owned by this instance.
+     */
+    [[nodiscard]] const std::vector<RawFrame> &frames() const {
+        return frameList;
+    }
+
+    /**
+     * @return  Total bytes of all frames
+     */
+    [[nodiscard]] size_t bytes() const {
+        return buffer.size();
+    }
+
+    bool write(const std::string &fileName) const;
+
+private:
+    /**
+     * @brief One side of a conversation
+     */
+    struct Endpoint {
+        uint8_t mac[6]{};
+        uint32_t ip{0};
+        uint16_t port{0};
+        uint32_t seq{0};
+        uint16_t ipId{0};
+    };
+
+    /**
+     * @brief A frame before it is placed in the capture
+     */
+    struct Pending {
+        size_t offset{0};
+        int length{0};
+    };
+
+    void buildFlow(int flow, std::vector<uint8_t> &out, std::vector<Pending> &frames);
+
+    static void addSegment(std::vector<uint8_t> &out, std::vector<Pending> &frames, Endpoint &src,
+                           const Endpoint &dst, uint8_t flags, int payload);
+
+    static void addOtherFrames(std::vector<uint8_t> &out, std::vector<Pending> &frames, Endpoint &client,
+                               const Endpoint &srv);
+
+    bool chance(double rate);
+
+    SyntheticConfig config;
+    std::mt19937_64 rng;
+    std::vector<uint8_t> buffer;
+    std::vector<RawFrame> frameList;
+};
+
+#endif //MACPCAP_SYNTHETICPCAP_H
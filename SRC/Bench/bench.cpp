@@ -0,0 +1,344 @@
+/*! \file bench.cpp
+ *  macpcap Benchmarks (macpcap_bench)
+ *  ----------------------------------
+ *  Times the stages of macpcap separately on deterministic synthetic traffic (see SyntheticPcap.h):
+ *  - BM_Parser         parser() over every packet of the capture, including building the tables
+ *  - BM_ProcessAck     sequence tracking and ACK matching of one long conversation
+ *  - BM_Finalize       computing the report values of every TCP conversation
+ *  - BM_SortMap        sorting the TCP conversation table on a string, integer and double column
+ *  - BM_PrintTable     building and printing the TCP conversation table (output is discarded)
+ *  - BM_Filter         --filter socket: on one conversation with libpcap BPF (0) and the compiled predicate (1)
+ *
+ *  Packet benchmarks report items_per_second (packets per second) and ns_per_packet. The Google Benchmark options
+ *  apply, so the results can be written as JSON or CSV and compared between builds:
+ *
+ *      macpcap_bench --flows 5000 --loss 0.01 --benchmark_out=bench.json --benchmark_out_format=json
+ *
+ *  The synthetic capture can also be written to a file and used with macpcap:
+ *
+ *      macpcap_bench --flows 100 --generate synthetic.pcap
+ *
+ *  --checkfilters tests every frame of a mixed capture (ARP, VLAN tagged, UDP, IPv4 fragments and IPv6) with each
+ *  compiled --filter predicate and with libpcap running the BPF string of the same filter, and fails on any frame
+ *  where they differ.
+ */
+
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <benchmark/benchmark.h>
+#include <boost/program_options.hpp>
+#include <fmt/format.h>
+#include "SyntheticPcap.h"
+#include "../Capture/FramePredicate.h"
+#include "../Protocols/parser.h"
+
+namespace po = boost::program_options;
+
+namespace {
+    SyntheticConfig benchConfig;
+    std::unique_ptr<SyntheticPcap> capture;
+    std::unique_ptr<StatsTables> parsedTables;
+
+    /**
+     * @return  The synthetic capture, generated on first use
+     */
+    const SyntheticPcap &getCapture() {
+        if (!capture) capture = std::make_unique<SyntheticPcap>(benchConfig);
+        return *capture;
+    }
+
+    /**
+     * @return  Tables filled by parsing the synthetic capture once
+     */
+    StatsTables &getTables() {
+        if (!parsedTables) {
+            parsedTables = std::make_unique<StatsTables>();
+            int pc{0};
+            for (auto const &frame: getCapture().frames()) {
+                pcpp::RawPacket raw(frame.data, frame.length, frame.ts, false, frame.linkType);
+                pcpp::Packet pkt(&raw, parseUntilLayer);
+                parser(pkt, *parsedTables, ++pc, false);
+            }
+            TCPConversation::finalizeTable(parsedTables->tcpConversationList, 1);
+        }
+        return *parsedTables;
+    }
+
+    /**
+     * @brief Report packets per second and nanoseconds per packet
+     */
+    void setPacketCounters(benchmark::State &state, size_t packets) {
+        state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * packets));
+        // An inverted iteration invariant rate is time / (value * iterations). Scaling by 1e-9 gives nanoseconds.
+        state.counters["ns_per_packet"] = benchmark::Counter(static_cast<double>(packets) * 1e-9,
+                                                             benchmark::Counter::kIsIterationInvariantRate |
+                                                             benchmark::Counter::kInvert);
+    }
+
+    /**
+     * @brief Sends the standard output, both fmt::print and std::cout, to /dev/null while in scope
+     */
+    class DiscardOutput {
+    public:
+        DiscardOutput() {
+            std::cout.flush();
+            fflush(stdout);
+            saved = dup(STDOUT_FILENO);
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+            ::close(null);
+        }
+
+        ~DiscardOutput() {
+            std::cout.flush();
+            fflush(stdout);
+            dup2(saved, STDOUT_FILENO);
+            ::close(saved);
+        }
+
+    private:
+        int saved{-1};
+    };
+}
+
+static void BM_Parser(benchmark::State &state) {
+    const auto &frames = getCapture().frames();
+    for (auto _: state) {
+        StatsTables tables;
+        int pc{0};
+        for (auto const &frame: frames) {
+            pcpp::RawPacket raw(frame.data, frame.length, frame.ts, false, frame.linkType);
+            pcpp::Packet pkt(&raw, parseUntilLayer);
+            parser(pkt, tables, ++pc, false);
+        }
+        benchmark::DoNotOptimize(tables.tcpConversationList.size());
+    }
+    setPacketCounters(state, frames.size());
+}
+
+/**
+ * @brief One conversation with range(0) request/response exchanges. Each data segment is queued and retired by
+ * the client's ACK.
+ */
+static void BM_ProcessAck(benchmark::State &state) {
+    SyntheticConfig config{benchConfig};
+    config.flows = 1;
+    config.requests = static_cast<int>(state.range(0));
+    config.handshakeRate = 0.0;
+    SyntheticPcap conversation(config);
+
+    std::vector<std::unique_ptr<pcpp::RawPacket>> raws;
+    std::vector<std::unique_ptr<pcpp::Packet>> parsed;
+    std::vector<PacketView> views;
+    int pc{0};
+    for (auto const &frame: conversation.frames()) {
+        raws.push_back(std::make_unique<pcpp::RawPacket>(frame.data, frame.length, frame.ts, false, frame.linkType));
+        parsed.push_back(std::make_unique<pcpp::Packet>(raws.back().get(), parseUntilLayer));
+        views.emplace_back(*parsed.back(), ++pc);
+    }
+
+    for (auto _: state) {
+        TCPConversation tcpc;
+        tcpc.setFirstSpeaker(views.front().tcpFromA);
+        for (auto const &view: views) {
+            tcpc.processSequenceNumber(view, view.tcpFromA);
+            tcpc.processAck(view, view.tcpFromA);
+        }
+        benchmark::DoNotOptimize(tcpc);
+    }
+    setPacketCounters(state, views.size());
+}
+
+static void BM_Finalize(benchmark::State &state) {
+    auto &tcl = getTables().tcpConversationList;
+    for (auto _: state) {
+        TCPConversation::finalizeTable(tcl, static_cast<int>(state.range(0)));
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * tcl.size()));
+}
+
+static void BM_SortMap(benchmark::State &state, const std::string &colId) {
+    const auto &tcl = getTables().tcpConversationList;
+    for (auto _: state) {
+        auto sl = TCPConversation::sortMap(tcl, colId, 0);
+        benchmark::DoNotOptimize(sl.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * tcl.size()));
+}
+
+static void BM_PrintTable(benchmark::State &state) {
+    const auto &tcl = getTables().tcpConversationList;
+    for (auto _: state) {
+        DiscardOutput discard;
+        TCPConversation::printTable(tcl, "id", 0, false);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * tcl.size()));
+}
+
+/**
+ * @brief Select the packets of the first conversation with the BPF program (range(0) == 0) or the frame predicate
+ */
+static void BM_Filter(benchmark::State &state) {
+    const auto &frames = getCapture().frames();
+    const uint8_t *d = frames.front().data;
+    std::string sip{fmt::format("{}.{}.{}.{}", d[26], d[27], d[28], d[29])};
+    std::string dip{fmt::format("{}.{}.{}.{}", d[30], d[31], d[32], d[33])};
+    std::string sport{std::to_string(d[34] << 8 | d[35])};
+    std::string dport{std::to_string(d[36] << 8 | d[37])};
+    pcpp::BpfFilterWrapper bpf;
+    bpf.setFilter(fmt::format("port {} and port {} and host {} and host {}", sport, dport, sip, dip));
+    FramePredicate predicate{FramePredicate::socket(sip, sport, dip, dport)};
+    for (auto _: state) {
+        size_t matched{0};
+        for (auto const &frame: frames) {
+            if (state.range(0) == 0) {
+                pcpp::RawPacket raw(frame.data, frame.length, frame.ts, false, frame.linkType);
+                matched += bpf.matchPacketWithFilter(&raw);
+            } else {
+                matched += predicate.match(frame);
+            }
+        }
+        benchmark::DoNotOptimize(matched);
+    }
+    setPacketCounters(state, frames.size());
+}
+
+/**
+ * @brief Compare each --filter form with the BPF string it replaces on every frame of a mixed capture
+ * @return      false if a predicate and libpcap disagree on any frame
+ */
+static bool checkFilters() {
+    SyntheticConfig config{benchConfig};
+    config.mixed = true;
+    SyntheticPcap mixed(config);
+    const auto &frames = mixed.frames();
+    auto first = std::find_if(frames.begin(), frames.end(), [](const RawFrame &f) {
+        return f.length >= 38 && f.data[12] == 0x08 && f.data[13] == 0x00;
+    });
+    if (first == frames.end()) return false;
+    const uint8_t *d = first->data;
+    std::string mac{fmt::format("{:02x}:{:02x}:{:02x}:{:02x}:{:02x}:{:02x}", d[6], d[7], d[8], d[9], d[10], d[11])};
+    std::string sip{fmt::format("{}.{}.{}.{}", d[26], d[27], d[28], d[29])};
+    std::string dip{fmt::format("{}.{}.{}.{}", d[30], d[31], d[32], d[33])};
+    std::string sport{std::to_string(d[34] << 8 | d[35])};
+    std::string dport{std::to_string(d[36] << 8 | d[37])};
+    std::string ipBpf;
+    pcpp::IPFilter(sip, pcpp::SRC_OR_DST).parseToString(ipBpf);
+
+    struct Check {
+        std::string filter;
+        FramePredicate predicate;
+        std::string bpf;
+    };
+    std::vector<Check> checks;
+    checks.push_back({"ip:" + sip, FramePredicate::ipHost(sip), ipBpf});
+    checks.push_back({fmt::format("hp:{}-{}", sip, dip), FramePredicate::hostPair(sip, dip),
+                      fmt::format("(host {}) and (host {})", sip, dip)});
+    checks.push_back({"port:" + sport, FramePredicate::port(sport), "port " + sport});
+    checks.push_back({"port:" + dport, FramePredicate::port(dport), "port " + dport});
+    checks.push_back({fmt::format("socket:{}:{}-{}:{}", sip, sport, dip, dport),
+                      FramePredicate::socket(sip, sport, dip, dport),
+                      fmt::format("port {} and port {} and host {} and host {}", sport, dport, sip, dip)});
+    checks.push_back({"mac:" + mac, FramePredicate::mac(mac), "ether host " + mac});
+    for (const char *prot: {"tcp", "udp", "sctp", "icmp", "arp"}) {
+        checks.push_back({fmt::format("prot:{}", prot), FramePredicate::protocol(prot), prot});
+    }
+
+    bool same{true};
+    fmt::print("{:<50} {:>10} {:>10} {:>10}\n", "Filter", "libpcap", "predicate", "differ");
+    for (auto &check: checks) {
+        pcpp::BpfFilterWrapper program;
+        if (!check.predicate.valid() || !program.setFilter(check.bpf)) {
+            fmt::print("{:<50} could not be compiled\n", check.filter);
+            same = false;
+            continue;
+        }
+        size_t pcapMatched{0}, predicateMatched{0}, differ{0};
+        for (auto const &frame: frames) {
+            pcpp::RawPacket raw(frame.data, frame.length, frame.ts, false, frame.linkType);
+            bool pcap{program.matchPacketWithFilter(&raw)};
+            bool predicate{check.predicate.match(frame)};
+            pcapMatched += pcap;
+            predicateMatched += predicate;
+            differ += pcap != predicate;
+        }
+        fmt::print("{:<50} {:>10} {:>10} {:>10}\n", check.filter, pcapMatched, predicateMatched, differ);
+        same = same && differ == 0;
+    }
+    fmt::print("{} frames: {}\n", frames.size(), same ? "the predicates match libpcap" : "MISMATCH");
+    return same;
+}
+
+BENCHMARK(BM_Parser)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ProcessAck)->Arg(100)->Arg(10000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Finalize)->Arg(1)->Arg(4)->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_SortMap, id, std::string("id"))->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_SortMap, packetcount, std::string("pc"))->Unit(benchmark::kMicrosecond);
+BENCHMARK_CAPTURE(BM_SortMap, duration, std::string("dur"))->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_PrintTable)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Filter)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+int main(int argc, char **argv) {
+    benchmark::Initialize(&argc, argv);
+
+    po::options_description desc("macpcap_bench options (the --benchmark_* options of Google Benchmark also apply)");
+    desc.add_options()
+            ("help", "produce help message")
+            ("generate", po::value<std::string>(), "Write the synthetic capture to this pcap file and exit")
+            ("flows", po::value<int>(), "Number of TCP conversations (default 1000)")
+            ("requests", po::value<int>(), "Request/response exchanges per conversation (default 20)")
+            ("servers", po::value<int>(), "Number of server addresses (default 16)")
+            ("minpayload", po::value<int>(), "Smallest TCP payload (default 64)")
+            ("maxpayload", po::value<int>(), "Largest TCP payload (default 1400)")
+            ("handshake", po::value<double>(), "Fraction of conversations with a three way handshake (default 1.0)")
+            ("loss", po::value<double>(), "Fraction of data segments missing from the capture (default 0)")
+            ("retransmit", po::value<double>(), "Fraction of data segments captured twice (default 0)")
+            ("gap", po::value<long>(), "Nanoseconds between packets (default 10000)")
+            ("seed", po::value<uint64_t>(), "Random seed (default 1)")
+            ("mixed", "Add ARP, VLAN tagged, UDP, IPv4 fragment and IPv6 frames to every conversation")
+            ("checkfilters", "Compare the --filter predicates with libpcap on a mixed capture and exit");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if (vm.count("help")) {
+        std::cout << desc << "\n";
+        return 0;
+    }
+    if (vm.count("flows")) benchConfig.flows = vm["flows"].as<int>();
+    if (vm.count("requests")) benchConfig.requests = vm["requests"].as<int>();
+    if (vm.count("servers")) benchConfig.servers = vm["servers"].as<int>();
+    if (vm.count("minpayload")) benchConfig.minPayload = vm["minpayload"].as<int>();
+    if (vm.count("maxpayload")) benchConfig.maxPayload = vm["maxpayload"].as<int>();
+    if (vm.count("handshake")) benchConfig.handshakeRate = vm["handshake"].as<double>();
+    if (vm.count("loss")) benchConfig.lossRate = vm["loss"].as<double>();
+    if (vm.count("retransmit")) benchConfig.retransmitRate = vm["retransmit"].as<double>();
+    if (vm.count("gap")) benchConfig.packetGapNs = vm["gap"].as<long>();
+    if (vm.count("seed")) benchConfig.seed = vm["seed"].as<uint64_t>();
+    benchConfig.mixed = vm.count("mixed") > 0;
+
+    if (vm.count("checkfilters")) return checkFilters() ? 0 : 1;
+
+    const SyntheticPcap &synthetic = getCapture();
+    if (vm.count("generate")) {
+        auto fileName = vm["generate"].as<std::string>();
+        if (!synthetic.write(fileName)) {
+            fmt::print(stderr, "Could not write {}\n", fileName);
+            return 1;
+        }
+        fmt::print("{} packets, {} bytes written to {}\n", synthetic.frames().size(), synthetic.bytes(), fileName);
+        return 0;
+    }
+
+    // Goes to stderr so the benchmark output on stdout stays machine readable
+    fmt::print(stderr, "Synthetic capture: {} flows, {} packets, {} bytes\n", benchConfig.flows,
+               synthetic.frames().size(), synthetic.bytes());
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,45 @@
+/**
+ * @file
+ * @brief Capture File Stamp
+ *
+ * The index files kept next to a capture (flow index, timestamp index) record the size and modification time of the
+ * capture they were built from. An index whose stamp no longer matches the capture is ignored.
+ */
+
+#ifndef MACPCAP_CAPTURESTAMP_H
+#define MACPCAP_CAPTURESTAMP_H
+
+#include <cstdint>
+#include <string>
+#include <sys/stat.h>
+#include "../Protocols/Timestamp.h"
+
+/**
+ * @brief Size and modification time of the capture file an index was built from
+ */
+struct CaptureStamp {
+    uint64_t size{0};
+    int64_t mtimeNs{0};
+
+    /**
+     * @brief Read the size and modification time of a file
+     * @return      false if the file does not exist
+     */
+    static bool read(const std::string &fileName, CaptureStamp &stamp) {
+        struct stat st{};
+        if (stat(fileName.c_str(), &st) != 0) return false;
+        stamp.size = static_cast<uint64_t>(st.st_size);
+#ifdef __APPLE__
+        stamp.mtimeNs = toNs(st.st_mtimespec);
+#else
+        stamp.mtimeNs = toNs(st.st_mtim);
+#endif
+        return true;
+    }
+
+    bool operator==(const CaptureStamp &o) const {
+        return size == o.size && mtimeNs == o.mtimeNs;
+    }
+};
+
+#endif //MACPCAP_CAPTURESTAMP_H
@@ -0,0 +1,243 @@
+/**
+ * @file
+ * @brief Flow Index
+ *
+ * File layout, in host byte order:
+ *  - header: magic, version, capture size and modification time, number of flows and number of record offsets
+ *  - one FlowIndexRecord per flow, sorted by key
+ *  - the record offsets of every flow, flow by flow, in capture order
+ */
+
+#include "FlowIndex.h"
+#include "NetworkLayer.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <spdlog/spdlog.h>
+
+namespace {
+    constexpr char indexMagic[8]{'M', 'P', 'F', 'L', 'O', 'W', 'I', 'X'};
+    constexpr uint32_t indexVersion{2};
+
+    struct IndexHeader {
+        char magic[8]{};
+        uint32_t version{0};
+        uint32_t recordSize{0};
+        CaptureStamp stamp;
+        uint64_t recordCount{0};
+        uint64_t offsetCount{0};
+    };
+
+    uint16_t rd16(const uint8_t *p) {
+        return static_cast<uint16_t>(p[0] << 8 | p[1]);
+    }
+
+    /**
+     * @brief Socket key of an IPv4 TCP, UDP or SCTP frame, read at fixed offsets. Indexes the frames of every link
+     * type the socket frame predicate reads (see NetworkLayer.h).
+     * @return      false for any other frame and for IP fragments after the first
+     */
+    bool socketKey(const RawFrame &frame, FlowKey &key) {
+        NetworkLayer n;
+        if (!NetworkLayer::find(frame.data, frame.length, frame.linkType, n)) return false;
+        const uint8_t *ip = n.p;
+        if (n.type != NetworkLayer::ipv4 || n.len < 20 || (ip[0] >> 4) != 4) return false;
+        size_t ihl = (ip[0] & 0x0fu) * 4u;
+        uint8_t prot = ip[9];
+        if ((rd16(ip + 6) & 0x1fff) != 0 || ihl < 20 || n.len < ihl + 4) return false;
+        if (prot != 6 && prot != 17 && prot != 132) return false;
+        uint32_t src, dst;
+        std::memcpy(&src, ip + 12, 4);
+        std::memcpy(&dst, ip + 16, 4);
+        bool fromA{true};
+        key = FlowKey::make(src, rd16(ip + ihl), dst, rd16(ip + ihl + 2), prot, fromA);
+        return true;
+    }
+}
+
+bool FlowIndexRecord::operator<(const FlowIndexRecord &o) const {
+    if (ipA != o.ipA) return ipA < o.ipA;
+    if (ipB != o.ipB) return ipB < o.ipB;
+    if (portA != o.portA) return portA < o.portA;
+    if (portB != o.portB) return portB < o.portB;
+    return protocol < o.protocol;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Pass the filter to the source. A filtered pass does not see every packet, so no index is written.
+ */
+bool FlowIndexWriter::setFilter(const std::string &bpf) {
+    if (!bpf.empty()) complete = false;
+    return source->setFilter(bpf);
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Read the next frame from the source and add it to its flow
+ */
+bool FlowIndexWriter::getNextPacket(RawFrame &frame) {
+    if (!source->getNextPacket(frame)) return false;
+    packets++;
+    if (frame.offset == RawFrame::noOffset) complete = false;
+    FlowKey key;
+    if (!complete || !socketKey(frame, key)) return true;
+
+    TimestampNs ts = toNs(frame.ts);
+    auto [it, inserted] = flows.try_emplace(key);
+    FlowIndexRecord &r = it->second.record;
+    if (inserted) {
+        r.ipA = key.ipA;
+        r.ipB = key.ipB;
+        r.portA = key.portA;
+        r.portB = key.portB;
+        r.protocol = key.protocol;
+        r.firstPacket = packets;
+        r.firstNs = ts;
+    }
+    r.packets++;
+    r.lastPacket = packets;
+    r.lastNs = ts;
+    r.bytes += static_cast<uint64_t>(frame.frameLength);
+    it->second.offsets.push_back(frame.offset);
+    return true;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Write the index file of the capture
+ *
+ * Nothing is written when the pass was filtered, the source returned frames without a file offset, or the source can
+ * not read its records by offset.
+ * @param captureFile   Capture file that was read
+ * @return              true if the index was written
+ */
+bool FlowIndexWriter::write(const std::string &captureFile, bool debug) const {
+    if (!complete || !source->seekable()) {
+        if (debug) SPDLOG_INFO("Flow index not written: filtered pass or the capture can not be read by offset");
+        return false;
+    }
+    IndexHeader header;
+    std::memcpy(header.magic, indexMagic, sizeof(indexMagic));
+    header.version = indexVersion;
+    header.recordSize = sizeof(FlowIndexRecord);
+    if (!CaptureStamp::read(captureFile, header.stamp)) return false;
+
+    std::vector<const Flow *> sorted;
+    sorted.reserve(flows.size());
+    for (auto const &[key, flow]: flows) sorted.push_back(&flow);
+    std::sort(sorted.begin(), sorted.end(), [](const Flow *a, const Flow *b) { return a->record < b->record; });
+
+    std::vector<FlowIndexRecord> records;
+    records.reserve(sorted.size());
+    for (auto const *flow: sorted) {
+        records.push_back(flow->record);
+        records.back().firstOffset = header.offsetCount;
+        header.offsetCount += flow->offsets.size();
+    }
+    header.recordCount = records.size();
+
+    std::string name{FlowIndex::fileName(captureFile)};
+    std::ofstream file(name, std::ios::binary | std::ios::trunc);
+    if (!file) return false;
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(records.data()),
+               static_cast<std::streamsize>(records.size() * sizeof(FlowIndexRecord)));
+    for (auto const *flow: sorted) {
+        file.write(reinterpret_cast<const char *>(flow->offsets.data()),
+                   static_cast<std::streamsize>(flow->offsets.size() * sizeof(uint64_t)));
+    }
+    if (debug) SPDLOG_INFO("Flow index {}: {} flows, {} packets", name, records.size(), header.offsetCount);
+    return static_cast<bool>(file);
+}
+
+FlowIndex::~FlowIndex() {
+    if (base != nullptr) munmap(const_cast<uint8_t *>(base), size);
+    if (fd >= 0) ::close(fd);
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Map the index file of a capture
+ * @return      false if there is no index or it was built from a different version of the capture
+ */
+bool FlowIndex::open(const std::string &captureFile) {
+    CaptureStamp stamp;
+    if (!CaptureStamp::read(captureFile, stamp)) return false;
+    fd = ::open(fileName(captureFile).c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(IndexHeader)) return false;
+    size = static_cast<size_t>(st.st_size);
+    void *m = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m == MAP_FAILED) {
+        size = 0;
+        return false;
+    }
+    base = static_cast<const uint8_t *>(m);
+
+    IndexHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, indexMagic, sizeof(indexMagic)) != 0 || header.version != indexVersion ||
+        header.recordSize != sizeof(FlowIndexRecord) || !(header.stamp == stamp)) {
+        return false;
+    }
+    size_t needed = sizeof(IndexHeader) + header.recordCount * sizeof(FlowIndexRecord) +
+                    header.offsetCount * sizeof(uint64_t);
+    if (needed != size) return false;
+    records = reinterpret_cast<const FlowIndexRecord *>(base + sizeof(IndexHeader));
+    recordCount = header.recordCount;
+    offsets = reinterpret_cast<const uint64_t *>(records + recordCount);
+    offsetCount = header.offsetCount;
+    return true;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Binary search for a flow
+ * @return      The flow, or nullptr if the capture has no packets of it
+ */
+const FlowIndexRecord *FlowIndex::find(const FlowKey &key) const {
+    if (records == nullptr) return nullptr;
+    FlowIndexRecord probe;
+    probe.ipA = key.ipA;
+    probe.ipB = key.ipB;
+    probe.portA = key.portA;
+    probe.portB = key.portB;
+    probe.protocol = key.protocol;
+    const FlowIndexRecord *end = records + recordCount;
+    const FlowIndexRecord *r = std::lower_bound(records, end, probe);
+    if (r == end || probe < *r) return nullptr;
+    return r;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Record offsets of the TCP, UDP and SCTP packets between two sockets, in capture order
+ * @param ip1       IPv4 address of one side, network byte order
+ * @param port1     Port of that side
+ * @param ip2       IPv4 address of the other side, network byte order
+ * @param port2     Port of the other side
+ */
+std::vector<uint64_t> FlowIndex::socketOffsets(uint32_t ip1, uint16_t port1, uint32_t ip2, uint16_t port2) const {
+    std::vector<uint64_t> result;
+    bool fromA{true};
+    for (uint8_t prot: {uint8_t{6}, uint8_t{17}, uint8_t{132}}) {
+        const FlowIndexRecord *r = find(FlowKey::make(ip1, port1, ip2, port2, prot, fromA));
+        if (r == nullptr || r->firstOffset + r->packets > offsetCount) continue;
+        size_t mid = result.size();
+        result.insert(result.end(), offsets + r->firstOffset, offsets + r->firstOffset + r->packets);
+        std::inplace_merge(result.begin(), result.begin() + static_cast<long>(mid), result.end());
+    }
+    return result;
+}
@@ -0,0 +1,165 @@
+/**
+ * @file
+ * @brief Flow Index
+ *
+ * A sidecar file (<capture>.flowidx) that lists, for every TCP, UDP and SCTP flow of a capture file, the file offsets
+ * of its packet records together with the first and last timestamp, the first and last packet number, and the packet
+ * and byte counts. It is written during a normal pass with --index. Later --list and --filter socket: runs on the same
+ * file look the socket up in the memory mapped index and read only the records of that flow instead of filtering
+ * the whole capture.
+ *
+ * The index records the size and modification time of the capture. It is ignored when they no longer match.
+ * Only IPv4 frames are indexed, of the link types and without the VLAN tags the socket filter reads (NetworkLayer.h).
+ */
+
+#ifndef MACPCAP_FLOWINDEX_H
+#define MACPCAP_FLOWINDEX_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "PacketSource.h"
+#include "CaptureStamp.h"
+#include "../Protocols/FlowKey.h"
+#include "../Protocols/Timestamp.h"
+
+/**
+ * @brief One flow of the index file
+ */
+struct FlowIndexRecord {
+    uint32_t ipA{0};            ///< Network byte order, as in FlowKey
+    uint32_t ipB{0};
+    uint16_t portA{0};
+    uint16_t portB{0};
+    uint8_t protocol{0};
+    uint8_t pad[3]{};
+    uint32_t packets{0};
+    uint32_t firstPacket{0};    ///< Packet number in the capture file, starting at 1
+    uint32_t lastPacket{0};
+    uint32_t reserved{0};
+    TimestampNs firstNs{0};
+    TimestampNs lastNs{0};
+    uint64_t bytes{0};
+    uint64_t firstOffset{0};    ///< Position of the flow's first record offset in the offset array
+
+    [[nodiscard]] bool operator<(const FlowIndexRecord &o) const;
+};
+
+static_assert(sizeof(FlowIndexRecord) == 64, "FlowIndexRecord is written to the index file as is");
+
+/**
+ * @brief Passes the frames of a packet source through and records the flows for the index file
+ */
+class FlowIndexWriter : public PacketSource {
+public:
+    explicit FlowIndexWriter(std::unique_ptr<PacketSource> source) : source(std::move(source)) {}
+
+    bool open() override {
+        return source->open();
+    }
+
+    void close() override {
+        source->close();
+    }
+
+    bool setFilter(const std::string &bpf) override;
+
+    bool getNextPacket(RawFrame &frame) override;
+
+    [[nodiscard]] bool stableFrames() const override {
+        return source->stableFrames();
+    }
+
+    bool write(const std::string &captureFile, bool debug) const;
+
+private:
+    struct Flow {
+        FlowIndexRecord record;
+        std::vector<uint64_t> offsets;
+    };
+
+    std::unique_ptr<PacketSource> source;
+    std::unordered_map<FlowKey, Flow, FlowKeyHash> flows;
+    uint32_t packets{0};
+    bool complete{true};    ///< Every frame had an offset and no filter was set
+};
+
+/**
+ * @brief Read only index of a capture file, memory mapped
+ */
+class FlowIndex {
+public:
+    FlowIndex() = default;
+
+    ~FlowIndex();
+
+    FlowIndex(const FlowIndex &) = delete;
+
+    FlowIndex &operator=(const FlowIndex &) = delete;
+
+    /**
+     * @return  Name of the index file of a capture file
+     */
+    static std::string fileName(const std::string &captureFile) {
+        return captureFile + ".flowidx";
+    }
+
+    bool open(const std::string &captureFile);
+
+    [[nodiscard]] const FlowIndexRecord *find(const FlowKey &key) const;
+
+    [[nodiscard]] std::vector<uint64_t> socketOffsets(uint32_t ip1, uint16_t port1, uint32_t ip2,
+                                                      uint16_t port2) const;
+
+private:
+    int fd{-1};
+    const uint8_t *base{nullptr};
+    size_t size{0};
+    const FlowIndexRecord *records{nullptr};
+    uint64_t recordCount{0};
+    const uint64_t *offsets{nullptr};
+    uint64_t offsetCount{0};
+};
+
+/**
+ * @brief Packet source that reads the records at a list of file offsets from another source
+ */
+class IndexedSource : public PacketSource {
+public:
+    IndexedSource(std::unique_ptr<PacketSource> source, std::vector<uint64_t> offsets) :
+            source(std::move(source)), offsets(std::move(offsets)) {}
+
+    bool open() override {
+        return true;
+    }
+
+    void close() override {
+        source->close();
+    }
+
+    /**
+     * The records were selected by the index, so no filter is needed
+     */
+    bool setFilter(const std::string &) override {
+        return true;
+    }
+
+    bool getNextPacket(RawFrame &frame) override {
+        while (next < offsets.size()) {
+            if (source->readAt(offsets[next++], frame)) return true;
+        }
+        return false;
+    }
+
+    [[nodiscard]] bool stableFrames() const override {
+        return source->stableFrames();
+    }
+
+private:
+    std::unique_ptr<PacketSource> source;
+    std::vector<uint64_t> offsets;
+    size_t next{0};
+};
+
+#endif //MACPCAP_FLOWINDEX_H
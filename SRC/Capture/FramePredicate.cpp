@@ -0,0 +1,332 @@
+/**
+ * @file
+ * @brief Compiled Frame Predicates
+ */
+
+#include "FramePredicate.h"
+#include "NetworkLayer.h"
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <regex>
+#include <arpa/inet.h>
+
+namespace {
+    constexpr uint16_t etherIPv4{0x0800};
+    constexpr uint16_t etherIPv6{0x86dd};
+    constexpr uint16_t etherArp{0x0806};
+    constexpr uint16_t etherRarp{0x8035};
+
+    uint16_t rd16(const uint8_t *p) {
+        return static_cast<uint16_t>(p[0] << 8 | p[1]);
+    }
+
+    bool eq32(const uint8_t *p, uint32_t val) {
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        return v == val;
+    }
+
+    bool ipv4Host(const NetworkLayer &n, uint32_t ip) {
+        return n.type == etherIPv4 && n.len >= 20 && (eq32(n.p + 12, ip) || eq32(n.p + 16, ip));
+    }
+
+    /**
+     * @brief The BPF host primitive: an IPv4 source or destination, or an ARP/RARP sender or target address
+     */
+    bool host(const NetworkLayer &n, uint32_t ip) {
+        if (n.type == etherArp || n.type == etherRarp) {
+            return n.len >= 28 && (eq32(n.p + 14, ip) || eq32(n.p + 24, ip));
+        }
+        return ipv4Host(n, ip);
+    }
+
+    /**
+     * @brief Ports of a TCP, UDP or SCTP packet, read where the BPF port primitive reads them. Only the first
+     * fragment of an IPv4 packet has the ports and IPv6 extension headers are not followed.
+     * @return      false for any other packet
+     */
+    bool transportPorts(const NetworkLayer &n, uint16_t &src, uint16_t &dst) {
+        auto transport = [](uint8_t prot) { return prot == 6 || prot == 17 || prot == 132; };
+        size_t at;
+        if (n.type == etherIPv4) {
+            if (n.len < 20 || !transport(n.p[9]) || (rd16(n.p + 6) & 0x1fff) != 0) return false;
+            at = (n.p[0] & 0x0fu) * 4u;
+        } else if (n.type == etherIPv6) {
+            if (n.len < 40 || !transport(n.p[6])) return false;
+            at = 40;
+        } else {
+            return false;
+        }
+        if (n.len < at + 4) return false;
+        src = rd16(n.p + at);
+        dst = rd16(n.p + at + 2);
+        return true;
+    }
+
+    bool parseIPv4(const std::string &text, uint32_t &ip) {
+        in_addr addr{};
+        if (inet_pton(AF_INET, text.c_str(), &addr) != 1) return false;
+        ip = addr.s_addr;
+        return true;
+    }
+
+    bool parsePort(const std::string &text, uint16_t &port) {
+        const char *end = text.data() + text.size();
+        auto [p, ec] = std::from_chars(text.data(), end, port);
+        return ec == std::errc() && p == end;
+    }
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief ip:x.x.x.x - IPv4 packets from or to the address
+ */
+FramePredicate FramePredicate::ipHost(const std::string &ip) {
+    FramePredicate f;
+    if (parseIPv4(ip, f.ip[0])) f.kind = Kind::ipHost;
+    return f;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief hp:x.x.x.x-y.y.y.y - packets with both hosts
+ */
+FramePredicate FramePredicate::hostPair(const std::string &ip1, const std::string &ip2) {
+    FramePredicate f;
+    if (parseIPv4(ip1, f.ip[0]) && parseIPv4(ip2, f.ip[1])) f.kind = Kind::hostPair;
+    return f;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief port:p - TCP, UDP and SCTP packets from or to the port
+ */
+FramePredicate FramePredicate::port(const std::string &port) {
+    FramePredicate f;
+    if (parsePort(port, f.ports[0])) f.kind = Kind::port;
+    return f;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief socket:x.x.x.x:p-y.y.y.y:q and --list - packets with both hosts and both ports
+ */
+FramePredicate FramePredicate::socket(const std::string &ip1, const std::string &port1, const std::string &ip2,
+                                      const std::string &port2) {
+    FramePredicate f;
+    if (parseIPv4(ip1, f.ip[0]) && parseIPv4(ip2, f.ip[1]) && parsePort(port1, f.ports[0]) &&
+        parsePort(port2, f.ports[1])) {
+        f.kind = Kind::socket;
+    }
+    return f;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief mac:hh:hh:hh:hh:hh:hh - Ethernet frames from or to the MAC address
+ */
+FramePredicate FramePredicate::mac(const std::string &mac) {
+    FramePredicate f;
+    unsigned int b[6];
+    char extra;
+    if (std::sscanf(mac.c_str(), "%2x:%2x:%2x:%2x:%2x:%2x%c", &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &extra) == 6) {
+        for (int i = 0; i < 6; i++) f.macAddr[i] = static_cast<uint8_t>(b[i]);
+        f.kind = Kind::mac;
+    }
+    return f;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief prot:name for tcp, udp, sctp, icmp and arp. Any other name is left to libpcap.
+ */
+FramePredicate FramePredicate::protocol(const std::string &name) {
+    FramePredicate f;
+    f.kind = Kind::protocol;
+    if (name == "tcp") f.ipProtocol = 6;
+    else if (name == "udp") f.ipProtocol = 17;
+    else if (name == "sctp") f.ipProtocol = 132;
+    else if (name == "icmp") {
+        f.ipProtocol = 1;
+        f.ipv6 = false;
+    } else if (name == "arp") f.etherType = etherArp;
+    else f.kind = Kind::none;
+    return f;
+}
+
+/**
+ * @return  true if frames of the link type are tested by match(). Other frames need the BPF program.
+ */
+bool FramePredicate::supports(pcpp::LinkLayerType linkType) const {
+    switch (linkType) {
+        case pcpp::LINKTYPE_ETHERNET:
+            return true;
+        case pcpp::LINKTYPE_LINUX_SLL:
+            return kind != Kind::mac;
+        case pcpp::LINKTYPE_RAW:
+        case pcpp::LINKTYPE_DLT_RAW1:
+        case pcpp::LINKTYPE_DLT_RAW2:
+        case pcpp::LINKTYPE_IPV4:
+        case pcpp::LINKTYPE_IPV6:
+            return kind != Kind::mac && etherType == 0;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Test a frame of a supported link type
+ */
+bool FramePredicate::match(const RawFrame &frame) const {
+    if (kind == Kind::mac) {
+        return frame.length >= 14 &&
+               (std::memcmp(frame.data, macAddr, 6) == 0 || std::memcmp(frame.data + 6, macAddr, 6) == 0);
+    }
+    NetworkLayer n;
+    if (!NetworkLayer::find(frame.data, frame.length, frame.linkType, n)) return false;
+    uint16_t src, dst;
+    switch (kind) {
+        case Kind::ipHost:
+            return ipv4Host(n, ip[0]);
+        case Kind::hostPair:
+            return host(n, ip[0]) && host(n, ip[1]);
+        case Kind::port:
+            return transportPorts(n, src, dst) && (src == ports[0] || dst == ports[0]);
+        case Kind::socket:
+            return transportPorts(n, src, dst) && (src == ports[0] || dst == ports[0]) &&
+                   (src == ports[1] || dst == ports[1]) && ipv4Host(n, ip[0]) && ipv4Host(n, ip[1]);
+        case Kind::protocol:
+            if (etherType != 0) return n.type == etherType;
+            if (n.type == etherIPv4) return n.len >= 20 && n.p[9] == ipProtocol;
+            if (n.type == etherIPv6 && ipv6) {
+                // Also a first fragment whose fragment header is followed by the protocol
+                return n.len >= 40 &&
+                       (n.p[6] == ipProtocol || (n.p[6] == 44 && n.len >= 41 && n.p[40] == ipProtocol));
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Compile the BPF program for a link type
+ * @return      false if libpcap can not compile the BPF string
+ */
+bool FrameFilter::compile(pcpp::LinkLayerType linkType) {
+    programValid = bpf.empty() || program.setFilter(bpf, linkType);
+    programLinkType = linkType;
+    programSet = true;
+    return programValid;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Test a frame with the predicate, or with the BPF program when the predicate can not read it
+ */
+bool FrameFilter::match(const RawFrame &frame) {
+    if (predicate.valid() && predicate.supports(frame.linkType)) return predicate.match(frame);
+    if (bpf.empty()) return true;
+    if (!programSet || programLinkType != frame.linkType) compile(frame.linkType);
+    if (!programValid) return false;
+    pcpp::RawPacket raw(frame.data, frame.length, frame.ts, false, frame.linkType);
+    return program.matchPacketWithFilter(&raw);
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Add a --list value
+ *  - sip:sport-dip:dport   one socket
+ *  - x.x.x.x-y.y.y.y       every flow between two hosts
+ *  - x.x.x.x/len, x.x.x.x  every flow with an endpoint in the subnet, or at the address
+ * @return      false if the value is none of these
+ */
+bool ListSelector::add(const std::string &spec) {
+    static const std::regex socketRgx(R"(^(\d+\.\d+\.\d+\.\d+):(\d+)\-(\d+\.\d+\.\d+\.\d+):(\d+)$)");
+    static const std::regex hostPairRgx(R"(^(\d+\.\d+\.\d+\.\d+)\-(\d+\.\d+\.\d+\.\d+)$)");
+    static const std::regex subnetRgx(R"(^(\d+\.\d+\.\d+\.\d+)(/(\d{1,2}))?$)");
+    std::smatch match;
+    uint32_t ip1, ip2;
+    uint16_t port1, port2;
+    bool fromA;
+    if (std::regex_match(spec, match, socketRgx)) {
+        if (!parseIPv4(match[1], ip1) || !parsePort(match[2], port1) || !parseIPv4(match[3], ip2) ||
+            !parsePort(match[4], port2)) {
+            return false;
+        }
+        sockets.insert(FlowKey::make(ip1, port1, ip2, port2, 6, fromA));
+        sockets.insert(FlowKey::make(ip1, port1, ip2, port2, 17, fromA));
+        return true;
+    }
+    if (std::regex_match(spec, match, hostPairRgx)) {
+        if (!parseIPv4(match[1], ip1) || !parseIPv4(match[2], ip2)) return false;
+        hostPairs.insert(FlowKey::make(ip1, 0, ip2, 0, 0, fromA));
+        return true;
+    }
+    if (std::regex_match(spec, match, subnetRgx)) {
+        int len{32};
+        if (match[3].matched) len = std::stoi(match[3]);
+        if (!parseIPv4(match[1], ip1) || len > 32) return false;
+        uint32_t mask{len == 0 ? 0u : htonl(~0u << (32 - len))};
+        auto it = std::find_if(subnets.begin(), subnets.end(), [mask](const Subnets &s) { return s.mask == mask; });
+        if (it == subnets.end()) it = subnets.insert(subnets.end(), Subnets{mask, {}});
+        it->networks.insert(ip1 & mask);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Test a frame against the sockets, host pairs and subnets
+ * @param key       Receives the socket key of an IPv4 TCP or UDP frame
+ * @param fromA     Receives true if the frame was sent from side A of the key
+ * @return          true if the frame belongs to a listed flow
+ */
+bool ListSelector::match(const RawFrame &frame, FlowKey &key, bool &fromA) const {
+    NetworkLayer n;
+    uint16_t src, dst;
+    if (!NetworkLayer::find(frame.data, frame.length, frame.linkType, n) || n.type != etherIPv4 ||
+        !transportPorts(n, src, dst)) {
+        return false;
+    }
+    uint8_t prot{n.p[9]};
+    if (prot != 6 && prot != 17) return false;
+    uint32_t srcIp, dstIp;
+    std::memcpy(&srcIp, n.p + 12, 4);
+    std::memcpy(&dstIp, n.p + 16, 4);
+    key = FlowKey::make(srcIp, src, dstIp, dst, prot, fromA);
+    if (sockets.contains(key)) return true;
+    bool pairFromA;
+    if (!hostPairs.empty() && hostPairs.contains(FlowKey::make(srcIp, 0, dstIp, 0, 0, pairFromA))) return true;
+    return std::any_of(subnets.begin(), subnets.end(), [srcIp, dstIp](const Subnets &s) {
+        return s.networks.contains(srcIp & s.mask) || s.networks.contains(dstIp & s.mask);
+    });
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Next frame of the source that matches the filter
+ */
+bool FilteredSource::getNextPacket(RawFrame &frame) {
+    while (source->getNextPacket(frame)) {
+        if (filter.match(frame)) return true;
+    }
+    return false;
+}
@@ -0,0 +1,153 @@
+/**
+ * @file
+ * @brief Compiled Frame Predicates
+ *
+ * The structured --filter forms (ip:, hp:, port:, socket:, mac: and the common prot: names) and --list are compiled
+ * into a FramePredicate that tests the raw frame bytes at fixed offsets: a 4 byte compare per IPv4 address, a 2 byte
+ * compare per port and a 6 byte compare per MAC address. The predicates match exactly the packets of the BPF string
+ * the filter used to be turned into: like BPF without the vlan keyword, headers are read at their untagged offsets.
+ * macpcap_bench --checkfilters compares them with libpcap frame by frame.
+ *
+ * Ethernet, Linux cooked and raw IP frames are tested natively. Frames of any other link type go to the equivalent
+ * BPF program, compiled by libpcap for the link type and kept until a frame of another link type. bpf: expressions and
+ * other prot: names still use libpcap for every frame. A BPF string that does not compile matches no frame.
+ *
+ * A ListSelector selects the TCP and UDP flows of several --list values, sockets, host pairs and subnets, with hash
+ * lookups of the normalized keys of the frame.
+ */
+
+#ifndef MACPCAP_FRAMEPREDICATE_H
+#define MACPCAP_FRAMEPREDICATE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <PcapFilter.h>
+#include "PacketSource.h"
+#include "../Protocols/FlowKey.h"
+
+class FramePredicate {
+public:
+    enum class Kind {
+        none, ipHost, hostPair, port, socket, mac, protocol
+    };
+
+    static FramePredicate ipHost(const std::string &ip);
+
+    static FramePredicate hostPair(const std::string &ip1, const std::string &ip2);
+
+    static FramePredicate port(const std::string &port);
+
+    static FramePredicate socket(const std::string &ip1, const std::string &port1, const std::string &ip2,
+                                 const std::string &port2);
+
+    static FramePredicate mac(const std::string &mac);
+
+    static FramePredicate protocol(const std::string &name);
+
+    /**
+     * @return  false if the filter text could not be compiled. The BPF string is then used.
+     */
+    [[nodiscard]] bool valid() const {
+        return kind != Kind::none;
+    }
+
+    [[nodiscard]] bool supports(pcpp::LinkLayerType linkType) const;
+
+    [[nodiscard]] bool match(const RawFrame &frame) const;
+
+private:
+    Kind kind{Kind::none};
+    uint32_t ip[2]{};       ///< Network byte order
+    uint16_t ports[2]{};    ///< Host byte order
+    uint8_t macAddr[6]{};
+    uint16_t etherType{0};  ///< protocol: frames of this EtherType, when not zero
+    uint8_t ipProtocol{0};  ///< protocol: IPv4/IPv6 packets of this protocol, when etherType is zero
+    bool ipv6{true};        ///< protocol: IPv6 packets match too
+};
+
+/**
+ * @brief One --filter: the compiled predicate, and the BPF program for the frames the predicate can not read
+ */
+class FrameFilter {
+public:
+    /**
+     * @param predicate Compiled filter. When it is not valid every frame is tested with the BPF program.
+     * @param bpf       BPF string equivalent to the predicate. Empty matches every frame.
+     */
+    FrameFilter(const FramePredicate &predicate, const std::string &bpf) : predicate(predicate), bpf(bpf) {}
+
+    bool compile(pcpp::LinkLayerType linkType = pcpp::LINKTYPE_ETHERNET);
+
+    bool match(const RawFrame &frame);
+
+private:
+    FramePredicate predicate;
+    std::string bpf;
+    pcpp::BpfFilterWrapper program;
+    bool programSet{false};
+    bool programValid{false};   ///< A program that does not compile matches no frame
+    pcpp::LinkLayerType programLinkType{pcpp::LINKTYPE_ETHERNET};
+};
+
+/**
+ * @brief Packet source that returns only the frames of another source that match a filter
+ */
+class FilteredSource : public PacketSource {
+public:
+    FilteredSource(std::unique_ptr<PacketSource> source, const FramePredicate &predicate, const std::string &bpf) :
+            source(std::move(source)), filter(predicate, bpf) {}
+
+    bool open() override {
+        return true;
+    }
+
+    void close() override {
+        source->close();
+    }
+
+    bool setFilter(const std::string &bpfFilter) override {
+        return source->setFilter(bpfFilter);
+    }
+
+    bool getNextPacket(RawFrame &frame) override;
+
+    [[nodiscard]] bool stableFrames() const override {
+        return source->stableFrames();
+    }
+
+private:
+    std::unique_ptr<PacketSource> source;
+    FrameFilter filter;
+};
+
+/**
+ * @brief Selects the IPv4 TCP and UDP packets of a set of sockets, host pairs and subnets
+ */
+class ListSelector {
+public:
+    bool add(const std::string &spec);
+
+    [[nodiscard]] bool match(const RawFrame &frame, FlowKey &key, bool &fromA) const;
+
+    [[nodiscard]] bool empty() const {
+        return sockets.empty() && hostPairs.empty() && subnets.empty();
+    }
+
+private:
+    /**
+     * @brief The subnets of one prefix length
+     */
+    struct Subnets {
+        uint32_t mask{0};                       ///< Network byte order
+        std::unordered_set<uint32_t> networks;  ///< Network byte order
+    };
+
+    std::unordered_set<FlowKey, FlowKeyHash> sockets;       ///< Socket keys, for TCP and for UDP
+    std::unordered_set<FlowKey, FlowKeyHash> hostPairs;     ///< Host pair keys
+    std::vector<Subnets> subnets;
+};
+
+#endif //MACPCAP_FRAMEPREDICATE_H
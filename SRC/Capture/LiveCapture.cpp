@@ -0,0 +1,117 @@
+/**
+ * @file
+ * @brief Live Capture
+ */
+
+#include "LiveCapture.h"
+#include "../Profile/Profiler.h"
+#include <csignal>
+#include <ctime>
+
+namespace {
+    volatile std::sig_atomic_t stopRequested{0};
+
+    void onInterrupt(int) {
+        stopRequested = 1;
+    }
+}
+
+LiveCapture::~LiveCapture() {
+    close();
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Find the interface by name or IP address and open it in promiscuous mode
+ * @return      false if the interface does not exist or can not be opened
+ */
+bool LiveCapture::open() {
+    device = pcpp::PcapLiveDeviceList::getInstance().getPcapLiveDeviceByIpOrName(interfaceName);
+    if (device == nullptr) {
+        if (debug) SPDLOG_INFO("Interface {} not found", interfaceName);
+        return false;
+    }
+    pcpp::PcapLiveDevice::DeviceConfiguration config(pcpp::PcapLiveDevice::Promiscuous);
+    if (!device->open(config)) {
+        if (debug) SPDLOG_INFO("Could not open interface {}", interfaceName);
+        device = nullptr;
+        return false;
+    }
+    if (debug) SPDLOG_INFO("Opened interface {}", device->getName());
+    return true;
+}
+
+void LiveCapture::close() {
+    if (device != nullptr) device->close();
+    device = nullptr;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @param bpf       Berkeley packet filter. An empty string clears the filter.
+ */
+bool LiveCapture::setFilter(const std::string &bpf) {
+    if (bpf.empty()) return device->clearFilter();
+    return device->setFilter(bpf);
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Called by PcapPlusPlus for every captured packet
+ * @return      true to stop the capture
+ */
+bool LiveCapture::onPacket(pcpp::RawPacket *rawPacket, pcpp::PcapLiveDevice *dev, void *cookie) {
+    auto *self = static_cast<LiveCapture *>(cookie);
+    self->packetCount++;
+    ProfileScope construct(Stage::packet);
+    pcpp::Packet parsedPacket(rawPacket, parseUntilLayer);
+    construct.stop();
+    (*self->currentHandler)(parsedPacket, self->packetCount, *self->currentTables);
+    return stopRequested != 0;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Capture until SIGINT
+ *
+ * @param tables            Statistics tables updated by the handler
+ * @param reportInterval    Seconds between reports
+ * @param handler           Called for each captured packet
+ * @param report            Called at the end of every interval
+ * @return                  Number of packets captured
+ */
+int LiveCapture::run(StatsTables &tables, int reportInterval, const PacketHandler &handler,
+                     const ReportHandler &report) {
+    currentTables = &tables;
+    currentHandler = &handler;
+    packetCount = 0;
+    stopRequested = 0;
+    auto previous = std::signal(SIGINT, onInterrupt);
+    if (reportInterval < 1) reportInterval = 1;
+
+    fmt::print("Capturing on {}. Reports every {} seconds. Ctrl-C to stop.\n", device->getName(), reportInterval);
+    while (stopRequested == 0) {
+        if (device->startCaptureBlockingMode(onPacket, this, reportInterval) == 0) {
+            SPDLOG_INFO("Capture on {} failed", device->getName());
+            break;
+        }
+        if (stopRequested != 0) break;
+
+        report(tables);
+        if (tables.limits.enabled()) {
+            // age on the clock as well, so entries time out when no packets arrive
+            timespec now{};
+            clock_gettime(CLOCK_REALTIME, &now);
+            tables.age(toNs(now));
+        }
+    }
+
+    std::signal(SIGINT, previous);
+    close();
+    if (debug) SPDLOG_INFO("Capture stopped. {} packets", packetCount);
+    return packetCount;
+}
@@ -0,0 +1,51 @@
+/**
+ * @file
+ * @brief Live Capture
+ *
+ * Captures packets from a network interface with a pcpp::PcapLiveDevice and feeds them to the parser. The capture
+ * runs in intervals: at the end of every interval the report callback is called with the current tables and, when
+ * flow limits are set, the entries that have timed out are evicted. The capture stops on SIGINT (Ctrl-C).
+ */
+
+#ifndef MACPCAP_LIVECAPTURE_H
+#define MACPCAP_LIVECAPTURE_H
+
+#include <functional>
+#include <string>
+#include <PcapLiveDevice.h>
+#include <PcapLiveDeviceList.h>
+#include "../Pipeline/Pipeline.h"
+
+/**
+ * Function called at the end of every report interval, and once more when the capture stops
+ */
+using ReportHandler = std::function<void(StatsTables &tables)>;
+
+class LiveCapture {
+public:
+    LiveCapture(std::string interfaceName, bool debug) : interfaceName(std::move(interfaceName)), debug(debug) {}
+
+    ~LiveCapture();
+
+    bool open();
+
+    void close();
+
+    bool setFilter(const std::string &bpf);
+
+    int run(StatsTables &tables, int reportInterval, const PacketHandler &handler, const ReportHandler &report);
+
+private:
+    static bool onPacket(pcpp::RawPacket *rawPacket, pcpp::PcapLiveDevice *dev, void *cookie);
+
+    std::string interfaceName;
+    bool debug{false};
+    pcpp::PcapLiveDevice *device{nullptr};
+
+    // State used by onPacket while run() is capturing
+    StatsTables *currentTables{nullptr};
+    const PacketHandler *currentHandler{nullptr};
+    int packetCount{0};
+};
+
+#endif //MACPCAP_LIVECAPTURE_H
@@ -0,0 +1,364 @@
+/**
+ * @file
+ * @brief Memory Mapped pcap/pcapng Reader
+ *
+ * Classic pcap: 24 byte file header followed by records of a 16 byte header and the captured bytes.
+ * pcapng: a list of blocks (type, total length, body, total length). Section header, interface description,
+ * enhanced packet, simple packet and the obsolete packet block are used. All other blocks are skipped.
+ */
+
+#include "MappedPcapReader.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <spdlog/spdlog.h>
+
+namespace {
+    constexpr uint32_t pcapMagicUs{0xa1b2c3d4};
+    constexpr uint32_t pcapMagicNs{0xa1b23c4d};
+    constexpr uint32_t ngSectionHeader{0x0a0d0d0a};
+    constexpr uint32_t ngByteOrderMagic{0x1a2b3c4d};
+    constexpr uint32_t ngInterfaceDescription{1};
+    constexpr uint32_t ngPacketObsolete{2};
+    constexpr uint32_t ngSimplePacket{3};
+    constexpr uint32_t ngEnhancedPacket{6};
+    constexpr uint16_t ngOptionTsResol{9};
+    constexpr uint32_t maxCapLen{std::numeric_limits<int>::max()};   ///< RawFrame::length is an int
+
+    uint32_t load32(const uint8_t *p) {
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        return v;
+    }
+}
+
+MappedPcapReader::~MappedPcapReader() {
+    close();
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Check the magic number of a file
+ * @param fileName      Capture file
+ * @return              true if the file is a classic pcap or pcapng file
+ */
+bool MappedPcapReader::isSupported(const std::string &fileName) {
+    int f = ::open(fileName.c_str(), O_RDONLY);
+    if (f < 0) return false;
+    uint8_t magic[4]{};
+    ssize_t n = ::read(f, magic, sizeof(magic));
+    ::close(f);
+    if (n != sizeof(magic)) return false;
+    uint32_t m = load32(magic);
+    return m == pcapMagicUs || m == pcapMagicNs || m == __builtin_bswap32(pcapMagicUs) ||
+           m == __builtin_bswap32(pcapMagicNs) || m == ngSectionHeader;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Map the file and read the file (or first section) header
+ * @return      false if the file can not be mapped or is not a pcap/pcapng file
+ */
+bool MappedPcapReader::open() {
+    fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size < 24) {
+        close();
+        return false;
+    }
+    size = static_cast<size_t>(st.st_size);
+    void *m = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (m == MAP_FAILED) {
+        size = 0;
+        close();
+        return false;
+    }
+    base = static_cast<const uint8_t *>(m);
+    madvise(m, size, MADV_SEQUENTIAL);
+    madvise(m, size, MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+    madvise(m, size, MADV_HUGEPAGE);
+#endif
+
+    uint32_t magic = load32(base);
+    if (magic == pcapMagicUs || magic == pcapMagicNs ||
+        magic == __builtin_bswap32(pcapMagicUs) || magic == __builtin_bswap32(pcapMagicNs)) {
+        format = Format::pcap;
+        swapped = (magic != pcapMagicUs && magic != pcapMagicNs);
+        nanoPcap = (magic == pcapMagicNs || magic == __builtin_bswap32(pcapMagicNs));
+        Interface ifc;
+        ifc.linkType = static_cast<pcpp::LinkLayerType>(rd32(base + 20) & 0xffff);
+        interfaces.push_back(ifc);
+        pos = 24;
+        return true;
+    }
+    if (magic == ngSectionHeader) {
+        format = Format::pcapng;
+        pos = 0;
+        if (!readSectionHeader()) return false;
+        // Read the interfaces at the start of the section so a record can be read by offset
+        while (pos + 12 <= size && rd32(base + pos) == ngInterfaceDescription) {
+            uint32_t blockLen = rd32(base + pos + 4);
+            if (blockLen < 12 || pos + blockLen > size) break;
+            addInterface(base + pos + 8, blockLen - 12);
+            pos += blockLen;
+        }
+        return true;
+    }
+    close();
+    return false;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Unmap the file
+ */
+void MappedPcapReader::close() {
+    if (base != nullptr) munmap(const_cast<uint8_t *>(base), size);
+    if (fd >= 0) ::close(fd);
+    base = nullptr;
+    fd = -1;
+    size = 0;
+    pos = 0;
+    format = Format::none;
+    interfaces.clear();
+    sections = 0;
+    lateInterface = false;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Compile a BPF filter. Frames that do not match are skipped by getNextPacket.
+ * @param bpf       Filter string. Empty to clear the filter.
+ */
+bool MappedPcapReader::setFilter(const std::string &bpf) {
+    filtered = !bpf.empty();
+    if (!filtered) return true;
+    pcpp::LinkLayerType lt = interfaces.empty() ? pcpp::LINKTYPE_ETHERNET : interfaces.front().linkType;
+    return bpfFilter.setFilter(bpf, lt);
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @param frame     Receives a pointer into the mapping for the next frame
+ * @return          false at end of file or on a truncated record
+ */
+bool MappedPcapReader::getNextPacket(RawFrame &frame) {
+    while (format == Format::pcap ? nextPcap(frame) : nextPcapNg(frame)) {
+        if (!filtered) return true;
+        pcpp::RawPacket raw(frame.data, frame.length, frame.ts, false, frame.linkType);
+        if (bpfFilter.matchPacketWithFilter(&raw)) return true;
+    }
+    return false;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Read the next classic pcap record
+ */
+bool MappedPcapReader::nextPcap(RawFrame &frame) {
+    if (pos + 16 > size) return false;
+    const uint8_t *h = base + pos;
+    uint32_t capLen = rd32(h + 8);
+    if (capLen > maxCapLen || pos + 16 + capLen > size) return false;
+    frame.data = h + 16;
+    frame.length = static_cast<int>(capLen);
+    frame.frameLength = static_cast<int>(rd32(h + 12));
+    frame.ts.tv_sec = rd32(h);
+    frame.ts.tv_nsec = nanoPcap ? rd32(h + 4) : rd32(h + 4) * 1000L;
+    frame.linkType = interfaces.front().linkType;
+    frame.offset = pos;
+    pos += 16 + capLen;
+    return true;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Read the packet record that starts at a file offset
+ * @param offset    Offset returned in RawFrame::offset by an earlier pass over the same file
+ * @param frame     Receives a pointer into the mapping for the frame
+ * @return          false if there is no packet record at the offset
+ */
+bool MappedPcapReader::readAt(uint64_t offset, RawFrame &frame) {
+    if (base == nullptr || offset >= size) return false;
+    pos = static_cast<size_t>(offset);
+    if (format == Format::pcap) return nextPcap(frame);
+    return nextPcapNg(frame) && frame.offset == offset;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Continue reading at a record offset
+ * @param offset    Offset returned in RawFrame::offset by an earlier pass over the same file
+ */
+bool MappedPcapReader::seek(uint64_t offset) {
+    if (base == nullptr || offset > size || !seekable()) return false;
+    pos = static_cast<size_t>(offset);
+    return true;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Read blocks until the next packet block
+ */
+bool MappedPcapReader::nextPcapNg(RawFrame &frame) {
+    while (pos + 12 <= size) {
+        size_t start = pos;
+        const uint8_t *b = base + pos;
+        uint32_t type = load32(b);
+        if (type == ngSectionHeader) {
+            if (!readSectionHeader()) return false;
+            continue;
+        }
+        uint32_t blockLen = rd32(b + 4);
+        if (blockLen < 12 || pos + blockLen > size) return false;
+        type = rd32(b);
+        const uint8_t *body = b + 8;
+        size_t bodyLen = blockLen - 12;
+        pos += blockLen;
+
+        if (type == ngInterfaceDescription) {
+            addInterface(body, bodyLen);
+            lateInterface = true;
+            continue;
+        }
+
+        if (type == ngEnhancedPacket && bodyLen >= 20) {
+            uint32_t ifId = rd32(body);
+            uint32_t capLen = rd32(body + 12);
+            if (ifId >= interfaces.size() || capLen > maxCapLen || size_t{20} + capLen > bodyLen) continue;
+            const Interface &ifc = interfaces[ifId];
+            frame.data = body + 20;
+            frame.length = static_cast<int>(capLen);
+            frame.frameLength = static_cast<int>(rd32(body + 16));
+            frame.ts = toTimespec(uint64_t(rd32(body + 4)) << 32 | rd32(body + 8), ifc);
+            frame.linkType = ifc.linkType;
+            frame.offset = start;
+            return true;
+        }
+
+        if (type == ngPacketObsolete && bodyLen >= 20) {
+            uint16_t ifId = rd16(body);
+            uint32_t capLen = rd32(body + 12);
+            if (ifId >= interfaces.size() || capLen > maxCapLen || size_t{20} + capLen > bodyLen) continue;
+            const Interface &ifc = interfaces[ifId];
+            frame.data = body + 20;
+            frame.length = static_cast<int>(capLen);
+            frame.frameLength = static_cast<int>(rd32(body + 16));
+            frame.ts = toTimespec(uint64_t(rd32(body + 4)) << 32 | rd32(body + 8), ifc);
+            frame.linkType = ifc.linkType;
+            frame.offset = start;
+            return true;
+        }
+
+        if (type == ngSimplePacket && bodyLen >= 4 && !interfaces.empty()) {
+            uint32_t origLen = rd32(body);
+            frame.data = body + 4;
+            frame.length = static_cast<int>(std::min<size_t>({origLen, bodyLen - 4, maxCapLen}));
+            frame.frameLength = static_cast<int>(origLen);
+            frame.ts = {0, 0};
+            frame.linkType = interfaces.front().linkType;
+            frame.offset = start;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Read a pcapng section header at the current position. Sets the byte order and resets the interface list.
+ */
+bool MappedPcapReader::readSectionHeader() {
+    if (pos + 28 > size) return false;
+    const uint8_t *b = base + pos;
+    uint32_t bom = load32(b + 8);
+    if (bom == ngByteOrderMagic) {
+        swapped = false;
+    } else if (bom == __builtin_bswap32(ngByteOrderMagic)) {
+        swapped = true;
+    } else {
+        SPDLOG_INFO("pcapng section header with bad byte order magic at offset {}", pos);
+        return false;
+    }
+    uint32_t blockLen = rd32(b + 4);
+    if (blockLen < 28 || pos + blockLen > size) return false;
+    interfaces.clear();
+    sections++;
+    pos += blockLen;
+    return true;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Add the interface of an interface description block body
+ */
+void MappedPcapReader::addInterface(const uint8_t *body, size_t bodyLen) {
+    if (bodyLen < 8) return;
+    Interface ifc;
+    ifc.linkType = static_cast<pcpp::LinkLayerType>(rd16(body));
+    // options: code(2) length(2) value padded to 32 bits
+    size_t o{8};
+    while (o + 4 <= bodyLen) {
+        uint16_t code = rd16(body + o);
+        uint16_t len = rd16(body + o + 2);
+        if (code == 0 || o + 4 + len > bodyLen) break;
+        if (code == ngOptionTsResol && len >= 1) {
+            uint8_t r = body[o + 4];
+            if (r & 0x80) {
+                ifc.pow2Shift = r & 0x7f;
+            } else {
+                ifc.unitsPerSec = 1;
+                for (int i = 0; i < r && i < 19; i++) ifc.unitsPerSec *= 10;
+            }
+        }
+        o += 4 + ((len + 3u) & ~3u);
+    }
+    interfaces.push_back(ifc);
+}
+
+uint16_t MappedPcapReader::rd16(const uint8_t *p) const {
+    uint16_t v;
+    std::memcpy(&v, p, 2);
+    return swapped ? __builtin_bswap16(v) : v;
+}
+
+uint32_t MappedPcapReader::rd32(const uint8_t *p) const {
+    uint32_t v = load32(p);
+    return swapped ? __builtin_bswap32(v) : v;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Convert a pcapng timestamp to a timespec using the interface timestamp resolution
+ */
+timespec MappedPcapReader::toTimespec(uint64_t ts, const Interface &ifc) const {
+    timespec t{};
+    if (ifc.pow2Shift != 0) {
+        uint64_t mask = (ifc.pow2Shift >= 64) ? ~0ULL : ((1ULL << ifc.pow2Shift) - 1);
+        t.tv_sec = static_cast<time_t>(ifc.pow2Shift >= 64 ? 0 : ts >> ifc.pow2Shift);
+        t.tv_nsec = static_cast<long>((static_cast<unsigned __int128>(ts & mask) * 1000000000ULL) >> ifc.pow2Shift);
+    } else {
+        t.tv_sec = static_cast<time_t>(ts / ifc.unitsPerSec);
+        uint64_t frac = ts % ifc.unitsPerSec;
+        t.tv_nsec = static_cast<long>(static_cast<unsigned __int128>(frac) * 1000000000ULL / ifc.unitsPerSec);
+    }
+    return t;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file
+ * @brief Memory Mapped pcap/pcapng Reader
+ *
+ * Maps the whole capture file and walks the records in place. Frames are returned as pointers into the mapping so
+ * no packet data is copied or allocated. The mapping is advised for sequential access, and huge pages where the
+ * platform supports them, so repeated runs over a file that is already in the page cache are cheap.
+ */
+
+#ifndef MACPCAP_MAPPEDPCAPREADER_H
+#define MACPCAP_MAPPEDPCAPREADER_H
+
+#include <vector>
+#include <PcapFilter.h>
+#include "PacketSource.h"
+
+class MappedPcapReader : public PacketSource {
+public:
+    explicit MappedPcapReader(std::string fileName) : fileName(std::move(fileName)) {}
+
+    ~MappedPcapReader() override;
+
+    bool open() override;
+
+    void close() override;
+
+    bool setFilter(const std::string &bpf) override;
+
+    bool getNextPacket(RawFrame &frame) override;
+
+    [[nodiscard]] bool stableFrames() const override {
+        return true;
+    }
+
+    /**
+     * Records of a pcapng file with more than one section, or with an interface description after the start of the
+     * section, can not be read by offset, as those interfaces are only known after reading up to them.
+     */
+    [[nodiscard]] bool seekable() const override {
+        return sections <= 1 && !lateInterface;
+    }
+
+    bool readAt(uint64_t offset, RawFrame &frame) override;
+
+    bool seek(uint64_t offset) override;
+
+    static bool isSupported(const std::string &fileName);
+
+private:
+    /**
+     * @brief Interface description from a pcapng IDB (or the pcap file header)
+     */
+    struct Interface {
+        pcpp::LinkLayerType linkType{pcpp::LINKTYPE_ETHERNET};
+        uint64_t unitsPerSec{1000000};  ///< Timestamp units per second when the resolution is a power of 10
+        uint8_t pow2Shift{0};           ///< Timestamp units are 2^-pow2Shift seconds when not zero
+    };
+
+    enum class Format {
+        none, pcap, pcapng
+    };
+
+    bool nextPcap(RawFrame &frame);
+
+    bool nextPcapNg(RawFrame &frame);
+
+    bool readSectionHeader();
+
+    void addInterface(const uint8_t *body, size_t bodyLen);
+
+    [[nodiscard]] uint16_t rd16(const uint8_t *p) const;
+
+    [[nodiscard]] uint32_t rd32(const uint8_t *p) const;
+
+    [[nodiscard]] timespec toTimespec(uint64_t ts, const Interface &ifc) const;
+
+    std::string fileName;
+    int fd{-1};
+    const uint8_t *base{nullptr};
+    size_t size{0};
+    size_t pos{0};
+    Format format{Format::none};
+    bool swapped{false};                ///< File byte order differs from host byte order
+    bool nanoPcap{false};               ///< Classic pcap with nanosecond timestamps
+    std::vector<Interface> interfaces;
+    int sections{0};                    ///< pcapng sections read
+    bool lateInterface{false};          ///< pcapng interface description read after the start of the section
+    bool filtered{false};
+    pcpp::BpfFilterWrapper bpfFilter;
+};
+
+#endif //MACPCAP_MAPPEDPCAPREADER_H
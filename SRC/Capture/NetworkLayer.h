@@ -0,0 +1,72 @@
+/**
+ * @file
+ * @brief Network Layer of a Raw Frame
+ *
+ * Finds the network header of a raw frame at the fixed offset of its link type, without parsing the packet:
+ * Ethernet, Linux cooked capture (SLL) and the raw IP link types. Used by the frame predicates and by the shard hash
+ * of the pipeline. Like a BPF program without the vlan keyword it does not skip VLAN tags: the EtherType of a tagged
+ * frame is 0x8100.
+ */
+
+#ifndef MACPCAP_NETWORKLAYER_H
+#define MACPCAP_NETWORKLAYER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <RawPacket.h>
+
+struct NetworkLayer {
+    static constexpr uint16_t ipv4{0x0800};
+    static constexpr uint16_t ipv6{0x86dd};
+
+    uint16_t type{0};           ///< EtherType
+    const uint8_t *p{nullptr};  ///< First byte of the network header
+    size_t len{0};              ///< Captured bytes from p
+
+    /**
+     * @brief Find the network header of a frame
+     * @param data      Raw frame
+     * @param length    Captured length of the frame
+     * @param linkType  Link type of the frame
+     * @param n         Receives the network layer
+     * @return          false if the frame is too short, or of a link type that is not read at a fixed offset
+     */
+    static bool find(const uint8_t *data, int length, pcpp::LinkLayerType linkType, NetworkLayer &n) {
+        size_t len = length > 0 ? static_cast<size_t>(length) : 0;
+        switch (linkType) {
+            case pcpp::LINKTYPE_ETHERNET:
+                if (len < 14) return false;
+                n = {rd16(data + 12), data + 14, len - 14};
+                return true;
+            case pcpp::LINKTYPE_LINUX_SLL:
+                if (len < 16) return false;
+                n = {rd16(data + 14), data + 16, len - 16};
+                return true;
+            case pcpp::LINKTYPE_RAW:
+            case pcpp::LINKTYPE_DLT_RAW1:
+            case pcpp::LINKTYPE_DLT_RAW2:
+            case pcpp::LINKTYPE_IPV4:
+            case pcpp::LINKTYPE_IPV6:
+                if (len < 1) return false;
+                switch (data[0] >> 4) {
+                    case 4:
+                        n = {ipv4, data, len};
+                        return true;
+                    case 6:
+                        n = {ipv6, data, len};
+                        return true;
+                    default:
+                        return false;
+                }
+            default:
+                return false;
+        }
+    }
+
+private:
+    static uint16_t rd16(const uint8_t *p) {
+        return static_cast<uint16_t>(p[0] << 8 | p[1]);
+    }
+};
+
+#endif //MACPCAP_NETWORKLAYER_H
@@ -0,0 +1,64 @@
+/**
+ * @file
+ * @brief Packet Sources
+ */
+
+#include "PacketSource.h"
+#include "MappedPcapReader.h"
+#include <spdlog/spdlog.h>
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Create a packet source for a capture file
+ *
+ * The memory mapped reader is used for classic pcap and pcapng files. Other files, or all files when mmap is turned
+ * off, are read with the PcapPlusPlus readers.
+ * @param fileName      Capture file
+ * @param useMmap       Use the memory mapped reader when the file format allows it
+ * @return              Packet source. Must be opened by the caller.
+ */
+std::unique_ptr<PacketSource> PacketSource::getSource(const std::string &fileName, bool useMmap, bool debug) {
+    if (useMmap && MappedPcapReader::isSupported(fileName)) {
+        if (debug) SPDLOG_INFO("Using memory mapped reader for {}", fileName);
+        return std::make_unique<MappedPcapReader>(fileName);
+    }
+    if (debug) SPDLOG_INFO("Using PCPP reader for {}", fileName);
+    return std::make_unique<PcapFileSource>(fileName);
+}
+
+PcapFileSource::PcapFileSource(const std::string &fileName) {
+    reader = pcpp::IFileReaderDevice::getReader(fileName);
+}
+
+PcapFileSource::~PcapFileSource() {
+    close();
+    delete reader;
+}
+
+bool PcapFileSource::open() {
+    return reader != nullptr && reader->open();
+}
+
+void PcapFileSource::close() {
+    if (reader != nullptr) reader->close();
+}
+
+bool PcapFileSource::setFilter(const std::string &bpf) {
+    return reader->setFilter(bpf);
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @param frame     Receives the next frame. The bytes are owned by this source and valid until the next call.
+ */
+bool PcapFileSource::getNextPacket(RawFrame &frame) {
+    if (!reader->getNextPacket(rawPacket)) return false;
+    frame.data = rawPacket.getRawData();
+    frame.length = rawPacket.getRawDataLen();
+    frame.frameLength = rawPacket.getFrameLength();
+    frame.ts = rawPacket.getPacketTimeStamp();
+    frame.linkType = rawPacket.getLinkLayerType();
+    return true;
+}
@@ -0,0 +1,128 @@
+/**
+ * @file
+ * @brief Packet Sources
+ *
+ * A packet source returns the frames of a capture one at a time as a RawFrame. The frame points at bytes owned by
+ * the source, so a pcpp::RawPacket can be placed over it without copying:
+ *
+ *      pcpp::RawPacket raw(frame.data, frame.length, frame.ts, false, frame.linkType);
+ *
+ * Two sources are provided for capture files:
+ *  - MappedPcapReader walks a memory mapped pcap or pcapng file in place
+ *  - PcapFileSource uses the PcapPlusPlus file readers and is used for anything the mapped reader does not handle
+ */
+
+#ifndef MACPCAP_PACKETSOURCE_H
+#define MACPCAP_PACKETSOURCE_H
+
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <RawPacket.h>
+#include <ProtocolType.h>
+#include <PcapFileDevice.h>
+
+/**
+ * @brief One frame returned by a packet source
+ */
+struct RawFrame {
+    const uint8_t *data{nullptr};                           ///< Captured bytes of the frame
+    int length{0};                                          ///< Captured length
+    int frameLength{0};                                     ///< Length of the frame on the wire
+    timespec ts{};                                          ///< Packet timestamp
+    pcpp::LinkLayerType linkType{pcpp::LINKTYPE_ETHERNET};  ///< Link type of the frame
+    uint64_t offset{noOffset};                              ///< Offset of the record in the file, if known
+
+    static constexpr uint64_t noOffset{~0ULL};
+};
+
+/**
+ * Deepest layer parsed when a frame is turned into a pcpp::Packet. The statistics only read the headers up to TCP/UDP,
+ * so the application layers are left unparsed unless the packets are logged (--log) or listed (--list).
+ */
+inline pcpp::OsiModelLayer parseUntilLayer{pcpp::OsiModelTransportLayer};
+
+/**
+ * @brief Interface for anything that produces frames
+ */
+class PacketSource {
+public:
+    virtual ~PacketSource() = default;
+
+    virtual bool open() = 0;
+
+    virtual void close() = 0;
+
+    /**
+     * @param bpf       Berkeley packet filter. An empty string clears the filter.
+     * @return          false if the filter could not be compiled
+     */
+    virtual bool setFilter(const std::string &bpf) = 0;
+
+    /**
+     * @param frame     Receives the next frame
+     * @return          false at end of file
+     */
+    virtual bool getNextPacket(RawFrame &frame) = 0;
+
+    /**
+     * @return true if the bytes of a frame stay valid until the source is closed. When false the bytes are only
+     *         valid until the next call to getNextPacket.
+     */
+    [[nodiscard]] virtual bool stableFrames() const {
+        return false;
+    }
+
+    /**
+     * @return true if every frame returned so far can be read again with readAt() using its RawFrame::offset
+     */
+    [[nodiscard]] virtual bool seekable() const {
+        return false;
+    }
+
+    /**
+     * @brief Read the record at a file offset returned in RawFrame::offset. The filter is not applied.
+     * @return          false if the source can not seek or there is no packet record at the offset
+     */
+    virtual bool readAt(uint64_t offset, RawFrame &frame) {
+        (void) offset;
+        (void) frame;
+        return false;
+    }
+
+    /**
+     * @brief Continue reading at a record offset returned in RawFrame::offset
+     * @return          false if the source can not seek
+     */
+    virtual bool seek(uint64_t offset) {
+        (void) offset;
+        return false;
+    }
+
+    static std::unique_ptr<PacketSource> getSource(const std::string &fileName, bool useMmap, bool debug);
+};
+
+/**
+ * @brief Packet source using the PcapPlusPlus file readers
+ */
+class PcapFileSource : public PacketSource {
+public:
+    explicit PcapFileSource(const std::string &fileName);
+
+    ~PcapFileSource() override;
+
+    bool open() override;
+
+    void close() override;
+
+    bool setFilter(const std::string &bpf) override;
+
+    bool getNextPacket(RawFrame &frame) override;
+
+private:
+    pcpp::IFileReaderDevice *reader{nullptr};
+    pcpp::RawPacket rawPacket;
+};
+
+#endif //MACPCAP_PACKETSOURCE_H
@@ -0,0 +1,259 @@
+/**
+ * @file
+ * @brief Timestamp Index and Time Range Reading
+ *
+ * Index file layout, in host byte order: header (magic, version, block size, capture stamp, first packet time,
+ * number of blocks) followed by the blocks in file order.
+ */
+
+#include "TimeIndex.h"
+#include "MappedPcapReader.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <regex>
+#include <spdlog/spdlog.h>
+
+namespace {
+    constexpr char indexMagic[8]{'M', 'P', 'T', 'I', 'M', 'E', 'I', 'X'};
+    constexpr uint32_t indexVersion{1};
+
+    struct IndexHeader {
+        char magic[8]{};
+        uint32_t version{0};
+        uint32_t blockSize{0};
+        CaptureStamp stamp;
+        TimestampNs firstNs{0};
+        uint64_t blockCount{0};
+    };
+
+    /**
+     * @return  Nanoseconds of a decimal fraction such as ".25", 0 for an empty string
+     */
+    TimestampNs fractionNs(const std::string &fraction) {
+        std::string digits{fraction.empty() ? "" : fraction.substr(1)};
+        digits.resize(9, '0');
+        return std::stoll(digits);
+    }
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Parse a --start or --end value
+ *
+ *  - +seconds[.fraction]               relative to the first packet, at most 10 digits of seconds
+ *  - seconds[.fraction]                seconds since the epoch, at most 10 digits of seconds
+ *  - YYYY-MM-DD[ T]HH:MM:SS[.fraction] local time
+ * @return      false if the text is none of these
+ */
+bool TimeBound::parse(const std::string &text, TimeBound &bound) {
+    static const std::regex seconds(R"(^(\+?)(\d{1,10})(\.\d{0,9})?$)");
+    static const std::regex local(R"(^(\d{4})-(\d{2})-(\d{2})[ T](\d{2}):(\d{2}):(\d{2})(\.\d{0,9})?$)");
+    std::smatch match;
+    if (std::regex_match(text, match, seconds)) {
+        TimestampNs s{std::stoll(match[2])};
+        if (s >= std::numeric_limits<TimestampNs>::max() / nsPerSecond) return false;
+        bound.relative = match[1].length() > 0;
+        bound.ns = s * nsPerSecond + fractionNs(match[3]);
+        bound.set = true;
+        return true;
+    }
+    if (std::regex_match(text, match, local)) {
+        std::tm tm{};
+        tm.tm_year = std::stoi(match[1]) - 1900;
+        tm.tm_mon = std::stoi(match[2]) - 1;
+        tm.tm_mday = std::stoi(match[3]);
+        tm.tm_hour = std::stoi(match[4]);
+        tm.tm_min = std::stoi(match[5]);
+        tm.tm_sec = std::stoi(match[6]);
+        tm.tm_isdst = -1;
+        time_t t = std::mktime(&tm);
+        if (t == -1) return false;
+        bound.relative = false;
+        bound.ns = static_cast<TimestampNs>(t) * nsPerSecond + fractionNs(match[7]);
+        bound.set = true;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Load the cached index of a capture, or build and cache it
+ * @return      false if the capture can not be read by offset
+ */
+bool TimeIndex::load(const std::string &captureFile, bool debug) {
+    if (read(captureFile)) {
+        if (debug) SPDLOG_INFO("Timestamp index {}: {} blocks", fileName(captureFile), blocks.size());
+        return true;
+    }
+    if (!build(captureFile)) return false;
+    write(captureFile);
+    if (debug) SPDLOG_INFO("Timestamp index {} built: {} blocks", fileName(captureFile), blocks.size());
+    return true;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Read the cached index
+ * @return      false if there is no index or it was built from a different version of the capture
+ */
+bool TimeIndex::read(const std::string &captureFile) {
+    if (!CaptureStamp::read(captureFile, stamp)) return false;
+    std::ifstream file(fileName(captureFile), std::ios::binary);
+    IndexHeader header;
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header))) return false;
+    if (std::memcmp(header.magic, indexMagic, sizeof(indexMagic)) != 0 || header.version != indexVersion ||
+        header.blockSize != blockRecords || !(header.stamp == stamp)) {
+        return false;
+    }
+    blocks.resize(header.blockCount);
+    if (!file.read(reinterpret_cast<char *>(blocks.data()),
+                   static_cast<std::streamsize>(blocks.size() * sizeof(Block)))) {
+        blocks.clear();
+        return false;
+    }
+    first = header.firstNs;
+    return true;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Build the index with one pass over the record headers of the capture
+ * @return      false if the capture is not a memory mappable file that can be read by offset
+ */
+bool TimeIndex::build(const std::string &captureFile) {
+    if (!CaptureStamp::read(captureFile, stamp) || !MappedPcapReader::isSupported(captureFile)) return false;
+    MappedPcapReader reader(captureFile);
+    if (!reader.open()) return false;
+    blocks.clear();
+    RawFrame frame;
+    uint64_t packets{0};
+    while (reader.getNextPacket(frame)) {
+        TimestampNs ts = toNs(frame.ts);
+        if (packets % blockRecords == 0) blocks.push_back({ts, ts, frame.offset, packets + 1});
+        if (packets == 0) first = ts;
+        Block &b = blocks.back();
+        b.minNs = std::min(b.minNs, ts);
+        b.maxNs = std::max(b.maxNs, ts);
+        packets++;
+    }
+    return reader.seekable();
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Cache the index next to the capture. A capture in a read only directory is simply not cached.
+ */
+void TimeIndex::write(const std::string &captureFile) const {
+    IndexHeader header;
+    std::memcpy(header.magic, indexMagic, sizeof(indexMagic));
+    header.version = indexVersion;
+    header.blockSize = blockRecords;
+    header.stamp = stamp;
+    header.firstNs = first;
+    header.blockCount = blocks.size();
+    std::ofstream file(fileName(captureFile), std::ios::binary | std::ios::trunc);
+    if (!file) return;
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(blocks.data()),
+               static_cast<std::streamsize>(blocks.size() * sizeof(Block)));
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief File offsets holding every packet from start to end
+ *
+ * Reading begins at the first block whose highest time is not before start. It ends at the first block after which
+ * every packet is later than end.
+ */
+TimeIndex::Range TimeIndex::range(TimestampNs start, TimestampNs end) const {
+    Range r;
+    auto it = std::find_if(blocks.begin(), blocks.end(), [start](const Block &b) { return b.maxNs >= start; });
+    if (it == blocks.end()) {
+        r.begin = stamp.size;
+        r.end = stamp.size;
+        return r;
+    }
+    r.begin = it->offset;
+
+    // Lowest time from each block to the end of the file, to find the first block where every later packet is past end
+    auto n = static_cast<size_t>(blocks.end() - it);
+    std::vector<TimestampNs> suffixMin(n);
+    TimestampNs low{std::numeric_limits<TimestampNs>::max()};
+    for (size_t i = n; i-- > 0;) {
+        low = std::min(low, it[static_cast<long>(i)].minNs);
+        suffixMin[i] = low;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (suffixMin[i] > end) {
+            r.end = it[static_cast<long>(i)].offset;
+            break;
+        }
+    }
+    return r;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Resolve the relative bounds and seek the source to the start of the range
+ * @return      false if the source can not seek. The range is then filtered on the time only.
+ */
+bool TimeRangeSource::useIndex(const TimeIndex &index) {
+    resolve(index.firstNs());
+    TimeIndex::Range r{index.range(startNs, endNs)};
+    if (!source->seek(r.begin)) return false;
+    stopOffset = r.end;
+    return true;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Resolve the relative bounds from the first record of the capture file, read with a source of its own
+ * @return      false if the capture has no packet
+ */
+bool TimeRangeSource::resolve(const std::string &captureFile, bool useMmap, bool debug) {
+    std::unique_ptr<PacketSource> first{PacketSource::getSource(captureFile, useMmap, debug)};
+    RawFrame frame;
+    if (!first->open() || !first->getNextPacket(frame)) return false;
+    resolve(toNs(frame.ts));
+    first->close();
+    return true;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Set the absolute bounds
+ * @param first     Time of the first packet of the capture
+ */
+void TimeRangeSource::resolve(TimestampNs first) {
+    if (start.set) startNs = start.relative ? first + start.ns : start.ns;
+    if (end.set) endNs = end.relative ? first + end.ns : end.ns;
+    resolved = true;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Next packet of the source inside the time range
+ */
+bool TimeRangeSource::getNextPacket(RawFrame &frame) {
+    while (source->getNextPacket(frame)) {
+        if (stopOffset != RawFrame::noOffset && frame.offset != RawFrame::noOffset && frame.offset >= stopOffset) {
+            return false;
+        }
+        TimestampNs ts = toNs(frame.ts);
+        if (!resolved) resolve(ts);
+        if (ts >= startNs && ts <= endNs) return true;
+    }
+    return false;
+}
@@ -0,0 +1,140 @@
+/**
+ * @file
+ * @brief Timestamp Index and Time Range Reading
+ *
+ * --start and --end limit the analysis to a time window of a capture file. The bounds are absolute (local time
+ * "2023-04-20 10:15:30.25" or epoch seconds "1681985730.25") or relative to the first packet ("+300", "+300.5").
+ *
+ * A sparse timestamp index (<capture>.tsidx) records, for every block of blockRecords packets, the file offset of
+ * the block's first record and the lowest and highest timestamp in the block. It is built by a first pass over the
+ * file the first time a time range is requested and cached next to the capture. With the index the reader seeks
+ * directly to the first block that can hold the start, and stops at the first block after which no packet is before
+ * the end, so captures with slightly out of order timestamps are still cut exactly.
+ *
+ * Without an index (PcapPlusPlus reader, multi section pcapng) the whole file is read and filtered on the time.
+ * Relative bounds are always taken from the first record of the capture, never from the first packet the wrapped
+ * source returns, which may be filtered or read from the flow index.
+ */
+
+#ifndef MACPCAP_TIMEINDEX_H
+#define MACPCAP_TIMEINDEX_H
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include "PacketSource.h"
+#include "CaptureStamp.h"
+#include "../Protocols/Timestamp.h"
+
+/**
+ * @brief A --start or --end bound
+ */
+struct TimeBound {
+    TimestampNs ns{0};
+    bool relative{false};   ///< ns is an offset from the first packet of the capture
+    bool set{false};
+
+    static bool parse(const std::string &text, TimeBound &bound);
+};
+
+class TimeIndex {
+public:
+    /**
+     * Packets per index block
+     */
+    static constexpr uint64_t blockRecords{4096};
+
+    struct Block {
+        TimestampNs minNs{0};
+        TimestampNs maxNs{0};
+        uint64_t offset{0};         ///< File offset of the first record of the block
+        uint64_t firstPacket{0};    ///< Packet number of the first record, starting at 1
+    };
+
+    /**
+     * @brief File offsets to read for a time range
+     */
+    struct Range {
+        uint64_t begin{0};                          ///< Offset to seek to
+        uint64_t end{RawFrame::noOffset};           ///< Offset to stop at. noOffset reads to the end of the file.
+    };
+
+    /**
+     * @return  Name of the index file of a capture file
+     */
+    static std::string fileName(const std::string &captureFile) {
+        return captureFile + ".tsidx";
+    }
+
+    bool load(const std::string &captureFile, bool debug);
+
+    [[nodiscard]] TimestampNs firstNs() const {
+        return first;
+    }
+
+    [[nodiscard]] Range range(TimestampNs start, TimestampNs end) const;
+
+private:
+    bool read(const std::string &captureFile);
+
+    bool build(const std::string &captureFile);
+
+    void write(const std::string &captureFile) const;
+
+    CaptureStamp stamp;
+    TimestampNs first{0};
+    std::vector<Block> blocks;
+};
+
+/**
+ * @brief Packet source that returns only the packets of another source inside a time range
+ */
+class TimeRangeSource : public PacketSource {
+public:
+    TimeRangeSource(std::unique_ptr<PacketSource> source, TimeBound start, TimeBound end) :
+            source(std::move(source)), start(start), end(end) {}
+
+    bool open() override {
+        return true;
+    }
+
+    void close() override {
+        source->close();
+    }
+
+    bool setFilter(const std::string &bpf) override {
+        return source->setFilter(bpf);
+    }
+
+    bool getNextPacket(RawFrame &frame) override;
+
+    [[nodiscard]] bool stableFrames() const override {
+        return source->stableFrames();
+    }
+
+    bool useIndex(const TimeIndex &index);
+
+    bool resolve(const std::string &captureFile, bool useMmap, bool debug);
+
+    /**
+     * @return  true if the resolved end is before the start
+     */
+    [[nodiscard]] bool inverted() const {
+        return resolved && endNs < startNs;
+    }
+
+private:
+    void resolve(TimestampNs first);
+
+    std::unique_ptr<PacketSource> source;
+    TimeBound start;
+    TimeBound end;
+    TimestampNs startNs{std::numeric_limits<TimestampNs>::min()};
+    TimestampNs endNs{std::numeric_limits<TimestampNs>::max()};
+    bool resolved{false};
+    uint64_t stopOffset{RawFrame::noOffset};
+};
+
+#endif //MACPCAP_TIMEINDEX_H
@@ -0,0 +1,178 @@
+/**
+ * @file
+ * @brief Typed Column Table
+ *
+ * Writes ColumnTables as the record batches of an Arrow IPC file or the row groups of a Parquet file. Needs Apache
+ * Arrow (MACPCAP_WITH_ARROW) and, for Parquet, its Parquet library (MACPCAP_WITH_PARQUET). Without them
+ * ColumnFileWriter::write() throws.
+ */
+
+#include "ColumnTable.h"
+
+#ifdef MACPCAP_WITH_ARROW
+
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <arrow/ipc/writer.h>
+
+#ifdef MACPCAP_WITH_PARQUET
+#include <parquet/arrow/writer.h>
+#endif
+
+namespace {
+    /**
+     * @brief Build the Arrow array of one column
+     * @param rows          Number of rows of the table. Used for a column that never received a value.
+     * @param dictionary    Dictionary encode a string column, otherwise store the string of each row
+     */
+    arrow::Result<std::shared_ptr<arrow::Array>> buildColumn(const ColumnTable::Column &col, size_t rows,
+                                                             bool dictionary) {
+        switch (col.type) {
+            case ColumnTable::Type::int64: {
+                arrow::Int64Builder builder;
+                ARROW_RETURN_NOT_OK(builder.AppendValues(col.ints));
+                return builder.Finish();
+            }
+            case ColumnTable::Type::float64: {
+                arrow::DoubleBuilder builder;
+                ARROW_RETURN_NOT_OK(builder.AppendValues(col.doubles));
+                return builder.Finish();
+            }
+            case ColumnTable::Type::string: {
+                arrow::StringBuilder words;
+                if (!dictionary) {
+                    ARROW_RETURN_NOT_OK(words.Reserve(static_cast<int64_t>(col.codes.size())));
+                    for (auto code: col.codes) ARROW_RETURN_NOT_OK(words.Append(col.dictionary[code]));
+                    return words.Finish();
+                }
+                arrow::Int32Builder codes;
+                ARROW_RETURN_NOT_OK(codes.AppendValues(col.codes));
+                ARROW_ASSIGN_OR_RAISE(auto indices, codes.Finish());
+                ARROW_RETURN_NOT_OK(words.AppendValues(col.dictionary));
+                ARROW_ASSIGN_OR_RAISE(auto values, words.Finish());
+                return arrow::DictionaryArray::FromArrays(arrow::dictionary(arrow::int32(), arrow::utf8()),
+                                                          indices, values);
+            }
+            default:
+                return std::static_pointer_cast<arrow::Array>(
+                        std::make_shared<arrow::NullArray>(static_cast<int64_t>(rows)));
+        }
+    }
+}
+
+struct ColumnFileWriter::Impl {
+    std::shared_ptr<arrow::io::FileOutputStream> out;
+    std::shared_ptr<arrow::Schema> schema;          ///< Schema of the first batch
+    std::shared_ptr<arrow::ipc::RecordBatchWriter> ipc;
+#ifdef MACPCAP_WITH_PARQUET
+    std::unique_ptr<parquet::arrow::FileWriter> rowGroups;
+#endif
+
+    /**
+     * @brief Write one batch, creating the file with the schema of the first batch
+     */
+    arrow::Status write(const ColumnTable &table, const std::string &fileName, bool asParquet) {
+        arrow::FieldVector fields;
+        arrow::ArrayVector arrays;
+        for (auto const &col: table.columns()) {
+            ARROW_ASSIGN_OR_RAISE(auto array, buildColumn(col, table.rows(), asParquet));
+            if (array->length() != static_cast<int64_t>(table.rows())) {
+                return arrow::Status::Invalid("Column ", col.name, " has ", array->length(), " values for ",
+                                              table.rows(), " rows");
+            }
+            fields.push_back(arrow::field(col.name, array->type()));
+            arrays.push_back(std::move(array));
+        }
+        auto batchSchema = arrow::schema(fields);
+        auto batch = arrow::RecordBatch::Make(batchSchema, static_cast<int64_t>(table.rows()), arrays);
+        ARROW_RETURN_NOT_OK(batch->ValidateFull());
+
+        if (!out) {
+            ARROW_ASSIGN_OR_RAISE(out, arrow::io::FileOutputStream::Open(fileName));
+            schema = batchSchema;
+            if (asParquet) {
+#ifdef MACPCAP_WITH_PARQUET
+                ARROW_ASSIGN_OR_RAISE(rowGroups, parquet::arrow::FileWriter::Open(*schema, arrow::default_memory_pool(),
+                                                                                  out));
+#else
+                return arrow::Status::NotImplemented("macpcap was built without Parquet");
+#endif
+            } else {
+                ARROW_ASSIGN_OR_RAISE(ipc, arrow::ipc::MakeFileWriter(out, schema));
+            }
+        } else if (!batchSchema->Equals(*schema)) {
+            return arrow::Status::Invalid("Columns changed from ", schema->ToString(), " to ",
+                                          batchSchema->ToString());
+        }
+
+#ifdef MACPCAP_WITH_PARQUET
+        if (rowGroups) {
+            ARROW_ASSIGN_OR_RAISE(auto rows, arrow::Table::FromRecordBatches(schema, {batch}));
+            return rowGroups->WriteTable(*rows, static_cast<int64_t>(batchRows));
+        }
+#endif
+        return ipc->WriteRecordBatch(*batch);
+    }
+
+    arrow::Status close() {
+#ifdef MACPCAP_WITH_PARQUET
+        if (rowGroups) ARROW_RETURN_NOT_OK(rowGroups->Close());
+#endif
+        if (ipc) ARROW_RETURN_NOT_OK(ipc->Close());
+        return out->Close();
+    }
+};
+
+ColumnFileWriter::ColumnFileWriter(std::string fileName, bool parquet) : fileName(std::move(fileName)),
+                                                                         parquet(parquet),
+                                                                         impl(std::make_unique<Impl>()) {}
+
+ColumnFileWriter::~ColumnFileWriter() = default;
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Write the rows of a table as the next record batch or row group
+ * @throws std::runtime_error if the file can not be written
+ */
+void ColumnFileWriter::write(const ColumnTable &table) {
+    arrow::Status status = impl->write(table, fileName, parquet);
+    if (!status.ok()) throw std::runtime_error(fileName + ": " + status.ToString());
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Finish the file. Does nothing if no batch was written.
+ * @throws std::runtime_error if the file can not be written
+ */
+void ColumnFileWriter::close() {
+    if (!impl->out || impl->out->closed()) return;
+    arrow::Status status = impl->close();
+    if (!status.ok()) throw std::runtime_error(fileName + ": " + status.ToString());
+}
+
+#else
+
+struct ColumnFileWriter::Impl {
+};
+
+ColumnFileWriter::ColumnFileWriter(std::string fileName, bool parquet) : fileName(std::move(fileName)),
+                                                                         parquet(parquet) {}
+
+ColumnFileWriter::~ColumnFileWriter() = default;
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief macpcap was built without Apache Arrow
+ * @throws std::runtime_error always
+ */
+void ColumnFileWriter::write(const ColumnTable &) {
+    throw std::runtime_error("macpcap was built without Apache Arrow, " + fileName + " not written");
+}
+
+void ColumnFileWriter::close() {
+}
+
+#endif
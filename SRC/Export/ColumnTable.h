@@ -0,0 +1,150 @@
+/**
+ * @file
+ * @brief Typed Column Table
+ *
+ * Collects the rows of a report table as typed columns for the columnar export formats. The type of each column is
+ * set by its first value: integers are kept as 64-bit counters, floating point values as doubles and strings are
+ * dictionary encoded, so a MAC address or host pair that appears in many rows is stored once. csvfile fills the
+ * table for --reportType arrow and parquet and hands it to a ColumnFileWriter every ColumnFileWriter::batchRows rows,
+ * so a table is never held in memory whole.
+ */
+
+#ifndef MACPCAP_COLUMNTABLE_H
+#define MACPCAP_COLUMNTABLE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+class ColumnTable {
+public:
+    enum class Type {
+        none, int64, float64, string
+    };
+
+    struct Column {
+        std::string name;
+        Type type{Type::none};
+        std::vector<int64_t> ints;
+        std::vector<double> doubles;
+        std::vector<int32_t> codes;                     ///< Index into dictionary of each row
+        std::vector<std::string> dictionary;
+        std::unordered_map<std::string, int32_t> lookup;
+    };
+
+    /**
+     * @brief Set the column names. Called once with the header row.
+     */
+    void setNames(const std::vector<std::string> &names) {
+        cols.resize(std::max(cols.size(), names.size()));
+        for (size_t i = 0; i < names.size(); i++) cols[i].name = names[i];
+    }
+
+    void add(int64_t val) {
+        Column &col = next(Type::int64);
+        if (col.type == Type::float64) col.doubles.push_back(static_cast<double>(val));
+        else col.ints.push_back(val);
+    }
+
+    void add(double val) {
+        Column &col = next(Type::float64);
+        if (col.type != Type::float64) throw std::invalid_argument("floating point value in column " + col.name);
+        col.doubles.push_back(val);
+    }
+
+    void add(std::string_view val) {
+        Column &col = next(Type::string);
+        if (col.type != Type::string) throw std::invalid_argument("string value in column " + col.name);
+        auto [it, inserted] = col.lookup.try_emplace(std::string(val), static_cast<int32_t>(col.dictionary.size()));
+        if (inserted) col.dictionary.emplace_back(val);
+        col.codes.push_back(it->second);
+    }
+
+    void endrow() {
+        if (field != 0) rowCount++;
+        field = 0;
+    }
+
+    /**
+     * @brief Drop the rows after they are written. The names and types of the columns are kept.
+     */
+    void clear() {
+        for (auto &col: cols) {
+            col.ints.clear();
+            col.doubles.clear();
+            col.codes.clear();
+            col.dictionary.clear();
+            col.lookup.clear();
+        }
+        field = 0;
+        rowCount = 0;
+    }
+
+    [[nodiscard]] const std::vector<Column> &columns() const {
+        return cols;
+    }
+
+    [[nodiscard]] size_t rows() const {
+        return rowCount;
+    }
+
+private:
+    std::vector<Column> cols;
+    size_t field{0};
+    size_t rowCount{0};
+
+    /**
+     * @brief Column of the next field. Its type is set by the first value.
+     */
+    Column &next(Type type) {
+        if (field == cols.size()) cols.emplace_back().name = "Column" + std::to_string(field);
+        Column &col = cols[field++];
+        if (col.type == Type::none) col.type = type;
+        return col;
+    }
+};
+
+/**
+ * @brief Writes ColumnTables as the record batches of one Arrow IPC file, or the row groups of one Parquet file
+ *
+ * The file is created by the first write() and finished by close(). Every batch must have the column names and types
+ * of the first one. A dictionary of the Arrow IPC file format can not change between batches, so Arrow IPC files
+ * store the strings of each row; Parquet dictionary encodes them itself within each row group.
+ */
+class ColumnFileWriter {
+public:
+    /**
+     * Rows collected before they are written as one batch
+     */
+    static constexpr size_t batchRows{1 << 16};
+
+    /**
+     * @param fileName  File name including the extension
+     * @param parquet   Write Parquet instead of Arrow IPC
+     */
+    ColumnFileWriter(std::string fileName, bool parquet);
+
+    ~ColumnFileWriter();
+
+    ColumnFileWriter(const ColumnFileWriter &) = delete;
+
+    ColumnFileWriter &operator=(const ColumnFileWriter &) = delete;
+
+    void write(const ColumnTable &table);
+
+    void close();
+
+private:
+    struct Impl;
+
+    std::string fileName;
+    bool parquet;
+    std::unique_ptr<Impl> impl;
+};
+
+#endif //MACPCAP_COLUMNTABLE_H
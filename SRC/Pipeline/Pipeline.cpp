@@ -0,0 +1,225 @@
+/**
+ * @file
+ * @brief Flow Sharded Packet Pipeline
+ *
+ * The worker threads are started on the concurrencpp thread executor. The reader runs on the calling thread.
+ */
+
+#include "Pipeline.h"
+#include "../Capture/NetworkLayer.h"
+#include "../Profile/Profiler.h"
+#include <concurrencpp/concurrencpp.h>
+#include <cstring>
+#include <exception>
+
+namespace {
+    constexpr size_t batchSize{256};        ///< Packets per batch handed to a worker
+    constexpr size_t queueDepth{64};        ///< Batches queued per worker before the reader blocks
+
+    uint16_t rd16(const uint8_t *p) {
+        return static_cast<uint16_t>(p[0] << 8 | p[1]);
+    }
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Queue a batch. Blocks while the queue is full.
+ * @param batch     Batch to queue
+ * @return          false if the queue has been aborted. The batch is dropped.
+ */
+bool BatchQueue::push(PacketBatch &&batch) {
+    std::unique_lock<std::mutex> lock(mtx);
+    notFull.wait(lock, [this] { return queue.size() < capacity || aborted; });
+    if (aborted) return false;
+    queue.push_back(std::move(batch));
+    notEmpty.notify_one();
+    return true;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Remove the next batch. Blocks while the queue is empty.
+ * @param batch     Receives the batch
+ * @return          false when the queue has been closed and is empty, or has been aborted
+ */
+bool BatchQueue::pop(PacketBatch &batch) {
+    std::unique_lock<std::mutex> lock(mtx);
+    notEmpty.wait(lock, [this] { return !queue.empty() || closed || aborted; });
+    if (queue.empty() || aborted) return false;
+    batch = std::move(queue.front());
+    queue.pop_front();
+    notFull.notify_one();
+    return true;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Tell the worker no more batches will be queued
+ */
+void BatchQueue::close() {
+    std::lock_guard<std::mutex> lock(mtx);
+    closed = true;
+    notEmpty.notify_all();
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Drop the queued batches and wake the reader and the worker. Later pushes and pops fail.
+ */
+void BatchQueue::abort() {
+    std::lock_guard<std::mutex> lock(mtx);
+    aborted = true;
+    queue.clear();
+    notFull.notify_all();
+    notEmpty.notify_all();
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Symmetric shard hash of a raw frame
+ *
+ * Finds the IPv4 header at the fixed offset of the link type (Ethernet, with any VLAN tags skipped, Linux cooked and
+ * raw IP, see NetworkLayer). Both directions of a host pair return the same hash. Ethernet frames without an IPv4
+ * header are hashed on their MAC pair.
+ * @param data          Raw frame
+ * @param length        Captured length of the frame
+ * @param linkType      Link type of the frame
+ * @return              Hash used to pick the worker
+ */
+uint64_t shardHash(const uint8_t *data, int length, pcpp::LinkLayerType linkType) {
+    bool fromA{true};
+    NetworkLayer n;
+    if (!NetworkLayer::find(data, length, linkType, n)) return 0;
+    if (linkType == pcpp::LINKTYPE_ETHERNET) {
+        while ((n.type == 0x8100 || n.type == 0x88a8) && n.len >= 4) {
+            n = {rd16(n.p + 2), n.p + 4, n.len - 4};
+        }
+        if (n.type != NetworkLayer::ipv4) return MacPairKey::make(data + 6, data, fromA).hash;
+    }
+    if (n.type != NetworkLayer::ipv4 || n.len < 20 || (n.p[0] >> 4) != 4) return 0;
+    uint32_t src, dst;
+    std::memcpy(&src, n.p + 12, 4);
+    std::memcpy(&dst, n.p + 16, 4);
+    return FlowKey::makeIpPair(src, dst, fromA).hash;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Read the capture file and process the packets on worker threads
+ *
+ * Packets are routed by host pair, so one MAC pair (a host and its gateway) is seen by many workers. With more than
+ * one worker the flow limits are not applied to MAC pairs: each worker would evict a partial row. MAC pairs are kept
+ * for the whole run and their counters merged once at the end.
+ *
+ * @param source        Open packet source. Any filter must already be set.
+ * @param threads       Number of worker threads
+ * @param tables        Receives the merged statistics tables of all workers
+ * @param handler       Called by the workers for each parsed packet
+ * @param debug         Turn on logging
+ * @return              Number of packets read
+ */
+int runPipeline(PacketSource *source, int threads, StatsTables &tables, const PacketHandler &handler,
+                bool debug) {
+    size_t n = threads > 0 ? static_cast<size_t>(threads) : 1;
+    if (debug) SPDLOG_INFO("Starting pipeline with {} workers", n);
+
+    std::vector<std::unique_ptr<BatchQueue>> queues;
+    std::vector<StatsTables> workerTables(n);
+    for (size_t i = 0; i < n; i++) {
+        queues.emplace_back(std::make_unique<BatchQueue>(queueDepth));
+        workerTables[i].stages = tables.stages;
+        workerTables[i].limits = tables.limits;
+        workerTables[i].limits.macPairs = n == 1;
+        workerTables[i].sink = tables.sink;
+    }
+
+    /**
+     * ### The first exception of a worker or the reader is kept and every queue is aborted
+     */
+    std::mutex errorMtx;
+    std::exception_ptr error;
+    auto fail = [&errorMtx, &error, &queues](std::exception_ptr e) {
+        {
+            std::lock_guard<std::mutex> lock(errorMtx);
+            if (!error) error = std::move(e);
+        }
+        for (auto &q: queues) q->abort();
+    };
+
+    /**
+     * ### Start workers. Each worker parses the packets of its batches into its own tables.
+     */
+    concurrencpp::runtime runtime;
+    std::vector<concurrencpp::result<void>> workers;
+    for (size_t i = 0; i < n; i++) {
+        workers.emplace_back(runtime.thread_executor()->submit([&queues, &workerTables, &handler, &fail, i] {
+            try {
+                PacketBatch batch;
+                while (queues[i]->pop(batch)) {
+                    for (const PacketJob &job: batch.jobs) {
+                        const uint8_t *data = job.data != nullptr ? job.data : batch.arena.data() + job.offset;
+                        pcpp::RawPacket raw(data, job.length, job.ts, false, job.linkType);
+                        ProfileScope construct(Stage::packet);
+                        pcpp::Packet parsedPacket(&raw, parseUntilLayer);
+                        construct.stop();
+                        handler(parsedPacket, job.pc, workerTables[i]);
+                    }
+                }
+            } catch (...) {
+                fail(std::current_exception());
+            }
+        }));
+    }
+
+    /**
+     * ### Read packets and route each to the worker that owns its host pair
+     */
+    std::vector<PacketBatch> pending(n);
+    bool stable = source->stableFrames();
+    RawFrame frame;
+    int packetCount{0};
+    auto readFrame = [source](RawFrame &f) {
+        ProfileScope scope(Stage::read);
+        return source->getNextPacket(f);
+    };
+    try {
+        while (readFrame(frame)) {
+            packetCount++;
+            size_t w = shardHash(frame.data, frame.length, frame.linkType) % n;
+
+            PacketBatch &batch = pending[w];
+            if (stable) {
+                batch.jobs.push_back({frame.data, 0, frame.length, frame.ts, frame.linkType, packetCount});
+            } else {
+                batch.jobs.push_back(
+                        {nullptr, batch.arena.size(), frame.length, frame.ts, frame.linkType, packetCount});
+                batch.arena.insert(batch.arena.end(), frame.data, frame.data + frame.length);
+            }
+            if (batch.jobs.size() >= batchSize) {
+                if (!queues[w]->push(std::move(batch))) break;
+                batch = PacketBatch{};
+            }
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (!pending[i].jobs.empty()) queues[i]->push(std::move(pending[i]));
+        }
+    } catch (...) {
+        fail(std::current_exception());
+    }
+    for (auto &q: queues) q->close();
+
+    /**
+     * ### Wait for the workers, report the first error, and merge their tables
+     */
+    for (auto &w: workers) w.get();
+    if (error) std::rethrow_exception(error);
+    for (auto &t: workerTables) tables.merge(t);
+    if (debug) SPDLOG_INFO("Pipeline complete. {} packets", packetCount);
+    return packetCount;
+}
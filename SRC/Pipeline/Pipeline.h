@@ -0,0 +1,84 @@
+/**
+ * @file
+ * @brief Flow Sharded Packet Pipeline
+ *
+ * One reader thread reads the capture file and hands the raw packets, in batches, to worker threads. A packet is
+ * assigned to a worker by a symmetric hash of its IP pair (MAC pair for non IP frames) so every packet of a host
+ * pair, and therefore of each of its TCP conversations, is processed by the same worker. Each worker owns a private
+ * set of statistics tables. The tables are merged into the caller's tables once the file has been read.
+ *
+ * An exception in a worker or in the reader stops the whole pipeline: every queue is aborted, so neither the reader
+ * nor a worker waits on a queue nobody serves, and the exception is rethrown once the workers have finished.
+ */
+
+#ifndef MACPCAP_PIPELINE_H
+#define MACPCAP_PIPELINE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <Packet.h>
+#include <RawPacket.h>
+#include "../Capture/PacketSource.h"
+#include "../Protocols/parser.h"
+
+/**
+ * @brief A packet waiting to be processed by a worker
+ */
+struct PacketJob {
+    const uint8_t *data{nullptr};                           ///< Frame bytes when the source frames are stable
+    size_t offset{0};                                       ///< Offset of the frame in the batch arena otherwise
+    int length{0};                                          ///< Captured length of the frame
+    timespec ts{};                                          ///< Packet timestamp
+    pcpp::LinkLayerType linkType{pcpp::LINKTYPE_ETHERNET};  ///< Link type of the frame
+    int pc{0};                                              ///< Packet number in the capture file
+};
+
+/**
+ * @brief A batch of packets for one worker. Unless the source frames stay valid (memory mapped file) the frames are
+ * copied back to back into a single arena.
+ */
+struct PacketBatch {
+    std::vector<uint8_t> arena;
+    std::vector<PacketJob> jobs;
+};
+
+/**
+ * @brief Bounded queue of packet batches between the reader and one worker
+ */
+class BatchQueue {
+public:
+    explicit BatchQueue(size_t capacity) : capacity(capacity) {}
+
+    bool push(PacketBatch &&batch);
+
+    bool pop(PacketBatch &batch);
+
+    void close();
+
+    void abort();
+
+private:
+    std::mutex mtx;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    std::deque<PacketBatch> queue;
+    size_t capacity;
+    bool closed{false};
+    bool aborted{false};    ///< A worker or the reader failed. Queued batches are dropped.
+};
+
+/**
+ * Function called by a worker for each packet. Receives the parsed packet, the packet number and the worker's tables.
+ */
+using PacketHandler = std::function<void(pcpp::Packet &pkt, int pc, StatsTables &tables)>;
+
+uint64_t shardHash(const uint8_t *data, int length, pcpp::LinkLayerType linkType);
+
+int runPipeline(PacketSource *source, int threads, StatsTables &tables, const PacketHandler &handler,
+                bool debug);
+
+#endif //MACPCAP_PIPELINE_H
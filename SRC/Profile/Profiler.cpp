@@ -0,0 +1,88 @@
+/**
+ * @file
+ * @brief Hot Path Profiler
+ */
+
+#include "Profiler.h"
+#include <iostream>
+#include <fmt/format.h>
+#include "../include/tabulate.hpp"
+
+namespace {
+    constexpr std::array<const char *, ProfileCounters::stages> stageNames{
+            "Read frame",
+            "Packet construction",
+            "processProtocol",
+            "processEthernet",
+            "processIpPacket",
+            "processTcpPacket",
+            "checkIpId",
+            "processSequenceNumber",
+            "processAck",
+            "Report rendering"
+    };
+}
+
+ProfileCounters *Profiler::registerThread() {
+    std::lock_guard<std::mutex> lock(mtx);
+    threads.push_back(std::make_unique<ProfileCounters>());
+    return threads.back().get();
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Print the time and calls of each stage, summed over all threads, and the peak table sizes
+ * @param elapsedMs     Wall clock time of the run, used for the percentage column
+ * @param peaks         Peak table sizes, summed over the tables of the workers or filters
+ */
+void Profiler::printSummary(double elapsedMs, const TablePeaks &peaks) {
+    std::lock_guard<std::mutex> lock(mtx);
+    ProfileCounters total;
+    for (auto const &c: threads) {
+        for (size_t i = 0; i < ProfileCounters::stages; i++) {
+            total.ns[i] += c->ns[i];
+            total.calls[i] += c->calls[i];
+        }
+    }
+
+    fmt::print("\n\nProfile ({} thread{}, stage times include nested stages)\n\n", threads.size(),
+               threads.size() == 1 ? "" : "s");
+    using namespace tabulate;
+    Table t;
+    t.add_row({"Stage", "Calls", "Time(ms)", "ns/Call", "%Run"});
+    for (size_t i = 0; i < ProfileCounters::stages; i++) {
+        if (total.calls[i] == 0) continue;
+        double ms = static_cast<double>(total.ns[i]) / 1e6;
+        t.add_row({stageNames[i],
+                   std::to_string(total.calls[i]),
+                   fmt::format("{:.3f}", ms),
+                   fmt::format("{:.1f}", static_cast<double>(total.ns[i]) / static_cast<double>(total.calls[i])),
+                   fmt::format("{:.1f}", elapsedMs > 0 ? ms * 100.0 / elapsedMs : 0.0)
+                  });
+    }
+    t.format()
+            .font_style({FontStyle::bold})
+            .hide_border()
+            .border_top(" ")
+            .border_left(" ")
+            .border_right(" ")
+            .corner("");
+    for (auto &cell: t[0]) {
+        cell.format()
+                .border_bottom("")
+                .border_top("")
+                .font_color(Color::green)
+                .font_style({FontStyle::bold});
+    }
+    t.print(std::cout);
+
+    if (peaks.tables > 1) {
+        fmt::print("\nPeak table sizes, summed over {} worker or filter tables (an upper bound on the entries held; an "
+                   "entry held by several tables is counted in each): ", peaks.tables);
+    } else {
+        fmt::print("\nPeak table sizes: ");
+    }
+    fmt::print("host pairs {}, TCP conversations {}, MAC pairs {}\n", peaks.hostPairs, peaks.tcpConversations,
+               peaks.ethernet);
+}
@@ -0,0 +1,126 @@
+/**
+ * @file
+ * @brief Hot Path Profiler
+ *
+ * Optional per-stage timing for --profile. A ProfileScope placed at the top of a stage measures the stage with
+ * std::chrono::steady_clock and adds the time and a call to the counters of the current thread. Each thread has its
+ * own counters, so the workers of the pipeline do not contend. When profiling is off a scope costs one test of
+ * Profiler::enabled.
+ *
+ * Stages nest: the IPv4 stage includes the TCP stage, which includes the IP id, sequence number and ACK stages.
+ */
+
+#ifndef MACPCAP_PROFILER_H
+#define MACPCAP_PROFILER_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Instrumented stages, in the order of the summary
+ */
+enum class Stage : size_t {
+    read, packet, protocol, ethernet, ip, tcp, ipId, sequence, ack, report, count
+};
+
+/**
+ * @brief Counters of one thread
+ */
+struct ProfileCounters {
+    static constexpr size_t stages{static_cast<size_t>(Stage::count)};
+
+    std::array<uint64_t, stages> ns{};
+    std::array<uint64_t, stages> calls{};
+
+    void add(Stage stage, uint64_t elapsedNs) {
+        ns[static_cast<size_t>(stage)] += elapsedNs;
+        calls[static_cast<size_t>(stage)]++;
+    }
+};
+
+/**
+ * @brief Peak sizes of the flow tables of one StatsTables, or their sum over several
+ *
+ * Each set of tables records its own peaks. The sum over the worker or filter tables is the number of entries the
+ * tables held at most, an upper bound since the tables peak at different times. It is not a count of distinct
+ * entries: a MAC pair is held by every worker table that saw it, and a packet by every filter table it matches.
+ */
+struct TablePeaks {
+    size_t tables{0};               ///< Sets of tables summed
+    size_t hostPairs{0};
+    size_t tcpConversations{0};
+    size_t ethernet{0};
+
+    void update(size_t hostPairSize, size_t tcpConversationSize, size_t ethernetSize) {
+        tables = std::max(tables, size_t{1});
+        hostPairs = std::max(hostPairs, hostPairSize);
+        tcpConversations = std::max(tcpConversations, tcpConversationSize);
+        ethernet = std::max(ethernet, ethernetSize);
+    }
+
+    void add(const TablePeaks &other) {
+        tables += other.tables;
+        hostPairs += other.hostPairs;
+        tcpConversations += other.tcpConversations;
+        ethernet += other.ethernet;
+    }
+};
+
+class Profiler {
+public:
+    static inline bool enabled{false};
+
+    /**
+     * @return  Counters of the calling thread. Created on first use and kept until the summary is printed.
+     */
+    static ProfileCounters &local() {
+        thread_local ProfileCounters *counters = registerThread();
+        return *counters;
+    }
+
+    static void printSummary(double elapsedMs, const TablePeaks &peaks);
+
+private:
+    static ProfileCounters *registerThread();
+
+    static inline std::mutex mtx;
+    static inline std::vector<std::unique_ptr<ProfileCounters>> threads;
+};
+
+/**
+ * @brief Times a stage from construction until stop() or destruction
+ */
+class ProfileScope {
+public:
+    explicit ProfileScope(Stage stage) : stage(stage), active(Profiler::enabled) {
+        if (active) start = std::chrono::steady_clock::now();
+    }
+
+    ~ProfileScope() {
+        stop();
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+    void stop() {
+        if (!active) return;
+        active = false;
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        Profiler::local().add(stage,
+                              static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+
+private:
+    Stage stage;
+    bool active;
+    std::chrono::steady_clock::time_point start{};
+};
+
+#endif //MACPCAP_PROFILER_H
@@ -7,78 +7,90 @@
  * @brief EtherNet Statistics
  *
  * This class file contains the code needed to collect Ethernet header layer statistics
- *
- * TODO: All the classes use the same sort algorithms. Find a way to combine into one file.
  */
 #include "EthernetStats.h"
 
 /**
  * @callgraph
  * @callergraph
- * @param pkt               Parsed PcapPlusPLus packet
- * @param debugOption       Turn on/off debug logging
+ * @param view              Decoded packet
+ * @param fromA             True if the frame was sent from side A of the MAC pair key
  */
-void EthernetStats::updateCounters(const pcpp::Packet &pkt) {
-    auto *ethLayer = dynamic_cast<pcpp::EthLayer *>(pkt.getLayerOfType(pcpp::Ethernet));
-    std::string sourceMac = ethLayer->getSourceMac().toString();
-    std::string destMac = ethLayer->getDestMac().toString();
-    std::string key = sourceMac + "<->" + destMac;
-    uint32_t payLoad = ethLayer->getLayerPayloadSize();
+void EthernetStats::updateCounters(const PacketView &view, bool fromA) {
+    uint32_t payLoad = view.ethPayloadLength;
     if (debug) SPDLOG_INFO("Payload Size {}", payLoad);
 
-    // get raw packet so we can get timestamp
-    pcpp::RawPacket *rawPkt = pkt.getRawPacketReadOnly();
-    timespec ts = rawPkt->getPacketTimeStamp();
-    if (firstTimeStamp.tv_sec == 0) firstTimeStamp = ts;
-    duration = EthernetStats::tsConSec(ts) - EthernetStats::tsConSec(firstTimeStamp);
-    packetRate = (duration == 0) ? 0.0 : packets / duration;
+    if (packets == 0) firstNs = view.tsNs;
+    lastNs = view.tsNs;
 
     packets++;
     byteCount += payLoad;
-    if (key == firstSpeaker) {//send
+    if (fromA == firstSpeaker) {//send
         sendPkt++;
         sendByteCount += payLoad;
-        sendPacketRate = (duration == 0) ? 0.0 : sendPkt / duration;
     } else { //recv
         recvPkt++;
         recvByteCount += payLoad;
-        recvPacketRate = (duration == 0) ? 0.0 : recvPkt / duration;
     }
 }
 
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Merge the counters of another instance for the same MAC pair into this one
+ *
+ * Used to combine the tables of the worker threads. A MAC pair (for example a host and its router) is usually seen
+ * by several workers. The first speaker of the instance that saw the earliest frame is kept and the send/receive
+ * counters of the other instance are swapped if it has the opposite first speaker.
+ * @param other     EthernetStats instance with the same key
+ */
+void EthernetStats::merge(const EthernetStats &other) {
+    if (other.packets == 0) return;
+    if (packets == 0) {
+        *this = other;
+        return;
+    }
+    lastNs = std::max(lastNs, other.lastNs);
+    if (other.firstNs < firstNs) {
+        firstNs = other.firstNs;
+        if (firstSpeaker != other.firstSpeaker) {
+            std::swap(sendPkt, recvPkt);
+            std::swap(sendByteCount, recvByteCount);
+            firstSpeaker = other.firstSpeaker;
+        }
+    }
+    bool same = (firstSpeaker == other.firstSpeaker);
+    packets += other.packets;
+    byteCount += other.byteCount;
+    sendPkt += same ? other.sendPkt : other.recvPkt;
+    recvPkt += same ? other.recvPkt : other.sendPkt;
+    sendByteCount += same ? other.sendByteCount : other.recvByteCount;
+    recvByteCount += same ? other.recvByteCount : other.sendByteCount;
+}
+
 /**
  * \callgraph
  * @callergraph
  * @param el    - Ethernet Statistics List
+ * @param top   - Number of rows to write. 0 writes all rows.
  */
 void
-EthernetStats::writeCsvTable(std::map<std::string, EthernetStats> &el, const std::string &ss, bool debug) {
+EthernetStats::writeCsvTable(const EthernetStatsTable &el, const std::string &ss, size_t top, bool debug) {
     /**
     * ##Processing Overview
     *
     * ### Sort map
     */
-    std::vector<std::string> sl{EthernetStats::sortMap(el, ss, debug)};
-    if (sl.empty()) sl = EthernetStats::sortMap(el, "id", debug);
+    std::vector<const EthernetStatsEntry *> sl{EthernetStats::sortMap(el, ss, top, debug)};
+    if (sl.empty()) sl = EthernetStats::sortMap(el, "id", top, debug);
 
     try {
-        csvfile csv("EtherStatsTable.csv"); // throws exceptions!
+        csvfile csv("EtherStatsTable"); // throws exceptions!
         // Header
-        csv << "MacPair" << "PacketCount" << "InPacketCount" << "OutPacketCount" << "ByteCount" << "InByteCnt" <<
-            "OutByteCnt" << "PacketRate" << "InPacketRate" << "OutPacketRate" << "Duration(sec)" << endrow;
+        writeCsvHeader(csv);
         // Data
-        for (auto const &key: sl) {
-            EthernetStats value = el[key];
-            csv << key << std::to_string(value.packets) <<
-                std::to_string(value.sendPkt) <<
-                std::to_string(value.recvPkt) <<
-                std::to_string(value.byteCount) <<
-                std::to_string(value.sendByteCount) <<
-                std::to_string(value.recvByteCount) <<
-                std::to_string(value.packetRate) <<
-                std::to_string(value.recvPacketRate) <<
-                std::to_string(value.sendPacketRate) <<
-                std::to_string(value.duration) << endrow;
+        for (auto const *entry: sl) {
+            entry->second.writeCsvRow(csv, entry->first);
         }
     }
     catch (const std::exception &e) {
@@ -91,9 +103,10 @@ EthernetStats::writeCsvTable(std::map<std::string, EthernetStats> &el, const std
  * \callgraph
  * @callergraph
  * @param el    - Ethernet Statistics List
+ * @param top   - Number of rows to print. 0 prints all rows.
  */
 void
-EthernetStats::printTable(std::map<std::string, EthernetStats> &el, const std::string &ss, bool debug) {
+EthernetStats::printTable(const EthernetStatsTable &el, const std::string &ss, size_t top, bool debug) {
     if (debug) SPDLOG_INFO("Printing EthernetStats Table. ss={}", ss);
     /**
      * ##Processing Overview
@@ -101,8 +114,8 @@ EthernetStats::printTable(std::map<std::string, EthernetStats> &el, const std::s
      * ### Sort map
      */
     fmt::print("\n\nEthernet Stats Table\n\n");
-    std::vector<std::string> sl{EthernetStats::sortMap(el, ss, debug)};
-    if (sl.size() == 0) sl = EthernetStats::sortMap(el, "id", debug);
+    std::vector<const EthernetStatsEntry *> sl{EthernetStats::sortMap(el, ss, top, debug)};
+    if (sl.empty()) sl = EthernetStats::sortMap(el, "id", top, debug);
     /**
      *
      * ### Print report header
@@ -116,19 +129,19 @@ EthernetStats::printTable(std::map<std::string, EthernetStats> &el, const std::s
     /**
      * ### Loop through EthernetStats map and print each record
      */
-    for (auto const &key: sl) {
-        EthernetStats value = el[key];
-        t.add_row({key,
+    for (auto const *entry: sl) {
+        auto const &[key, value] = *entry;
+        t.add_row({value.label(key),
                    std::to_string(value.packets),
                    std::to_string(value.sendPkt),
                    std::to_string(value.recvPkt),
                    std::to_string(value.byteCount),
                    std::to_string(value.sendByteCount),
                    std::to_string(value.recvByteCount),
-                   std::to_string(value.packetRate),
-                   std::to_string(value.recvPacketRate),
-                   std::to_string(value.sendPacketRate),
-                   std::to_string(value.duration)
+                   std::to_string(value.packetRate()),
+                   std::to_string(value.recvPacketRate()),
+                   std::to_string(value.sendPacketRate()),
+                   std::to_string(value.duration())
                   });
     }
     t.format()
@@ -151,100 +164,71 @@ EthernetStats::printTable(std::map<std::string, EthernetStats> &el, const std::s
 }
 
 /**
- * @callgraph
  * @callergraph
- * @param vint      - Vector of pairs in the format <string,int>
- * @return          - string of EthernetStats keys in sorted order
- *
- * sort a list of pairs by second element, in this case int
- */
-std::vector<std::string> EthernetStats::sortInt(std::vector<std::pair<std::string, int >> vint, bool debug) {
-    if (debug) SPDLOG_INFO("");
-    std::vector<std::string> results{};
-    std::sort(vint.begin(), vint.end(), [](auto &left, auto &right) {
-        return left.second > right.second;
-    });
-    for (auto const &p: vint) {
-        results.emplace_back(p.first);
-    }
-    return results;
-}
-
-/**
  * @callgraph
- * @callergraph
- * @param v     Vector of pairs. Each pair is of string,double
- * @return      string of EthernetStats keys in sort order
+ * @param hpl       EthernetStats map
+ * @param colId     Column to sort
+ * @param top       Number of rows to return. 0 returns all rows.
+ * @return          Vector of EthernetStats table entries in sorted order
  *
- * Sort a list of pairs by the second element, in this case doubles.
+ * Routine will take a map of EthernetStats instances and sort it in descending order based on the column ID. The returned
+ * entries point into the EthernetStats list and are used to print the list in sorted order.
  */
-std::vector<std::string> EthernetStats::sortDbl(std::vector<std::pair<std::string, double >> v, bool debug) {
-    if (debug) SPDLOG_INFO("");
-    std::vector<std::string> results{};
-    std::sort(v.begin(), v.end(), [](auto &left, auto &right) {
-        return left.second > right.second;
-    });
-    for (auto const &p: v) {
-        results.emplace_back(p.first);
+std::vector<const EthernetStatsEntry *>
+EthernetStats::sortMap(const EthernetStatsTable &hpl, const std::string &colId, size_t top, bool debug) {
+    if (debug) SPDLOG_INFO("colId {}", colId);
+    std::vector<std::pair<const EthernetStatsEntry *, int >> vint{};
+    std::vector<std::pair<const EthernetStatsEntry *, double >> vdouble{};
+    std::vector<std::pair<const EthernetStatsEntry *, std::string >> vstring{};
+
+    // process int variables
+    for (auto const &entry: hpl) {
+        auto const &[key, value] = entry;
+        if (colId == "id" || colId.starts_with("macp")) vstring.emplace_back(&entry, value.label(key));
+        if (colId == "pc" || colId.starts_with("packetc")) vint.emplace_back(&entry, value.packets);
+        if (colId == "rpc" || colId.starts_with("inpacketc")) vint.emplace_back(&entry, value.recvPkt);
+        if (colId == "spc" || colId.starts_with("outpacketc")) vint.emplace_back(&entry, value.sendPkt);
+        if (colId == "bc" || colId.starts_with("bytec")) vint.emplace_back(&entry, value.byteCount);
+        if (colId == "rbc" || colId.starts_with("inbytec")) vint.emplace_back(&entry, value.recvByteCount);
+        if (colId == "sbc" || colId.starts_with("outbytec")) vint.emplace_back(&entry, value.sendByteCount);
+        if (colId == "pr" || colId.starts_with("pscketr")) vdouble.emplace_back(&entry, value.packetRate());
+        if (colId == "pir" || colId.starts_with("inpacketr")) vdouble.emplace_back(&entry, value.recvPacketRate());
+        if (colId == "opr" || colId.starts_with("outpacketr")) vdouble.emplace_back(&entry, value.sendPacketRate());
+        if (colId == "dur" || colId.starts_with("du")) vdouble.emplace_back(&entry, value.duration());
     }
-    return results;
+    std::vector<const EthernetStatsEntry *> r{};
+    if (!vint.empty()) return sortRows(std::move(vint), top);
+    if (!vdouble.empty()) return sortRows(std::move(vdouble), top);
+    if (!vstring.empty()) return sortRows(std::move(vstring), top);
+    return r;
 }
 
+
 /**
- * @callgraph
+ * \callgraph
  * @callergraph
- * @param v     Vector of pairs. Each pair is of string,double
- * @return      string of EthernetStats keys in sort order
- *
- * Sort a list of pairs by the second element, in this case strings.
+ * @brief Write the column names of the Ethernet CSV table
  */
-std::vector<std::string> EthernetStats::sortStr(std::vector<std::pair<std::string, std::string >> v, bool debug) {
-    if (debug) SPDLOG_INFO("");
-    std::vector<std::string> results{};
-    std::sort(v.begin(), v.end(), [](auto &left, auto &right) {
-        return left.second > right.second;
-    });
-    for (auto const &p: v) {
-        results.emplace_back(p.first);
-    }
-    return results;
+void EthernetStats::writeCsvHeader(csvfile &csv) {
+    csv << "MacPair" << "PacketCount" << "InPacketCount" << "OutPacketCount" << "ByteCount" << "InByteCnt" <<
+        "OutByteCnt" << "PacketRate" << "InPacketRate" << "OutPacketRate" << "Duration(sec)" << endrow;
 }
 
 /**
+ * \callgraph
  * @callergraph
- * @callgraph
- * @param hpl       EthernetStats map
- * @param colId     Column to sort
- * @return          Vector of EthernetStats keys in sorted order
- *
- * Routine will take a map of EthernetStats instances and sort it in descending order based on the column ID. The returned
- * string will be used index the EthernetStats list to print the list in sorted order.
+ * @brief Write this MAC pair as a row of the Ethernet CSV table
+ * @param key       Key of this instance in the Ethernet table
  */
-std::vector<std::string>
-EthernetStats::sortMap(const std::map<std::string, EthernetStats> &hpl, const std::string &colId, bool debug) {
-    if (debug) SPDLOG_INFO("colId {}", colId);
-    std::vector<std::pair<std::string, int >> vint{};
-    std::vector<std::pair<std::string, double >> vdouble{};
-    std::vector<std::pair<std::string, std::string >> vstring{};
-
-    // process int variables
-    for (auto const &[key, value]: hpl) {
-        if (colId == "id" || colId.starts_with("macp")) vstring.emplace_back(key, key);
-        if (colId == "pc" || colId.starts_with("packetc")) vint.emplace_back(key, value.packets);
-        if (colId == "rpc" || colId.starts_with("inpacketc")) vint.emplace_back(key, value.recvPkt);
-        if (colId == "spc" || colId.starts_with("outpacketc")) vint.emplace_back(key, value.sendPkt);
-        if (colId == "bc" || colId.starts_with("bytec")) vint.emplace_back(key, value.byteCount);
-        if (colId == "rbc" || colId.starts_with("inbytec")) vint.emplace_back(key, value.recvByteCount);
-        if (colId == "sbc" || colId.starts_with("outbytec")) vint.emplace_back(key, value.sendByteCount);
-        if (colId == "pr" || colId.starts_with("pscketr")) vdouble.emplace_back(key, value.packetRate);
-        if (colId == "pir" || colId.starts_with("inpacketr")) vdouble.emplace_back(key, value.recvPacketRate);
-        if (colId == "opr" || colId.starts_with("outpacketr")) vdouble.emplace_back(key, value.sendPacketRate);
-        if (colId == "dur" || colId.starts_with("du")) vdouble.emplace_back(key, value.duration);
-    }
-    std::vector<std::string> r{};
-    if (!vint.empty()) return sortInt(vint, debug);
-    if (!vdouble.empty()) return sortDbl(vdouble, debug);
-    if (!vstring.empty()) return sortStr(vstring, debug);
-    return r;
+void EthernetStats::writeCsvRow(csvfile &csv, const MacPairKey &key) const {
+    csv << label(key) << packets <<
+        sendPkt <<
+        recvPkt <<
+        byteCount <<
+        sendByteCount <<
+        recvByteCount <<
+        packetRate() <<
+        recvPacketRate() <<
+        sendPacketRate() <<
+        duration() << endrow;
 }
-
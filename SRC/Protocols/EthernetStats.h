@@ -33,49 +33,81 @@
 #include <EthLayer.h>
 #include "../include/tabulate.hpp"
 #include "../include/csvfile.h"
+#include "FlowKey.h"
+#include "PacketView.h"
+#include "SortRows.h"
+#include <unordered_map>
+#include <list>
 
+class EthernetStats;
+
+/**
+ * Ethernet statistics table. Key is the normalized MAC address pair.
+ */
+using EthernetStatsTable = std::unordered_map<MacPairKey, EthernetStats, MacPairKeyHash>;
+using EthernetStatsEntry = EthernetStatsTable::value_type;
 
 class EthernetStats {
 public:
     bool debug{false};
+    std::list<MacPairKey>::iterator lru{};  ///< Position in the LRU list when flow eviction is on
+
+    void updateCounters(const PacketView &view, bool fromA);
 
-    void updateCounters(const pcpp::Packet &pkt);
+    static void printTable(const EthernetStatsTable &el, const std::string &ss, size_t top, bool debug);
 
-    static void printTable(std::map<std::string, EthernetStats> &el, const std::string &ss, bool debug);
+    static void writeCsvTable(const EthernetStatsTable &el, const std::string &ss, size_t top, bool debug);
 
-    static void writeCsvTable(std::map<std::string, EthernetStats> &el, const std::string &ss, bool debug);
+    static void writeCsvHeader(csvfile &csv);
 
-    static std::vector<std::string>
-    sortMap(const std::map<std::string, EthernetStats> &el, const std::string &colId, bool debug);
+    void writeCsvRow(csvfile &csv, const MacPairKey &key) const;
 
-    static std::vector<std::string> sortInt(std::vector<std::pair<std::string, int >> vint, bool debug);
+    void merge(const EthernetStats &other);
 
-    static std::vector<std::string> sortDbl(std::vector<std::pair<std::string, double >> v, bool debug);
+    static std::vector<const EthernetStatsEntry *>
+    sortMap(const EthernetStatsTable &el, const std::string &colId, size_t top, bool debug);
 
-    static std::vector<std::string> sortStr(std::vector<std::pair<std::string, std::string >> v, bool debug);
+    /**
+     * @return  Timestamp of the last packet
+     */
+    [[nodiscard]] TimestampNs lastSeen() const {
+        return lastNs;
+    }
 
-    static long double tsConSec(timespec ts) {
-        return ((ts.tv_sec) * 1e9 + (ts.tv_nsec)) / 1e9L;
+    /**
+     * @param aFirst    True if side A of the MAC pair key is the first speaker
+     */
+    void setFs(bool aFirst) {
+        firstSpeaker = aFirst;
     }
 
-    void setFs(std::string fs) {
-        firstSpeaker = fs;
+    /**
+     * @brief MAC pair label used in the reports
+     * @param key   Key of this instance in the ethernet statistics table
+     * @return      String in the format smac<->dmac with the first speaker first
+     */
+    [[nodiscard]] std::string label(const MacPairKey &key) const {
+        return key.toString(firstSpeaker);
     }
 
 private:
-    timespec firstTimeStamp{NULL};
-    std::string firstSpeaker{};
+    TimestampNs firstNs{0};
+    TimestampNs lastNs{0};
+    bool firstSpeaker{true};
     uint32_t packets{0};
     uint32_t sendPkt{0};
     uint32_t recvPkt{0};
     uint32_t byteCount{0};
     uint32_t sendByteCount{0};
     uint32_t recvByteCount{0};
-    double packetRate{0.0};
-    double recvPacketRate{0.0};
-    double sendPacketRate{0.0};
-    long double duration{0.0};
 
+    [[nodiscard]] double duration() const { return nsToSeconds(lastNs - firstNs); }
+
+    [[nodiscard]] double packetRate() const { return perSecond(packets, lastNs - firstNs); }
+
+    [[nodiscard]] double recvPacketRate() const { return perSecond(recvPkt, lastNs - firstNs); }
+
+    [[nodiscard]] double sendPacketRate() const { return perSecond(sendPkt, lastNs - firstNs); }
 
 };
 
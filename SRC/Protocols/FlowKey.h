@@ -0,0 +1,172 @@
+/**
+ * @file
+ * @brief Binary Flow Keys
+ *
+ * Keys used to index the statistics tables. A key is built from the raw header fields of a packet and is
+ * normalized so both directions of a conversation produce the same key. The hash is computed once when the key is
+ * built. Strings are only created from a key when a report is written.
+ */
+
+#ifndef MACPCAP_FLOWKEY_H
+#define MACPCAP_FLOWKEY_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <fmt/format.h>
+#include <IpAddress.h>
+#include <MacAddress.h>
+
+/**
+ * @brief Mix a 64 bit value (splitmix64 finalizer)
+ * @param x     Value to mix
+ * @return      Mixed value
+ */
+inline uint64_t flowMix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/**
+ * @brief Direction normalized 5-tuple
+ *
+ * The endpoint with the lower (address, port) is always stored as side A. When the key is built the caller is told
+ * if the packet was sent from side A, which is all that is needed to decide the send/receive direction of the packet.
+ * A host pair key is a FlowKey with the ports and protocol set to zero.
+ */
+struct FlowKey {
+    uint32_t ipA{0};        ///< Side A IPv4 address, network byte order
+    uint32_t ipB{0};        ///< Side B IPv4 address, network byte order
+    uint16_t portA{0};      ///< Side A port, host byte order
+    uint16_t portB{0};      ///< Side B port, host byte order
+    uint8_t protocol{0};    ///< IP protocol number
+    uint64_t hash{0};       ///< Precomputed hash of the fields above
+
+    /**
+     * @brief Build a normalized key
+     * @param srcIp     Source IPv4 address (network byte order)
+     * @param srcPort   Source port (host byte order)
+     * @param dstIp     Destination IPv4 address (network byte order)
+     * @param dstPort   Destination port (host byte order)
+     * @param prot      IP protocol number
+     * @param fromA     Set to true if the packet was sent from side A of the key
+     * @return          Normalized key
+     */
+    static FlowKey make(uint32_t srcIp, uint16_t srcPort, uint32_t dstIp, uint16_t dstPort, uint8_t prot,
+                        bool &fromA) {
+        FlowKey k;
+        fromA = (srcIp < dstIp) || (srcIp == dstIp && srcPort <= dstPort);
+        if (fromA) {
+            k.ipA = srcIp;
+            k.portA = srcPort;
+            k.ipB = dstIp;
+            k.portB = dstPort;
+        } else {
+            k.ipA = dstIp;
+            k.portA = dstPort;
+            k.ipB = srcIp;
+            k.portB = srcPort;
+        }
+        k.protocol = prot;
+        k.hash = flowMix((uint64_t(k.ipA) << 32 | k.ipB) ^
+                         flowMix(uint64_t(k.portA) << 24 | uint64_t(k.portB) << 8 | k.protocol));
+        return k;
+    }
+
+    /**
+     * @brief Build a normalized host pair key
+     */
+    static FlowKey makeIpPair(uint32_t srcIp, uint32_t dstIp, bool &fromA) {
+        return make(srcIp, 0, dstIp, 0, 0, fromA);
+    }
+
+    bool operator==(const FlowKey &o) const {
+        return ipA == o.ipA && ipB == o.ipB && portA == o.portA && portB == o.portB && protocol == o.protocol;
+    }
+
+    /**
+     * @brief Socket string in the format sip:sport-dip:dport
+     * @param aFirst    Put side A first. Use the first speaker of the conversation.
+     */
+    [[nodiscard]] std::string toString(bool aFirst) const {
+        std::string a{pcpp::IPv4Address(ipA).toString()};
+        std::string b{pcpp::IPv4Address(ipB).toString()};
+        return aFirst ? fmt::format("{}:{}-{}:{}", a, portA, b, portB)
+                      : fmt::format("{}:{}-{}:{}", b, portB, a, portA);
+    }
+
+    /**
+     * @brief Host pair string in the format sip-dip
+     * @param aFirst    Put side A first. Use the first speaker of the host pair.
+     */
+    [[nodiscard]] std::string ipPairString(bool aFirst) const {
+        std::string a{pcpp::IPv4Address(ipA).toString()};
+        std::string b{pcpp::IPv4Address(ipB).toString()};
+        return aFirst ? a + "-" + b : b + "-" + a;
+    }
+};
+
+/**
+ * @brief Hash functor for FlowKey. Returns the precomputed hash.
+ */
+struct FlowKeyHash {
+    size_t operator()(const FlowKey &k) const noexcept {
+        return static_cast<size_t>(k.hash);
+    }
+};
+
+/**
+ * @brief Direction normalized pair of MAC addresses
+ */
+struct MacPairKey {
+    uint8_t macA[6]{};
+    uint8_t macB[6]{};
+    uint64_t hash{0};
+
+    /**
+     * @brief Build a normalized MAC pair key
+     * @param src       Source MAC address (6 bytes)
+     * @param dst       Destination MAC address (6 bytes)
+     * @param fromA     Set to true if the frame was sent from side A of the key
+     */
+    static MacPairKey make(const uint8_t *src, const uint8_t *dst, bool &fromA) {
+        MacPairKey k;
+        fromA = std::memcmp(src, dst, 6) <= 0;
+        std::memcpy(k.macA, fromA ? src : dst, 6);
+        std::memcpy(k.macB, fromA ? dst : src, 6);
+        uint64_t a{0}, b{0};
+        std::memcpy(&a, k.macA, 6);
+        std::memcpy(&b, k.macB, 6);
+        k.hash = flowMix(a ^ flowMix(b));
+        return k;
+    }
+
+    bool operator==(const MacPairKey &o) const {
+        return std::memcmp(macA, o.macA, 6) == 0 && std::memcmp(macB, o.macB, 6) == 0;
+    }
+
+    /**
+     * @brief MAC pair string in the format smac<->dmac
+     * @param aFirst    Put side A first. Use the first speaker of the MAC pair.
+     */
+    [[nodiscard]] std::string toString(bool aFirst) const {
+        std::string a{pcpp::MacAddress(macA).toString()};
+        std::string b{pcpp::MacAddress(macB).toString()};
+        return aFirst ? a + "<->" + b : b + "<->" + a;
+    }
+};
+
+/**
+ * @brief Hash functor for MacPairKey. Returns the precomputed hash.
+ */
+struct MacPairKeyHash {
+    size_t operator()(const MacPairKey &k) const noexcept {
+        return static_cast<size_t>(k.hash);
+    }
+};
+
+#endif //MACPCAP_FLOWKEY_H
@@ -0,0 +1,52 @@
+/**
+ * @file
+ * @brief Evicted Flow Sink
+ */
+
+#include "FlowSink.h"
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Finalize an evicted TCP conversation and append it to EvictedTcpConversationStatsTable.csv
+ */
+void FlowSink::write(const FlowKey &key, TCPConversation &tcpc) {
+    tcpc.finalize();
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!tcpCsv) {
+        tcpCsv = std::make_unique<csvfile>(prefix + "EvictedTcpConversationStatsTable");
+        TCPConversation::writeCsvHeader(*tcpCsv);
+    }
+    tcpc.writeCsvRow(*tcpCsv, key);
+    written++;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Append an evicted host pair to EvictedHostPairTable.csv
+ */
+void FlowSink::write(const FlowKey &key, const HostPair &hp) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!hostPairCsv) {
+        hostPairCsv = std::make_unique<csvfile>(prefix + "EvictedHostPairTable");
+        HostPair::writeCsvHeader(*hostPairCsv);
+    }
+    hp.writeCsvRow(*hostPairCsv, key);
+    written++;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Append an evicted MAC pair to EvictedEtherStatsTable.csv
+ */
+void FlowSink::write(const MacPairKey &key, const EthernetStats &es) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!ethernetCsv) {
+        ethernetCsv = std::make_unique<csvfile>(prefix + "EvictedEtherStatsTable");
+        EthernetStats::writeCsvHeader(*ethernetCsv);
+    }
+    es.writeCsvRow(*ethernetCsv, key);
+    written++;
+}
@@ -0,0 +1,50 @@
+/**
+ * @file
+ * @brief Evicted Flow Sink
+ *
+ * Entries removed from the statistics tables before the end of the capture (idle timeout, closed TCP conversation or
+ * table limit) are written here as rows of the same CSV tables the reports produce. The files are named after the
+ * report files with an "Evicted" prefix and are created when the first entry of the table is evicted. A sink may be
+ * shared by the pipeline workers.
+ */
+
+#ifndef MACPCAP_FLOWSINK_H
+#define MACPCAP_FLOWSINK_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include "HostPair.h"
+#include "TCPConversation.h"
+#include "EthernetStats.h"
+
+class FlowSink {
+public:
+    /**
+     * @param prefix    Prepended to the file names, to keep the evicted entries of several filters apart
+     */
+    explicit FlowSink(std::string prefix = {}) : prefix(std::move(prefix)) {}
+
+    void write(const FlowKey &key, TCPConversation &tcpc);
+
+    void write(const FlowKey &key, const HostPair &hp);
+
+    void write(const MacPairKey &key, const EthernetStats &es);
+
+    /**
+     * @return  Number of entries written
+     */
+    [[nodiscard]] size_t count() const {
+        return written;
+    }
+
+private:
+    std::string prefix;
+    std::mutex mtx;
+    std::unique_ptr<csvfile> tcpCsv;
+    std::unique_ptr<csvfile> hostPairCsv;
+    std::unique_ptr<csvfile> ethernetCsv;
+    size_t written{0};
+};
+
+#endif //MACPCAP_FLOWSINK_H
@@ -10,62 +10,89 @@
 /**
  * @callgraph
  * @callergraph
- * @param pkt                   PcapPlus Parsed Packet
- * @param ipHdr                 Address of the IP packet header
- * @param currentIPAddress      This is the HostPair IP addresses for the current packet. Used to determine first speaker.
+ * @param view                  Decoded packet
+ * @param fromA                 True if the packet was sent from side A of the host pair key. Used with the first
+ *                              speaker to determine the direction of the packet.
  */
-void HostPair::updateCounters(const pcpp::Packet &pkt, pcpp::Layer &ipHdr,
-                              std::string &currentIPAddress) {
+void HostPair::updateCounters(const PacketView &view, bool fromA) {
     if (debug) SPDLOG_INFO("");
-    // get raw packet so we can get timestamp
-    pcpp::RawPacket *rawPkt = pkt.getRawPacketReadOnly();
-    timespec ts = rawPkt->getPacketTimeStamp();
     if (!firstTS) {
-        firstTimeStamp = ts;
+        firstNs = view.tsNs;
         firstTS = true;
     }
+    lastNs = view.tsNs;
     // add statistics to HostPair class
     packetCount++;
-    duration = tsConSec(ts) - tsConSec(firstTimeStamp);
-    packetRate = (duration == 0) ? 0.0 : packetCount / duration;
-    int dataLen = ipHdr.getLayerPayloadSize();
+    int dataLen = static_cast<int>(view.ipPayloadLength);
     byteCount += dataLen;
-    if (firstSpeaker == currentIPAddress) {
+    if (firstSpeaker == fromA) {
         outputPacketCount++;
         outputByteCount += dataLen;
-        outputPacketRate = (duration == 0) ? 0.0 : outputPacketCount / duration;
     } else {
         inputPacketCount++;
         inputByteCount += dataLen;
-        inputPacketRate = (duration == 0) ? 0.0 : inputPacketCount / duration;
     }
 }
 
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Merge the counters of another instance for the same host pair into this one
+ *
+ * Used to combine the tables of the worker threads. The first speaker of the instance that saw the earliest packet
+ * is kept and the in/out counters of the other instance are swapped if it has the opposite first speaker.
+ * @param other     HostPair instance with the same key
+ */
+void HostPair::merge(const HostPair &other) {
+    if (!other.firstTS) return;
+    if (!firstTS) {
+        *this = other;
+        return;
+    }
+    lastNs = std::max(lastNs, other.lastNs);
+    if (other.firstNs < firstNs) {
+        firstNs = other.firstNs;
+        if (firstSpeaker != other.firstSpeaker) {
+            std::swap(inputPacketCount, outputPacketCount);
+            std::swap(inputByteCount, outputByteCount);
+            firstSpeaker = other.firstSpeaker;
+        }
+    }
+    bool same = (firstSpeaker == other.firstSpeaker);
+    packetCount += other.packetCount;
+    byteCount += other.byteCount;
+    inputPacketCount += same ? other.inputPacketCount : other.outputPacketCount;
+    outputPacketCount += same ? other.outputPacketCount : other.inputPacketCount;
+    inputByteCount += same ? other.inputByteCount : other.outputByteCount;
+    outputByteCount += same ? other.outputByteCount : other.inputByteCount;
+}
+
 /**
  * \callgraph
  * @callergraph
- * @param s
+ * @param aFirst    True if side A of the host pair key is the first speaker
  */
-void HostPair::setFirstSpeaker(std::string s) {
-    HostPair::firstSpeaker = s;
+void HostPair::setFirstSpeaker(bool aFirst) {
+    HostPair::firstSpeaker = aFirst;
 }
 
 /**
  * \callgraph
  * @callergraph
- * @return
+ * @return      True if side A of the host pair key is the first speaker
  */
-std::string HostPair::getFirstSpeaker() {
+bool HostPair::getFirstSpeaker() const {
     return HostPair::firstSpeaker;
 }
 
 /**
  * \callgraph
  * @callergraph
- * @param hpl       Host Pair List. A map whose key is a string of IP pair (source and destination) addresses. The value
- *                  of the map is a HostPair class object.
+ * @param hpl       Host Pair List. A map whose key is the normalized IP pair (source and destination) addresses. The
+ *                  value of the map is a HostPair class object.
+ * @param top       Number of rows to print. 0 prints all rows.
  */
-void HostPair::printTable(std::map<std::string, HostPair> &hpl, const std::string &ss, bool debug) {
+void HostPair::printTable(const HostPairTable &hpl, const std::string &ss, size_t top, bool debug) {
     if (debug) SPDLOG_INFO("Printing HostPair Table. ss={}", ss);
     /**
      * ##Processing Overview
@@ -73,8 +100,8 @@ void HostPair::printTable(std::map<std::string, HostPair> &hpl, const std::strin
      * ### Sort map
      */
     fmt::print("\n\nHost Pair List Report\n\n");
-    std::vector<std::string> sl{HostPair::sortMap(hpl, ss)};
-    if (sl.empty()) sl = HostPair::sortMap(hpl, "id");
+    std::vector<const HostPairEntry *> sl{HostPair::sortMap(hpl, ss, top)};
+    if (sl.empty()) sl = HostPair::sortMap(hpl, "id", top);
     /**
      *
      * ### Print report header
@@ -98,20 +125,20 @@ void HostPair::printTable(std::map<std::string, HostPair> &hpl, const std::strin
     /**
      * ### Loop through HostPair map and print each record
      */
-    for (auto const &key: sl) {
-        HostPair value = hpl[key];
+    for (auto const *entry: sl) {
+        auto const &[key, value] = *entry;
         t.add_row({
-                          key,
+                          value.label(key),
                           std::to_string(value.packetCount),
                           std::to_string(value.inputPacketCount),
                           std::to_string(value.outputPacketCount),
                           std::to_string(value.byteCount),
                           std::to_string(value.inputByteCount),
                           std::to_string(value.outputByteCount),
-                          std::to_string(value.packetRate),
-                          std::to_string(value.inputPacketRate),
-                          std::to_string(value.outputPacketRate),
-                          std::to_string(value.duration)
+                          std::to_string(value.packetRate()),
+                          std::to_string(value.inputPacketRate()),
+                          std::to_string(value.outputPacketRate()),
+                          std::to_string(value.duration())
                   });
     }
     t.format()
@@ -134,168 +161,68 @@ void HostPair::printTable(std::map<std::string, HostPair> &hpl, const std::strin
 }
 
 /**
- * @callgraph
- * @callergraph
- * @param vint      - Vector of pairs in the format <string,int>
- * @return          - string of HostPair keys in sorted order
- *
- * sort a list of pairs by second element, in this case int
- */
-std::vector<std::string> HostPair::sortInt(std::vector<std::pair<std::string, int >> vint) {
-    std::vector<std::string> results{};
-    std::sort(vint.begin(), vint.end(), [](auto &left, auto &right) {
-        return left.second > right.second;
-    });
-    for (auto const &p: vint) {
-        results.emplace_back(p.first);
-    }
-    return results;
-}
-
-/**
- * @callgraph
  * @callergraph
- * @param v     Vector of pairs. Each pair is of string,double
- * @return      string of HostPair keys in sort order
- *
- * Sort a list of pairs by the second element, in this case doubles.
- */
-std::vector<std::string> HostPair::sortDbl(std::vector<std::pair<std::string, double >> v) {
-    std::vector<std::string> results{};
-    std::sort(v.begin(), v.end(), [](auto &left, auto &right) {
-        return left.second > right.second;
-    });
-    for (auto const &p: v) {
-        results.emplace_back(p.first);
-    }
-    return results;
-}
-
-/**
  * @callgraph
- * @callergraph
- * @param v     Vector of pairs. Each pair is of string,double
- * @return      string of HostPair keys in sort order
- *
- * Sort a list of pairs by the second element, in this case strings.
- */
-std::vector<std::string> HostPair::sortStr(std::vector<std::pair<std::string, std::string >> v) {
-    std::vector<std::string> results{};
-    std::sort(v.begin(), v.end(), [](auto &left, auto &right) {
-        return left.second > right.second;
-    });
-    for (auto const &p: v) {
-        results.emplace_back(p.first);
-    }
-    return results;
-}
-
-/**
- * @callergraph
- * @callgraph
- * @param hpl       Host Pair List. A map whose key is a string of IP pair (source and destination) addresses. The value
- *                  of the map is a HostPair class object.
+ * @param hpl       Host Pair List. A map whose key is the normalized IP pair (source and destination) addresses. The
+ *                  value of the map is a HostPair class object.
  * @param colId     Column to sort
- * @return          Vector of HostPair keys in sorted order
+ * @param top       Number of rows to return. 0 returns all rows.
+ * @return          Vector of HostPair table entries in sorted order
  *
  * Routine will take a map of HostPair instances and sort it in descending order based on the column ID. The returned
- * string will be used index the HostPair list to print the list in sorted order.
+ * entries point into the HostPair list and are used to print the list in sorted order.
  */
-std::vector<std::string> HostPair::sortMap(const std::map<std::string, HostPair> &hpl, const std::string &colId) {
-    std::vector<std::pair<std::string, int >> vint{};
-    std::vector<std::pair<std::string, double >> vdouble{};
-    std::vector<std::pair<std::string, std::string >> vstring{};
+std::vector<const HostPairEntry *>
+HostPair::sortMap(const HostPairTable &hpl, const std::string &colId, size_t top) {
+    std::vector<std::pair<const HostPairEntry *, int >> vint{};
+    std::vector<std::pair<const HostPairEntry *, double >> vdouble{};
+    std::vector<std::pair<const HostPairEntry *, std::string >> vstring{};
 
     // process int variables
-    for (auto const &[key, value]: hpl) {
-        if (colId == "id" || colId.starts_with("hostp")) vstring.emplace_back(key, key);
-        if (colId == "pc" || colId.starts_with("packetc")) vint.emplace_back(key, value.packetCount);
-        if (colId == "ipc" || colId.starts_with("inpacketc")) vint.emplace_back(key, value.inputPacketCount);
-        if (colId == "opc" || colId.starts_with("outpacketc")) vint.emplace_back(key, value.outputPacketCount);
-        if (colId == "bc" || colId.starts_with("bytec")) vint.emplace_back(key, value.byteCount);
-        if (colId == "ibc" || colId.starts_with("inbytec")) vint.emplace_back(key, value.inputByteCount);
-        if (colId == "obc" || colId.starts_with("outbytec")) vint.emplace_back(key, value.outputByteCount);
-        if (colId == "pr" || colId.starts_with("packetr")) vdouble.emplace_back(key, value.packetRate);
-        if (colId == "pir" || colId.starts_with("inpacketr")) vdouble.emplace_back(key, value.inputPacketRate);
-        if (colId == "opr" || colId.starts_with("outpacketr")) vdouble.emplace_back(key, value.outputPacketRate);
-        if (colId == "dur" || colId.starts_with("dur")) vdouble.emplace_back(key, value.duration);
+    for (auto const &entry: hpl) {
+        auto const &[key, value] = entry;
+        if (colId == "id" || colId.starts_with("hostp")) vstring.emplace_back(&entry, value.label(key));
+        if (colId == "pc" || colId.starts_with("packetc")) vint.emplace_back(&entry, value.packetCount);
+        if (colId == "ipc" || colId.starts_with("inpacketc")) vint.emplace_back(&entry, value.inputPacketCount);
+        if (colId == "opc" || colId.starts_with("outpacketc")) vint.emplace_back(&entry, value.outputPacketCount);
+        if (colId == "bc" || colId.starts_with("bytec")) vint.emplace_back(&entry, value.byteCount);
+        if (colId == "ibc" || colId.starts_with("inbytec")) vint.emplace_back(&entry, value.inputByteCount);
+        if (colId == "obc" || colId.starts_with("outbytec")) vint.emplace_back(&entry, value.outputByteCount);
+        if (colId == "pr" || colId.starts_with("packetr")) vdouble.emplace_back(&entry, value.packetRate());
+        if (colId == "pir" || colId.starts_with("inpacketr")) vdouble.emplace_back(&entry, value.inputPacketRate());
+        if (colId == "opr" || colId.starts_with("outpacketr")) vdouble.emplace_back(&entry, value.outputPacketRate());
+        if (colId == "dur" || colId.starts_with("dur")) vdouble.emplace_back(&entry, value.duration());
     }
-    std::vector<std::string> r{};
-    if (!vint.empty()) return sortInt(vint);
-    if (!vdouble.empty()) return sortDbl(vdouble);
-    if (!vstring.empty()) return sortStr(vstring);
+    std::vector<const HostPairEntry *> r{};
+    if (!vint.empty()) return sortRows(std::move(vint), top);
+    if (!vdouble.empty()) return sortRows(std::move(vdouble), top);
+    if (!vstring.empty()) return sortRows(std::move(vstring), top);
     return r;
 }
 
 
-/**
- * \callgraph
- * @callergraph
- * \brief Get IP Pair Key
- * This routine will create a ip source and destination key used to index the hostPairList map
- * The key is a two element vector that contains the following
- *  - Source Ip + "<-->" + Destination ip
- *  - Destination IP + <--> Source Ip
- *
- * @param pkt       PcapPlusPlus parsed packet
- * @return          String vector with a Source and Destination IP pair address string
- */
-std::vector<std::string> HostPair::getIpPair(const pcpp::Packet &pkt, bool debug) {
-    std::vector<std::string> ipkey{"", ""};
-    if (pcpp::Layer *ipv4 = pkt.getLayerOfType(pcpp::IPv4); ipv4 != NULL) {
-        auto *ipv4hdr = dynamic_cast<pcpp::IPv4Layer *>(ipv4);
-        std::string src = ipv4hdr->getSrcIPAddress().toString();
-        std::string dst = ipv4hdr->getDstIPAddress().toString();
-        std::string s1 = src + "-" + dst;
-        std::string s2 = dst + "-" + src;
-        ipkey = {s1, s2};
-    }
-    if (debug) SPDLOG_INFO("key {} {}", ipkey[0], ipkey[1]);
-    return ipkey;
-}
-
 /**
  * \callgraph
  * @callergraph
  * @param el    - Ethernet Statistics List
  */
 void
-HostPair::writeCsvTable(std::map<std::string, HostPair> &hpl, const std::string &ss, bool debug) {
+HostPair::writeCsvTable(const HostPairTable &hpl, const std::string &ss, size_t top, bool debug) {
     /**
     * ##Processing Overview
     *
     * ### Sort map
     */
-    std::vector<std::string> sl{HostPair::sortMap(hpl, ss)};
-    if (sl.empty()) sl = HostPair::sortMap(hpl, "id");
+    std::vector<const HostPairEntry *> sl{HostPair::sortMap(hpl, ss, top)};
+    if (sl.empty()) sl = HostPair::sortMap(hpl, "id", top);
 
     try {
-        csvfile csv("HostPairTable.csv"); // throws exceptions!
+        csvfile csv("HostPairTable"); // throws exceptions!
         // Header
-        csv << "HostPair" <<
-            "PacketCount" <<
-            "InPacketCount" <<
-            "OutPacketCount" <<
-            "ByteCount" <<
-            "InByteCnt" <<
-            "OutByteCnt" <<
-            "PacketRate" <<
-            "InPacketRate" <<
-            "OutPacketRate" <<
-            "Duration(sec)" << endrow;
+        writeCsvHeader(csv);
         // Data
-        for (auto const &key: sl) {
-            HostPair value = hpl[key];
-            csv << key << std::to_string(value.packetCount) <<
-                std::to_string(value.inputPacketCount) <<
-                std::to_string(value.outputPacketCount) <<
-                std::to_string(value.byteCount) <<
-                std::to_string(value.inputByteCount) <<
-                std::to_string(value.outputByteCount) <<
-                std::to_string(value.packetRate) <<
-                std::to_string(value.inputPacketRate) <<
-                std::to_string(value.outputPacketRate) <<
-                std::to_string(value.duration) << endrow;
+        for (auto const *entry: sl) {
+            entry->second.writeCsvRow(csv, entry->first);
         }
     }
     catch (const std::exception &e) {
@@ -303,3 +230,41 @@ HostPair::writeCsvTable(std::map<std::string, HostPair> &hpl, const std::string
     }
 
 }
+
+/**
+ * \callgraph
+ * @callergraph
+ * @brief Write the column names of the host pair CSV table
+ */
+void HostPair::writeCsvHeader(csvfile &csv) {
+    csv << "HostPair" <<
+        "PacketCount" <<
+        "InPacketCount" <<
+        "OutPacketCount" <<
+        "ByteCount" <<
+        "InByteCnt" <<
+        "OutByteCnt" <<
+        "PacketRate" <<
+        "InPacketRate" <<
+        "OutPacketRate" <<
+        "Duration(sec)" << endrow;
+}
+
+/**
+ * \callgraph
+ * @callergraph
+ * @brief Write this host pair as a row of the host pair CSV table
+ * @param key       Key of this instance in the host pair table
+ */
+void HostPair::writeCsvRow(csvfile &csv, const FlowKey &key) const {
+    csv << label(key) << packetCount <<
+        inputPacketCount <<
+        outputPacketCount <<
+        byteCount <<
+        inputByteCount <<
+        outputByteCount <<
+        packetRate() <<
+        inputPacketRate() <<
+        outputPacketRate() <<
+        duration() << endrow;
+}
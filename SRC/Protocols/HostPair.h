@@ -25,58 +25,63 @@
 #include <spdlog/spdlog.h>
 #include "../include/tabulate.hpp"
 #include "../include/csvfile.h"
+#include "FlowKey.h"
+#include "PacketView.h"
+#include "SortRows.h"
+#include <unordered_map>
+#include <list>
 
+class HostPair;
+
+/**
+ * Host pair table. Key is the normalized IP pair of the conversation.
+ */
+using HostPairTable = std::unordered_map<FlowKey, HostPair, FlowKeyHash>;
+using HostPairEntry = HostPairTable::value_type;
 
 class HostPair {
 public:
     bool debug{false};
+    std::list<FlowKey>::iterator lru{};     ///< Position in the LRU list when flow eviction is on
 
-    void setFirstSpeaker(std::string);
+    void setFirstSpeaker(bool aFirst);
 
-    std::string getFirstSpeaker();
+    bool getFirstSpeaker() const;
 
-    void
-    updateCounters(const pcpp::Packet &pkt, pcpp::Layer &ipHd, std::string &currentIpAddress);
+    void updateCounters(const PacketView &view, bool fromA);
 
-    static void printTable(std::map<std::string, HostPair> &hpl, const std::string &ss, bool debug);
+    static void printTable(const HostPairTable &hpl, const std::string &ss, size_t top, bool debug);
 
-    static std::vector<std::string> sortMap(const std::map<std::string, HostPair> &hpl, const std::string &colId);
+    static std::vector<const HostPairEntry *> sortMap(const HostPairTable &hpl, const std::string &colId, size_t top);
 
-    static std::vector<std::string> sortInt(std::vector<std::pair<std::string, int >> vint);
+    /**
+     * @return  Timestamp of the last packet
+     */
+    [[nodiscard]] TimestampNs lastSeen() const {
+        return lastNs;
+    }
 
-    static std::vector<std::string> sortDbl(std::vector<std::pair<std::string, double >> v);
+    static void writeCsvTable(const HostPairTable &hpl, const std::string &ss, size_t top, bool debug);
 
-    static std::vector<std::string> sortStr(std::vector<std::pair<std::string, std::string >> v);
+    static void writeCsvHeader(csvfile &csv);
 
-    static std::vector<std::string> getIpPair(const pcpp::Packet &pkt, bool debug);
+    void writeCsvRow(csvfile &csv, const FlowKey &key) const;
 
-    static long double tsConSec(timespec ts) {
-        return ((ts.tv_sec) * 1e9 + (ts.tv_nsec)) / 1e9L;
-    }
-
-    static void writeCsvTable(std::map<std::string, HostPair> &hpl, const std::string &ss, bool debug);
+    void merge(const HostPair &other);
 
     /**
- * @callergraph
- * @callgraph
- * @param pkt
- * @return
- */
-    static std::string getIpAddress(pcpp::Packet pkt, bool debug) {
-        std::string s1{};
-        if (pcpp::Layer *ipv4 = pkt.getLayerOfType(pcpp::IPv4); ipv4 != nullptr) {
-            auto *ipv4hdr = dynamic_cast<pcpp::IPv4Layer *>(ipv4);
-            std::string src = ipv4hdr->getSrcIPAddress().toString();
-            std::string dst = ipv4hdr->getDstIPAddress().toString();
-            s1 = src + "<-->" + dst;
-        }
-        if (debug) SPDLOG_INFO("s1 {}", s1);
-        return s1;
+     * @brief Host pair label used in the reports
+     * @param key   Key of this instance in the host pair table
+     * @return      String in the format sip-dip with the first speaker first
+     */
+    [[nodiscard]] std::string label(const FlowKey &key) const {
+        return key.ipPairString(firstSpeaker);
     }
 
 private:
-    std::string firstSpeaker{};
-    timespec firstTimeStamp{0, 0};
+    bool firstSpeaker{true};
+    TimestampNs firstNs{0};
+    TimestampNs lastNs{0};
     bool firstTS{false};
     int packetCount{0};
     int inputPacketCount{0};
@@ -84,11 +89,14 @@ private:
     int byteCount{0};
     int inputByteCount{0};
     int outputByteCount{0};
-    double packetRate{0.0};
-    double inputPacketRate{0.0};
-    double outputPacketRate{0.0};
-    long double duration{0.0};
 
+    [[nodiscard]] double duration() const { return nsToSeconds(lastNs - firstNs); }
+
+    [[nodiscard]] double packetRate() const { return perSecond(packetCount, lastNs - firstNs); }
+
+    [[nodiscard]] double inputPacketRate() const { return perSecond(inputPacketCount, lastNs - firstNs); }
+
+    [[nodiscard]] double outputPacketRate() const { return perSecond(outputPacketCount, lastNs - firstNs); }
 };
 
 
@@ -0,0 +1,62 @@
+/**
+ * @file
+ * @brief Decoded Packet View
+ */
+
+#include "PacketView.h"
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Decode the headers of a parsed packet in one pass over its layers
+ * @param pkt       Parsed packet. Must outlive the view.
+ * @param pc        Packet number
+ */
+PacketView::PacketView(const pcpp::Packet &pkt, int pc) : pkt(pkt), pc(pc) {
+    ts = pkt.getRawPacketReadOnly()->getPacketTimeStamp();
+    tsNs = toNs(ts);
+
+    for (pcpp::Layer *layer = pkt.getFirstLayer(); layer != nullptr; layer = layer->getNextLayer()) {
+        switch (layer->getProtocol()) {
+            case pcpp::Ethernet:
+                if (ethLayer != nullptr) break;
+                ethLayer = static_cast<pcpp::EthLayer *>(layer);
+                eth = ethLayer->getEthHeader();
+                etherType = pcpp::netToHost16(eth->etherType);
+                ethPayloadLength = static_cast<uint32_t>(ethLayer->getLayerPayloadSize());
+                break;
+
+            case pcpp::IPv4:
+                if (ipLayer != nullptr) break;
+                ipLayer = static_cast<pcpp::IPv4Layer *>(layer);
+                ip = ipLayer->getIPv4Header();
+                ipId = pcpp::netToHost16(ip->ipId);
+                ipLength = static_cast<uint32_t>(ipLayer->getDataLen());
+                ipPayloadLength = static_cast<uint32_t>(ipLayer->getLayerPayloadSize());
+                ipPair = FlowKey::makeIpPair(ip->ipSrc, ip->ipDst, ipFromA);
+                break;
+
+            case pcpp::TCP:
+                if (tcpLayer != nullptr) break;
+                tcpLayer = static_cast<pcpp::TcpLayer *>(layer);
+                tcp = tcpLayer->getTcpHeader();
+                seq = pcpp::netToHost32(tcp->sequenceNumber);
+                ackNumber = pcpp::netToHost32(tcp->ackNumber);
+                window = pcpp::netToHost16(tcp->windowSize);
+                syn = tcp->synFlag != 0;
+                ack = tcp->ackFlag != 0;
+                fin = tcp->finFlag != 0;
+                rst = tcp->rstFlag != 0;
+                payloadLength = static_cast<uint32_t>(tcpLayer->getLayerPayloadSize());
+                if (ip != nullptr) {
+                    tcpKey = FlowKey::make(ip->ipSrc, pcpp::netToHost16(tcp->portSrc),
+                                           ip->ipDst, pcpp::netToHost16(tcp->portDst),
+                                           pcpp::PACKETPP_IPPROTO_TCP, tcpFromA);
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+}
@@ -0,0 +1,62 @@
+/**
+ * @file
+ * @brief Decoded Packet View
+ *
+ * The parser and the statistics classes all need the same few header fields of a packet. A PacketView walks the
+ * layers of the parsed packet once and keeps pointers to the Ethernet, IPv4 and TCP headers, the fields converted to
+ * host byte order, the payload lengths, the timestamp and the host pair and TCP conversation keys. It is built once
+ * in parser() and passed by reference, so no stage looks up a layer or converts a field a second time.
+ */
+
+#ifndef MACPCAP_PACKETVIEW_H
+#define MACPCAP_PACKETVIEW_H
+
+#include <cstdint>
+#include <ctime>
+#include <Packet.h>
+#include <EthLayer.h>
+#include <IPv4Layer.h>
+#include <TcpLayer.h>
+#include <SystemUtils.h>
+#include "FlowKey.h"
+#include "Timestamp.h"
+
+struct PacketView {
+    explicit PacketView(const pcpp::Packet &pkt, int pc = 0);
+
+    const pcpp::Packet &pkt;                ///< The parsed packet, for anything not decoded here
+    int pc{0};                              ///< Packet number in the capture
+    timespec ts{};                          ///< Packet timestamp
+    TimestampNs tsNs{0};                    ///< Packet timestamp in nanoseconds since the epoch
+
+    // Ethernet. Null when the first layer is not Ethernet.
+    pcpp::EthLayer *ethLayer{nullptr};
+    const pcpp::ether_header *eth{nullptr};
+    uint16_t etherType{0};                  ///< Host byte order
+    uint32_t ethPayloadLength{0};
+
+    // First IPv4 layer. Null when the packet has none.
+    pcpp::IPv4Layer *ipLayer{nullptr};
+    const pcpp::iphdr *ip{nullptr};
+    uint16_t ipId{0};                       ///< Host byte order
+    uint32_t ipLength{0};                   ///< IPv4 header and payload
+    uint32_t ipPayloadLength{0};
+    FlowKey ipPair{};                       ///< Host pair key
+    bool ipFromA{true};                     ///< Packet was sent from side A of ipPair
+
+    // First TCP layer. Null when the packet has none.
+    pcpp::TcpLayer *tcpLayer{nullptr};
+    const pcpp::tcphdr *tcp{nullptr};
+    uint32_t seq{0};                        ///< Host byte order
+    uint32_t ackNumber{0};                  ///< Host byte order
+    uint16_t window{0};                     ///< Host byte order
+    bool syn{false};
+    bool ack{false};
+    bool fin{false};
+    bool rst{false};
+    uint32_t payloadLength{0};              ///< TCP payload
+    FlowKey tcpKey{};                       ///< TCP conversation key
+    bool tcpFromA{true};                    ///< Packet was sent from side A of tcpKey
+};
+
+#endif //MACPCAP_PACKETVIEW_H
@@ -14,20 +14,22 @@
 /**
  * \callgraph
  * @callergraph
- * @param el    - Ethernet Statistics List
+ * @param pt    - Protocol Statistics Table
+ * @param top   - Number of rows to write. 0 writes all rows.
  */
 void
-ProtocolStats::writeCsvTable(std::map<std::string, ProtocolStats> &pl, const std::string &ss, bool debug) {
+ProtocolStats::writeCsvTable(const ProtocolStatsTable &pt, const std::string &ss, size_t top, bool debug) {
     /**
     * ##Processing Overview
     *
-    * ### Sort map
+    * ### Label and sort map
     */
-    std::vector<std::string> sl{ProtocolStats::sortMap(pl, ss)};
-    if (sl.empty()) sl = ProtocolStats::sortMap(pl, "id");
+    std::map<std::string, ProtocolStats> pl{pt.labelled()};
+    std::vector<const ProtocolStatsEntry *> sl{ProtocolStats::sortMap(pl, ss, top)};
+    if (sl.empty()) sl = ProtocolStats::sortMap(pl, "id", top);
 
     try {
-        csvfile csv("ProtocolStatsTable.csv"); // throws exceptions!
+        csvfile csv("ProtocolStatsTable"); // throws exceptions!
         // Header
         csv << "Protocol" <<
             "PacketCount" <<
@@ -35,12 +37,12 @@ ProtocolStats::writeCsvTable(std::map<std::string, ProtocolStats> &pl, const std
             "PacketRate" <<
             "Duration(sec)" << endrow;
         // Data
-        for (auto const &key: sl) {
-            ProtocolStats value = pl[key];
-            csv << key << std::to_string(value.packets) <<
-                std::to_string(value.byteCount) <<
-                std::to_string(value.packetRate) <<
-                std::to_string(value.duration) << endrow;
+        for (auto const *entry: sl) {
+            auto const &[key, value] = *entry;
+            csv << key << value.packets <<
+                value.byteCount <<
+                value.packetRate() <<
+                value.duration() << endrow;
         }
     }
     catch (const std::exception &e) {
@@ -54,19 +56,21 @@ ProtocolStats::writeCsvTable(std::map<std::string, ProtocolStats> &pl, const std
  * \callgraph
  * @callergraph
  * @brief Routine to print out the protocol statistics table
- * @param pl    Map of protocol class objects for collecting statistics
+ * @param pt    Table of protocol class objects for collecting statistics
+ * @param top   Number of rows to print. 0 prints all rows.
  */
 void
-ProtocolStats::printTable(std::map<std::string, ProtocolStats> &pl, const std::string &ss, bool debug) {
+ProtocolStats::printTable(const ProtocolStatsTable &pt, const std::string &ss, size_t top, bool debug) {
     if (debug) SPDLOG_INFO("Printing Protocol Stats  Table. ss={}", ss);
     /**
      * ##Processing Overview
      *
-     * ### Sort map
+     * ### Label and sort map
      */
     fmt::print("\n\nProtocol Stats Table\n\n");
-    std::vector<std::string> sl{ProtocolStats::sortMap(pl, ss)};
-    if (sl.empty() == 0) sl = ProtocolStats::sortMap(pl, "id");
+    std::map<std::string, ProtocolStats> pl{pt.labelled()};
+    std::vector<const ProtocolStatsEntry *> sl{ProtocolStats::sortMap(pl, ss, top)};
+    if (sl.empty()) sl = ProtocolStats::sortMap(pl, "id", top);
     /**
      *
      * ### Print report header
@@ -84,13 +88,13 @@ ProtocolStats::printTable(std::map<std::string, ProtocolStats> &pl, const std::s
     /**
      * ### Loop through ProtocolStats map and print each record
      */
-    for (auto const &key: sl) {
-        ProtocolStats value = pl[key];
+    for (auto const *entry: sl) {
+        auto const &[key, value] = *entry;
         t.add_row({key,
                    std::to_string(value.packets),
                    std::to_string(value.byteCount),
-                   std::to_string(value.packetRate),
-                   std::to_string(value.duration)
+                   std::to_string(value.packetRate()),
+                   std::to_string(value.duration())
                   });
     }
     t.format()
@@ -113,121 +117,197 @@ ProtocolStats::printTable(std::map<std::string, ProtocolStats> &pl, const std::s
 }
 
 /**
- * @callgraph
  * @callergraph
- * @brief  sort a list of pairs by second element, in this case int
- * @param vint      - Vector of pairs in the format <string,int>
- * @return          - string of HostPair keys in sorted order
+ * @callgraph
+ * @param hpl       Labelled protocol map
+ * @param colId     Column to sort
+ * @param top       Number of rows to return. 0 returns all rows.
+ * @return          Vector of protocol map entries in sorted order
  *
- * sort a list of pairs by second element, in this case int
+ * Routine will take a map of ProtocolStats instances and sort it in descending order based on the column ID. The
+ * returned entries point into the map and are used to print the list in sorted order.
  */
-std::vector<std::string> ProtocolStats::sortInt(std::vector<std::pair<std::string, int >> vint) {
-    std::vector<std::string> results{};
-    std::sort(vint.begin(), vint.end(), [](auto &left, auto &right) {
-        return left.second > right.second;
-    });
-    for (auto const &p: vint) {
-        results.emplace_back(p.first);
+std::vector<const ProtocolStatsEntry *>
+ProtocolStats::sortMap(const std::map<std::string, ProtocolStats> &hpl, const std::string &colId, size_t top) {
+    std::vector<std::pair<const ProtocolStatsEntry *, int >> vint{};
+    std::vector<std::pair<const ProtocolStatsEntry *, double >> vdouble{};
+    std::vector<std::pair<const ProtocolStatsEntry *, std::string >> vstring{};
+
+    // process int variables
+    for (auto const &entry: hpl) {
+        auto const &[key, value] = entry;
+        if (colId == "id" || colId.starts_with("prot")) vstring.emplace_back(&entry, key);
+        if (colId == "pc" || colId.starts_with("packetc")) vint.emplace_back(&entry, value.packets);
+        if (colId == "bc" || colId.starts_with("byte")) vint.emplace_back(&entry, value.byteCount);
+        if (colId == "pr" || colId.starts_with("packetr")) vdouble.emplace_back(&entry, value.packetRate());
+        if (colId == "dur" || colId.starts_with("du")) vdouble.emplace_back(&entry, value.duration());
     }
-    return results;
+    std::vector<const ProtocolStatsEntry *> r{};
+    if (!vint.empty()) return sortRows(std::move(vint), top);
+    if (!vdouble.empty()) return sortRows(std::move(vdouble), top);
+    if (!vstring.empty()) return sortRows(std::move(vstring), top);
+    return r;
+}
+
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Update Statistics Counters
+ * Routine will update the protocol statistics for an instance if the protocol class
+ * @param ts        Packet timestamp
+ * @param bytes     Bytes to add to the byte count
+ */
+void ProtocolStats::updateCounters(TimestampNs ts, uint32_t bytes) {
+    if (packets == 0) firstNs = ts;
+    lastNs = ts;
+
+    packets++;
+    byteCount += bytes;
 }
 
 /**
  * @callgraph
  * @callergraph
- * @brief  Sort a list of pairs by the second element, in this case doubles.
- * @param v     Vector of pairs. Each pair is of string,double
- * @return      string of HostPair keys in sort order
+ * @brief Merge the counters of another instance for the same protocol into this one
  *
- * Sort a list of pairs by the second element, in this case doubles.
+ * Used to combine the tables of the worker threads.
+ * @param other     ProtocolStats instance with the same key
  */
-std::vector<std::string> ProtocolStats::sortDbl(std::vector<std::pair<std::string, double >> v) {
-    std::vector<std::string> results{};
-    std::sort(v.begin(), v.end(), [](auto &left, auto &right) {
-        return left.second > right.second;
-    });
-    for (auto const &p: v) {
-        results.emplace_back(p.first);
+void ProtocolStats::merge(const ProtocolStats &other) {
+    if (other.packets == 0) return;
+    if (packets == 0) {
+        *this = other;
+        return;
     }
-    return results;
+    firstNs = std::min(firstNs, other.firstNs);
+    lastNs = std::max(lastNs, other.lastNs);
+    packets += other.packets;
+    byteCount += other.byteCount;
+}
+
+namespace {
+    constexpr std::array<std::pair<uint16_t, const char *>, 5> etherTypeNames{{
+            {0x0806, "ARP"},
+            {0x0800, "IpV4"},
+            {0x8100, "Vlan"},
+            {0x86dd, "IpV6"},
+            {0x8035, "RevArp"},
+    }};
+
+    constexpr std::array<const char *, 256> ipProtocolNames = [] {
+        std::array<const char *, 256> names{};
+        names[pcpp::PACKETPP_IPPROTO_TCP] = "TCP";
+        names[pcpp::PACKETPP_IPPROTO_EGP] = "EGP";
+        names[pcpp::PACKETPP_IPPROTO_ICMP] = "ICMP";
+        names[pcpp::PACKETPP_IPPROTO_ICMPV6] = "ICMPV6";
+        names[pcpp::PACKETPP_IPPROTO_FRAGMENT] = "FRAGMENT";
+        names[pcpp::PACKETPP_IPPROTO_UDP] = "UDP";
+        names[pcpp::PACKETPP_IPPROTO_GRE] = "GRE";
+        return names;
+    }();
 }
 
 /**
  * @callgraph
  * @callergraph
- * @brief  Sort a list of pairs by the second element, in this case strings.
- * @param v     Vector of pairs. Each pair is of string,double
- * @return      string of HostPair keys in sort order
+ * @brief Count a packet against its EtherType and, for IPv4, its IP protocol
  *
- * Sort a list of pairs by the second element, in this case strings.
+ * The EtherType entry counts every Ethernet frame. Its bytes are the IP payload for IPv4 and the Ethernet payload
+ * otherwise. The IP protocol entry counts the IP payload.
+ * @param view      Decoded packet
  */
-std::vector<std::string> ProtocolStats::sortStr(std::vector<std::pair<std::string, std::string >> v) {
-    std::vector<std::string> results{};
-    std::sort(v.begin(), v.end(), [](auto &left, auto &right) {
-        return left.second > right.second;
-    });
-    for (auto const &p: v) {
-        results.emplace_back(p.first);
+void ProtocolStatsTable::add(const PacketView &view, bool debug) {
+    if (view.eth == nullptr) return;
+    uint32_t bytes = view.ip != nullptr ? view.ipPayloadLength : view.ethPayloadLength;
+    if (debug) SPDLOG_INFO("ethType {:#06x}   PL {}", view.etherType, bytes);
+    etherTypeSlot(view.etherType).updateCounters(view.tsNs, bytes);
+
+    if (view.ip != nullptr) {
+        if (debug) SPDLOG_INFO("pt {}   PL {}", view.ip->protocol, view.ipPayloadLength);
+        ipProtocols[view.ip->protocol].updateCounters(view.tsNs, view.ipPayloadLength);
+        ipSeen = true;
     }
-    return results;
 }
 
 /**
- * @callergraph
  * @callgraph
- * @param hpl       HostPair map
- * @param colId     Column to sort
- * @return          Vector of HostPair keys in sorted order
+ * @callergraph
+ * @brief Find the slot of an EtherType, claiming an empty slot for a new one
  *
- * Routine will take a map of HostPair instances and sort it in descending order based on the column ID. The returned
- * string will be used index the HostPair list to print the list in sorted order.
+ * Linear probing on a power of two table. The table doubles when it becomes half full.
  */
-std::vector<std::string>
-ProtocolStats::sortMap(const std::map<std::string, ProtocolStats> &hpl, const std::string &colId) {
-    std::vector<std::pair<std::string, int >> vint{};
-    std::vector<std::pair<std::string, double >> vdouble{};
-    std::vector<std::pair<std::string, std::string >> vstring{};
+ProtocolStats &ProtocolStatsTable::etherTypeSlot(uint16_t etherType) {
+    if ((etherUsed + 1) * 2 > etherKeys.size()) {
+        std::vector<int32_t> oldKeys(std::max<size_t>(etherKeys.size() * 2, 16), emptySlot);
+        std::vector<ProtocolStats> oldStats(oldKeys.size());
+        oldKeys.swap(etherKeys);
+        oldStats.swap(etherStats);
+        etherUsed = 0;
+        for (size_t i = 0; i < oldKeys.size(); i++) {
+            if (oldKeys[i] != emptySlot) etherTypeSlot(static_cast<uint16_t>(oldKeys[i])) = oldStats[i];
+        }
+    }
+    size_t mask = etherKeys.size() - 1;
+    size_t i = (etherType * 0x9E37u) >> 4 & mask;
+    while (etherKeys[i] != emptySlot && etherKeys[i] != etherType) i = (i + 1) & mask;
+    if (etherKeys[i] == emptySlot) {
+        etherKeys[i] = etherType;
+        etherUsed++;
+    }
+    return etherStats[i];
+}
 
-    // process int variables
-    for (auto const &[key, value]: hpl) {
-        if (colId == "id" || colId.starts_with("prot")) vstring.emplace_back(key, key);
-        if (colId == "pc" || colId.starts_with("packetc")) vint.emplace_back(key, value.packets);
-        if (colId == "bc" || colId.starts_with("byte")) vint.emplace_back(key, value.byteCount);
-        if (colId == "pr" || colId.starts_with("packetr")) vdouble.emplace_back(key, value.packetRate);
-        if (colId == "dur" || colId.starts_with("du")) vdouble.emplace_back(key, value.duration);
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Merge the counters of another table into this one
+ *
+ * Used to combine the tables of the worker threads.
+ */
+void ProtocolStatsTable::merge(const ProtocolStatsTable &other) {
+    for (size_t p = 0; p < ipProtocols.size(); p++) ipProtocols[p].merge(other.ipProtocols[p]);
+    ipSeen = ipSeen || other.ipSeen;
+    for (size_t i = 0; i < other.etherKeys.size(); i++) {
+        if (other.etherKeys[i] != emptySlot)
+            etherTypeSlot(static_cast<uint16_t>(other.etherKeys[i])).merge(other.etherStats[i]);
     }
-    std::vector<std::string> r{};
-    if (!vint.empty()) return sortInt(vint);
-    if (!vdouble.empty()) return sortDbl(vdouble);
-    if (!vstring.empty()) return sortStr(vstring);
-    return r;
 }
 
+void ProtocolStatsTable::clear() {
+    *this = ProtocolStatsTable{};
+}
 
 /**
  * @callgraph
  * @callergraph
- * @brief Update Statistics Counters
- * Routine will update the protocol statistics for an instance if the protocol class
- * @param pkt
- * @param debugOption
+ * @return      The EtherType and IP protocol counters that saw packets, keyed by their report label
  */
-void ProtocolStats::updateCounters(const pcpp::Packet &pkt) {
-    if (debug) SPDLOG_INFO("Starting");
-    auto *ipLayer = dynamic_cast<pcpp::IPv4Layer *>(pkt.getLayerOfType(pcpp::IPv4));
-    if (ipLayer != nullptr) {
-        pcpp::ProtocolType pt = ipLayer->getProtocol();
-        uint32_t payLoad = ipLayer->getLayerPayloadSize();
-        if (debug) SPDLOG_INFO("pt {}   PL {}", pt, payLoad);
-
-        // get raw packet so we can get timestamp
-        pcpp::RawPacket *rawPkt = pkt.getRawPacketReadOnly();
-        timespec ts = rawPkt->getPacketTimeStamp();
-        if (firstTimeStamp.tv_sec == 0) firstTimeStamp = ts;
-        duration = tsConSec(ts) - tsConSec(firstTimeStamp);
-        packetRate = (duration == 0.0L) ? 0.0 : packets / duration;
-
-        packets++;
-        byteCount += payLoad;
+std::map<std::string, ProtocolStats> ProtocolStatsTable::labelled() const {
+    std::map<std::string, ProtocolStats> pl{};
+    for (size_t i = 0; i < etherKeys.size(); i++) {
+        if (etherKeys[i] != emptySlot) pl.emplace(etherTypeLabel(static_cast<uint16_t>(etherKeys[i])), etherStats[i]);
+    }
+    for (size_t p = 0; p < ipProtocols.size(); p++) {
+        if (ipProtocols[p].getPackets() > 0) pl.emplace(ipProtocolLabel(static_cast<uint8_t>(p)), ipProtocols[p]);
     }
+    return pl;
+}
+
+/**
+ * @return      Report label of an EtherType, e.g. "ethType:0X800(IpV4)"
+ */
+std::string ProtocolStatsTable::etherTypeLabel(uint16_t etherType) {
+    for (auto const &[value, name]: etherTypeNames) {
+        if (value == etherType) return fmt::format("ethType:{:#04X}({})", etherType, name);
+    }
+    return fmt::format("ethType:{:#04X}", etherType);
+}
+
+/**
+ * @return      Report label of an IP protocol, e.g. "IpProt:6(TCP)"
+ */
+std::string ProtocolStatsTable::ipProtocolLabel(uint8_t protocol) {
+    if (ipProtocolNames[protocol] == nullptr) return fmt::format("IpProt:{}", protocol);
+    return fmt::format("IpProt:{}({})", protocol, ipProtocolNames[protocol]);
 }
@@ -8,6 +8,7 @@
 #ifndef MACPCAP_PROTOCOLSTATS_H
 #define MACPCAP_PROTOCOLSTATS_H
 
+#include <array>
 #include <map>
 #include <IPv4Layer.h>
 #include <Packet.h>
@@ -26,38 +27,79 @@
 #include <typeinfo>
 #include <EthLayer.h>
 #include "../include/tabulate.hpp"
+#include "PacketView.h"
+#include "SortRows.h"
 
+class ProtocolStats;
+class ProtocolStatsTable;
+
+/**
+ * Row of a protocol report: the label and the counters of one EtherType or IP protocol
+ */
+using ProtocolStatsEntry = std::pair<const std::string, ProtocolStats>;
 
 class ProtocolStats {
 public:
     bool debug{false};
 
-    static void printTable(std::map<std::string, ProtocolStats> &pl, const std::string &ss, bool debug);
-
-    static void writeCsvTable(std::map<std::string, ProtocolStats> &pl, const std::string &ss, bool debug);
-
-    static std::vector<std::string> sortMap(const std::map<std::string, ProtocolStats> &pl, const std::string &colId);
-
-    static std::vector<std::string> sortInt(std::vector<std::pair<std::string, int >> vint);
+    static void printTable(const ProtocolStatsTable &pt, const std::string &ss, size_t top, bool debug);
 
-    static std::vector<std::string> sortDbl(std::vector<std::pair<std::string, double >> v);
+    static void writeCsvTable(const ProtocolStatsTable &pt, const std::string &ss, size_t top, bool debug);
 
-    static std::vector<std::string> sortStr(std::vector<std::pair<std::string, std::string >> v);
+    static std::vector<const ProtocolStatsEntry *>
+    sortMap(const std::map<std::string, ProtocolStats> &pl, const std::string &colId, size_t top);
 
-    void updateCounters(const pcpp::Packet &pkt);
+    void updateCounters(TimestampNs ts, uint32_t bytes);
 
-    static long double tsConSec(timespec ts) {
-        return ((ts.tv_sec) * 1e9 + (ts.tv_nsec)) / 1e9L;
-    }
+    void merge(const ProtocolStats &other);
 
+    [[nodiscard]] long getPackets() const { return packets; }
 
 private:
-    timespec firstTimeStamp{0, 0};
+    TimestampNs firstNs{0};
+    TimestampNs lastNs{0};
     long packets{0};
     uint32_t byteCount{0};
-    double packetRate{0.0};
-    long double duration{0.0L};
+
+    [[nodiscard]] double duration() const { return nsToSeconds(lastNs - firstNs); }
+
+    [[nodiscard]] double packetRate() const { return perSecond(packets, lastNs - firstNs); }
 };
 
 
+/**
+ * @brief Protocol counters indexed by the numeric EtherType and IP protocol
+ *
+ * The IP protocols have one slot each. The few EtherTypes seen in a capture are kept in a small open addressed
+ * table that grows when it is half full. Counting a packet is an array index and a short probe; the
+ * "ethType:0X800(IpV4)" style labels are only built by labelled() when a report is printed or written.
+ */
+class ProtocolStatsTable {
+public:
+    void add(const PacketView &view, bool debug);
+
+    void merge(const ProtocolStatsTable &other);
+
+    void clear();
+
+    [[nodiscard]] bool empty() const { return etherUsed == 0 && !ipSeen; }
+
+    [[nodiscard]] std::map<std::string, ProtocolStats> labelled() const;
+
+    static std::string etherTypeLabel(uint16_t etherType);
+
+    static std::string ipProtocolLabel(uint8_t protocol);
+
+private:
+    ProtocolStats &etherTypeSlot(uint16_t etherType);
+
+    std::array<ProtocolStats, 256> ipProtocols{};
+    bool ipSeen{false};
+
+    static constexpr int32_t emptySlot{-1};
+    std::vector<int32_t> etherKeys;             ///< EtherType of each slot, emptySlot when unused
+    std::vector<ProtocolStats> etherStats;
+    size_t etherUsed{0};
+};
+
 #endif //MACPCAP_PROTOCOLSTATS_H
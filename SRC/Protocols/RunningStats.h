@@ -0,0 +1,161 @@
+/**
+ * @file
+ * @brief Streaming Statistics
+ *
+ * Accumulators that summarize a stream of samples in constant memory. RunningStats keeps the count, mean, variance
+ * (Welford), minimum and maximum. QuantileSketch is a DDSketch: samples are counted in logarithmic buckets so any
+ * quantile is returned within a fixed relative error. Both can be merged, so per thread results can be combined.
+ */
+
+#ifndef MACPCAP_RUNNINGSTATS_H
+#define MACPCAP_RUNNINGSTATS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <map>
+
+/**
+ * @brief Running count, mean, variance, minimum and maximum
+ */
+class RunningStats {
+public:
+    /**
+     * @callgraph
+     * @callergraph
+     * @param x     Sample
+     */
+    void add(double x) {
+        n++;
+        double delta = x - m;
+        m += delta / static_cast<double>(n);
+        m2 += delta * (x - m);
+        lo = std::min(lo, x);
+        hi = std::max(hi, x);
+    }
+
+    /**
+     * @callgraph
+     * @callergraph
+     * @brief Combine the samples of another accumulator (Chan et al.)
+     */
+    void merge(const RunningStats &other) {
+        if (other.n == 0) return;
+        if (n == 0) {
+            *this = other;
+            return;
+        }
+        uint64_t total = n + other.n;
+        double delta = other.m - m;
+        m += delta * static_cast<double>(other.n) / static_cast<double>(total);
+        m2 += other.m2 + delta * delta * static_cast<double>(n) * static_cast<double>(other.n) /
+                         static_cast<double>(total);
+        n = total;
+        lo = std::min(lo, other.lo);
+        hi = std::max(hi, other.hi);
+    }
+
+    [[nodiscard]] uint64_t count() const { return n; }
+
+    [[nodiscard]] double mean() const { return m; }
+
+    [[nodiscard]] double sum() const { return m * static_cast<double>(n); }
+
+    /**
+     * @return  Sample variance. Zero with fewer than two samples.
+     */
+    [[nodiscard]] double variance() const { return n > 1 ? m2 / static_cast<double>(n - 1) : 0.0; }
+
+    [[nodiscard]] double stddev() const { return std::sqrt(variance()); }
+
+    [[nodiscard]] double min() const { return n > 0 ? lo : 0.0; }
+
+    [[nodiscard]] double max() const { return n > 0 ? hi : 0.0; }
+
+private:
+    uint64_t n{0};
+    double m{0.0};
+    double m2{0.0};
+    double lo{std::numeric_limits<double>::max()};
+    double hi{std::numeric_limits<double>::lowest()};
+};
+
+/**
+ * @brief DDSketch quantile estimator for non negative samples
+ *
+ * A sample x is counted in bucket ceil(log(x) / log(gamma)) with gamma = (1 + a) / (1 - a), which bounds the
+ * relative error of a returned quantile to a. When more than maxBuckets buckets are in use the lowest buckets are
+ * folded together, so only the low quantiles lose accuracy.
+ */
+class QuantileSketch {
+public:
+    explicit QuantileSketch(double accuracy = 0.01, size_t maxBuckets = 2048)
+            : gamma((1.0 + accuracy) / (1.0 - accuracy)), logGamma(std::log(gamma)), maxBuckets(maxBuckets) {}
+
+    /**
+     * @callgraph
+     * @callergraph
+     * @param x     Sample. Values below 1 ns are counted as zero.
+     */
+    void add(double x) {
+        n++;
+        if (x < minValue) {
+            zeroCount++;
+            return;
+        }
+        buckets[static_cast<int>(std::ceil(std::log(x) / logGamma))]++;
+        if (buckets.size() > maxBuckets) collapse();
+    }
+
+    /**
+     * @callgraph
+     * @callergraph
+     * @brief Add the buckets of another sketch. Both sketches must use the same accuracy.
+     */
+    void merge(const QuantileSketch &other) {
+        n += other.n;
+        zeroCount += other.zeroCount;
+        for (auto const &[index, c]: other.buckets) buckets[index] += c;
+        while (buckets.size() > maxBuckets) collapse();
+    }
+
+    /**
+     * @callgraph
+     * @callergraph
+     * @param q     Quantile between 0 and 1
+     * @return      Estimated value of the quantile. Zero if the sketch is empty.
+     */
+    [[nodiscard]] double quantile(double q) const {
+        if (n == 0) return 0.0;
+        auto rank = static_cast<uint64_t>(std::clamp(q, 0.0, 1.0) * static_cast<double>(n - 1));
+        uint64_t seen = zeroCount;
+        if (rank < seen) return 0.0;
+        for (auto const &[index, c]: buckets) {
+            seen += c;
+            if (rank < seen) return 2.0 * std::pow(gamma, index) / (gamma + 1.0);
+        }
+        return buckets.empty() ? 0.0 : 2.0 * std::pow(gamma, buckets.rbegin()->first) / (gamma + 1.0);
+    }
+
+    [[nodiscard]] uint64_t count() const { return n; }
+
+private:
+    void collapse() {
+        auto first = buckets.begin();
+        auto second = std::next(first);
+        second->second += first->second;
+        buckets.erase(first);
+    }
+
+    static constexpr double minValue{1e-9};
+
+    double gamma;
+    double logGamma;
+    size_t maxBuckets;
+    uint64_t n{0};
+    uint64_t zeroCount{0};
+    std::map<int, uint64_t> buckets;
+};
+
+#endif //MACPCAP_RUNNINGSTATS_H
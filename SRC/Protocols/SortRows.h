@@ -0,0 +1,40 @@
+/**
+ * @file
+ * @brief Report Row Sorting
+ *
+ * All the report tables are sorted the same way: on one column, in descending order. A row is a pointer to its
+ * entry in the statistics table, so sorting and printing a report never copies an entry or looks its key up again.
+ * When only the first top rows are printed a partial sort is used.
+ */
+
+#ifndef MACPCAP_SORTROWS_H
+#define MACPCAP_SORTROWS_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Sort table entries by a column value
+ * @param v         Pairs of table entry and the value of the sort column
+ * @param top       Number of rows to return. 0 returns all rows.
+ * @return          Table entries in descending order of the column value
+ */
+template<typename Entry, typename V>
+std::vector<const Entry *> sortRows(std::vector<std::pair<const Entry *, V>> v, size_t top) {
+    auto descending = [](const auto &left, const auto &right) {
+        return left.second > right.second;
+    };
+    size_t n = (top > 0 && top < v.size()) ? top : v.size();
+    if (n < v.size()) std::partial_sort(v.begin(), v.begin() + static_cast<long>(n), v.end(), descending);
+    else std::sort(v.begin(), v.end(), descending);
+
+    std::vector<const Entry *> results{};
+    results.reserve(n);
+    for (size_t i = 0; i < n; i++) results.push_back(v[i].first);
+    return results;
+}
+
+#endif //MACPCAP_SORTROWS_H
@@ -8,8 +8,15 @@
  * Routine to process the TCP header and collect statistics about the TCP conversation.
  */
 #include "TCPConversation.h"
+#include "../Profile/Profiler.h"
+#include <thread>
+#include <algorithm>
 
-std::vector<variant<std::string, const char *, std::string_view, tabulate::Table>> headers{
+namespace {
+    /**
+     * Columns of the TCP conversation tables, in the order of TCPConversation::row()
+     */
+    const std::vector<std::string> columns{
         "TCPConversation",
         "SrcMac",
         "DestMac",
@@ -44,112 +51,39 @@ std::vector<variant<std::string, const char *, std::string_view, tabulate::Table
         "sendWindowUpdate",
         "Duration(sec)"};
 
-/**
- * @callergraph
- * @callgraph
- * @brief Format the headers of a packet
- * @param p     Parsed PcapPlusPLus packet
- * @return      Return a vector of formatted strings of the packet headers ready for logging
- */
-std::vector<std::string> packetFormat(const pcpp::Packet &p) {
-    std::vector<std::string> v{};
-    std::string s{};
-    for (pcpp::Layer *curLayer = p.getFirstLayer(); curLayer != nullptr; curLayer = curLayer->getNextLayer()) {
-        switch (curLayer->getProtocol()) {
-            case pcpp::Ethernet: {
-                auto *ethLayer = dynamic_cast<pcpp::EthLayer *>(p.getLayerOfType(pcpp::Ethernet));
-                s = fmt::format("{}     Protocol {}  Payload Length {}",
-                                curLayer->toString(),
-                                std::to_string(ethLayer->getProtocol()),
-                                std::to_string(ethLayer->getLayerPayloadSize())
-                );
-                v.push_back(s);
-            }
-                break;
-            case pcpp::IPv4: {
-                auto *ipLayer = dynamic_cast<pcpp::IPv4Layer *>(p.getLayerOfType(pcpp::IPv4));
-                auto *ipHdr = ipLayer->getIPv4Header();
-                s = curLayer->toString() + fmt::format("     Protocol {}   PL {}   IPID {}   TTL {}",
-                                                       std::to_string(ipLayer->getProtocol()),
-                                                       std::to_string(ipLayer->getLayerPayloadSize()),
-                                                       std::to_string(pcpp::hostToNet16(ipHdr->ipId)),
-                                                       std::to_string(ipHdr->timeToLive)
-                );
-                v.push_back(s);
-            }
-                break;
-
-            case pcpp::TCP: {
-                auto *tcpL = dynamic_cast<pcpp::TcpLayer *>(p.getLayerOfType(pcpp::TCP));
-                auto *tcpHdr = tcpL->getTcpHeader();
-                s = curLayer->toString() + fmt::format("     Protocol {}   PL {}  seq {}   Ack {}    ws {}",
-                                                       std::to_string(tcpL->getProtocol()),
-                                                       std::to_string(tcpL->getLayerPayloadSize()),
-                                                       std::to_string(pcpp::netToHost32(tcpHdr->sequenceNumber)),
-                                                       std::to_string(pcpp::netToHost32(tcpHdr->ackNumber)),
-                                                       std::to_string(pcpp::netToHost16(tcpHdr->windowSize))
-                );
-                v.push_back(s);
-            }
-                break;
-
-            default:
-                v.push_back(curLayer->toString());
-        }
-    }
-    return v;
-}
-
-//Function for variance
-/**
- * @callergraph
- * @callgraph
- * @brief Calculate Variance
- *
- * Routine to calculate the variance of doubles in a vector.
- * @param v
- * @param mean
- * @return
- */
-double variance(std::vector<double> &v, double mean) {
-    double sum = 0.0;
-    double temp = 0.0;
-    double var = 0.0;
-
-    for (auto j: v) {
-        temp = pow((j - mean), 2);
-        sum += temp;
-    }
+    const std::vector<std::string> quantileColumns{"RspP50", "RspP95", "RspP99"};
 
-    return var = sum / (v.size() - 2);
-}
+    /**
+     * Smallest number of conversations worth a finalize thread
+     */
+    constexpr size_t finalizeChunk{4096};
 
+    /**
+     * Collects the fields of a row as the strings of a text table, formatted the same way as csvfile
+     */
+    struct RowStrings {
+        std::vector<std::string> cells;
 
-/**
- * @callgraph
- * @callergraph
- * @brief Calculate Statistics values for a vector of doubles
- * @param v         Vector of doubles
- * @return          results vector:
- *                      mean
- *                      Square Sum
- *                      Standard Deviation
- *                      Variance
- */
-std::vector<double> calcStats(std::vector<double> &v) {
+        RowStrings &operator<<(const std::string &val) {
+            cells.push_back(val);
+            return *this;
+        }
 
-    if (v.empty()) return {0.0, 0.0, 0.0, 0.0};
+        template<std::integral T>
+        RowStrings &operator<<(T val) {
+            cells.push_back(fmt::format("{}", val));
+            return *this;
+        }
 
-    double sum = std::accumulate(v.begin(), v.end(), 0.0);
-    double mean = sum / v.size();
-    double var = variance(v, mean);
+        RowStrings &operator<<(double val) {
+            return *this << Decimal{val, 6};
+        }
 
-    std::vector<double> diff(v.size());
-    std::transform(v.begin(), v.end(), diff.begin(), [mean](double x) { return x - mean; });
-    double sq_sum = std::inner_product(diff.begin(), diff.end(), diff.begin(), 0.0);
-    double stdev = std::sqrt(sq_sum / v.size());
-    std::vector<double> results{mean, sq_sum, stdev, var};
-    return results;
+        RowStrings &operator<<(Decimal val) {
+            cells.push_back(fmt::format("{:.{}f}", val.value, val.places));
+            return *this;
+        }
+    };
 }
 
 /**
@@ -161,147 +95,24 @@ std::vector<double> calcStats(std::vector<double> &v) {
  * is used to create the tables.
  * @param tcl   Map of TCP Conversation instances
  * @param ss    Column ID for sorting.
+ * @param top   Number of rows to write. 0 writes all rows.
+ *
+ * finalizeTable() must have been called.
  */
-void TCPConversation::writeCsvTable(std::map<std::string, TCPConversation> &tcl, const std::string &ss,
+void TCPConversation::writeCsvTable(const TcpConversationTable &tcl, const std::string &ss, size_t top,
                                     bool debug
 ) {
     if (debug) SPDLOG_INFO("Printing TCP Conversation Table. ss={}", ss);
 
-    long double x(0.0L);
-    long index;
-
-    for (auto &[key, value]: tcl) {
-        if (debug) SPDLOG_INFO("Key {}", key);
-        index = 0;
-        x = 0.0L;
-        value.sendAckTimeAvg = 0.0;
-        value.recvAckTimeAvg = 0.0;
-        TCPConversation::seqRec seq;
-        for (std::pair<const unsigned int, seqRec> sr: value.sendSequenceNumbers) {
-            seq = sr.second;
-            if (seq.ack) {
-                x += (TCPConversation::tsConSec(seq.ackTime) - TCPConversation::tsConSec(seq.ts));
-                index++;
-            } else {
-                value.seqUnacknowledged++;
-            }
-        }
-        if (index > 0 && x > 0)
-            value.sendAckTimeAvg = (x / index);
-
-        index = 0;
-        x = 0.0L;
-        for (std::pair<const unsigned int, seqRec> sr: value.recvSequenceNumbers) {
-            seq = sr.second;
-            if (seq.ack) {
-                x += (TCPConversation::tsConSec(seq.ackTime) - TCPConversation::tsConSec(seq.ts));
-                index++;
-            } else {
-                value.seqUnacknowledged++;
-            }
-        }
-        if (index > 0 && x > 0) value.recvAckTimeAvg = (x / index);
-    }
-
-    std::vector<std::string> sl{TCPConversation::sortMap(tcl, ss)};
-    if (sl.empty()) sl = TCPConversation::sortMap(tcl, "id");
+    std::vector<const TcpConversationEntry *> sl{TCPConversation::sortMap(tcl, ss, top)};
+    if (sl.empty()) sl = TCPConversation::sortMap(tcl, "id", top);
 
-    csvfile csv("TcpConversationStatsTable.csv"); // throws exceptions!
+    csvfile csv("TcpConversationStatsTable"); // throws exceptions!
     // Header
-    csv << "TCPConversation" <<
-        "SrcMac" <<
-        "DestMac" <<
-        "HandShake" <<
-        "CTS->D(ms)" <<
-        "CTD-S(ms)" <<
-        "SendAckTime-RTT" <<
-        "recvAckTime-RTT" <<
-        "AvgRspTime" <<
-        "Unackseq#" <<
-        "SendDupAck" <<
-        "RecvDupAck" <<
-        "Resets" <<
-        "ZeroWindow" <<
-        "sendDataPkt" <<
-        "RecvDataPkt" <<
-        "Retrans" <<
-        "RetransRate" <<
-        "InRetrans" <<
-        "OutRetrans" <<
-        "InterGapTime" <<
-        "PacketCount" <<
-        "InPacketCount" <<
-        "OutPacketCount" <<
-        "ByteCount" <<
-        "InByteCnt" <<
-        "OutByteCnt" <<
-        "PacketRate" <<
-        "RecvPacketRate" <<
-        "SendPacketRate" <<
-        "recvWindowUpdate" <<
-        "sendWindowUpdate" <<
-        "Duration(sec)" << endrow;
-
-    for (auto const &key: sl) {
-
-        TCPConversation value = tcl[key];
-
-        std::string handShake{"......"};
-        if (value.syn) handShake[0] = 'S';
-        if (value.ack) handShake[5] = 'A';
-        if (value.synAck) {
-            handShake[2] = 'S';
-            handShake[3] = 'A';
-        }
-        if (value.syn && !value.synAck && value.RST) {
-            handShake[2] = 'R';
-            handShake[3] = '.';
-        }
+    writeCsvHeader(csv);
 
-        if (value.syn && value.synAck && value.RST) handShake[5] = 'R';
-        enum rindex {
-            mean = 0,
-            sum = 1,
-            std = 2,
-            var = 4
-        };
-
-        std::vector<double> r = calcStats(value.iglist);
-        value.igAverageTime = fmt::format("{:.5f}", r[mean]);
-
-        r = calcStats(value.rspTime);
-        value.avgResponseTime = fmt::format("{:.5f}", r[mean]);
-
-        csv << key << value.sourceMac << value.destMac << handShake <<
-            std::to_string(value.synSynAckTime) <<
-            std::to_string(value.synAckAckTime) <<
-            std::to_string(value.sendAckTimeAvg) <<
-            std::to_string(value.recvAckTimeAvg) <<
-            value.avgResponseTime <<
-            std::to_string(value.seqUnacknowledged) <<
-            std::to_string(value.sendDupAck) <<
-            std::to_string(value.recvDupAck) <<
-            std::to_string(value.resetCount) <<
-            std::to_string(value.zeroWindow) <<
-            std::to_string(value.sendDataPkt) <<
-            std::to_string(value.recvDataPkt) <<
-            std::to_string(value.totalRetrans) <<
-            std::to_string(value.totalRetransPercentage) <<
-            std::to_string(value.inRetranCount) <<
-            std::to_string(value.outRetransCount) <<
-            value.igAverageTime <<
-            std::to_string(value.packetCount) <<
-            std::to_string(value.inputPacketCount) <<
-            std::to_string(value.outputPacketCount) <<
-            std::to_string(value.byteCount) <<
-            std::to_string(value.inputByteCount) <<
-            std::to_string(value.outputByteCount) <<
-            std::to_string(value.packetRate) <<
-            std::to_string(value.inputPacketRate) <<
-            std::to_string(value.outputPacketRate) <<
-            std::to_string(value.recvWindowUpdates) <<
-            std::to_string(value.sendWindowUpdates) <<
-            std::to_string(value.duration) << endrow;
+    for (auto const *entry: sl) {
+        entry->second.writeCsvRow(csv, entry->first);
     }
 }
 
@@ -315,118 +126,28 @@ void TCPConversation::writeCsvTable(std::map<std::string, TCPConversation> &tcl,
  * is used to create the tables.
  * @param tcl   Map of TCP Conversation instances
  * @param ss    Column ID for sorting.
+ * @param top   Number of rows to print. 0 prints all rows.
+ *
+ * finalizeTable() must have been called.
  */
-void TCPConversation::printTable(std::map<std::string, TCPConversation> &tcl, const std::string &ss,
+void TCPConversation::printTable(const TcpConversationTable &tcl, const std::string &ss, size_t top,
                                  bool debug
 ) {
     if (debug) SPDLOG_INFO("Printing TCP Conversation Table. ss={}", ss);
     fmt::print("\n\nTCP Conversations\n");
-    
-    long double x(0.0L);
-    long index;
-
-    for (auto &[key, value]: tcl) {
-        if (debug) SPDLOG_INFO("Key {}", key);
-        index = 0;
-        x = 0.0L;
-        value.sendAckTimeAvg = 0.0;
-        value.recvAckTimeAvg = 0.0;
-        TCPConversation::seqRec seq;
-        for (std::pair<const unsigned int, seqRec> sr: value.sendSequenceNumbers) {
-            seq = sr.second;
-            if (seq.ack) {
-                x += (TCPConversation::tsConSec(seq.ackTime) - TCPConversation::tsConSec(seq.ts));
-                index++;
-            } else {
-                value.seqUnacknowledged++;
-            }
-        }
-        if (index > 0 && x > 0)
-            value.sendAckTimeAvg = (x / index);
-
-        index = 0;
-        x = 0.0L;
-        for (std::pair<const unsigned int, seqRec> sr: value.recvSequenceNumbers) {
-            seq = sr.second;
-            if (seq.ack) {
-                x += (TCPConversation::tsConSec(seq.ackTime) - TCPConversation::tsConSec(seq.ts));
-                index++;
-            } else {
-                value.seqUnacknowledged++;
-            }
-        }
-        if (index > 0 && x > 0) value.recvAckTimeAvg = (x / index);
-    }
 
-    std::vector<std::string> sl{TCPConversation::sortMap(tcl, ss)};
-    if (sl.empty()) sl = TCPConversation::sortMap(tcl, "id");
+    std::vector<const TcpConversationEntry *> sl{TCPConversation::sortMap(tcl, ss, top)};
+    if (sl.empty()) sl = TCPConversation::sortMap(tcl, "id", top);
 
     using namespace tabulate;
     Table t;
 
-    t.add_row(headers);
-
-    for (auto const &key: sl) {
-
-        TCPConversation value = tcl[key];
+    std::vector<std::string> names{columnNames()};
+    t.add_row(Table::Row_t(names.begin(), names.end()));
 
-        std::string handShake{"......"};
-        if (value.syn) handShake[0] = 'S';
-        if (value.ack) handShake[5] = 'A';
-        if (value.synAck) {
-            handShake[2] = 'S';
-            handShake[3] = 'A';
-        }
-        if (value.syn && !value.synAck && value.RST) {
-            handShake[2] = 'R';
-            handShake[3] = '.';
-        }
-
-        if (value.syn && value.synAck && value.RST) handShake[5] = 'R';
-        enum rindex {
-            mean = 0,
-            sum = 1,
-            std = 2,
-            var = 4
-        };
-
-        std::vector<double> r = calcStats(value.iglist);
-        value.igAverageTime = fmt::format("{:.5f}", r[mean]);
-
-        r = calcStats(value.rspTime);
-        value.avgResponseTime = fmt::format("{:.5f}", r[mean]);
-
-        t.add_row({
-                          key, value.sourceMac, value.destMac, handShake,
-                          std::to_string(value.synSynAckTime),
-                          std::to_string(value.synAckAckTime),
-                          std::to_string(value.sendAckTimeAvg),
-                          std::to_string(value.recvAckTimeAvg),
-                          value.avgResponseTime,
-                          std::to_string(value.seqUnacknowledged),
-                          std::to_string(value.sendDupAck),
-                          std::to_string(value.recvDupAck),
-                          std::to_string(value.resetCount),
-                          std::to_string(value.zeroWindow),
-                          std::to_string(value.sendDataPkt),
-                          std::to_string(value.recvDataPkt),
-                          std::to_string(value.totalRetrans),
-                          std::to_string(value.totalRetransPercentage),
-                          std::to_string(value.inRetranCount),
-                          std::to_string(value.outRetransCount),
-                          value.igAverageTime,
-                          std::to_string(value.packetCount),
-                          std::to_string(value.inputPacketCount),
-                          std::to_string(value.outputPacketCount),
-                          std::to_string(value.byteCount),
-                          std::to_string(value.inputByteCount),
-                          std::to_string(value.outputByteCount),
-                          std::to_string(value.packetRate),
-                          std::to_string(value.inputPacketRate),
-                          std::to_string(value.outputPacketRate),
-                          std::to_string(value.recvWindowUpdates),
-                          std::to_string(value.sendWindowUpdates),
-                          std::to_string(value.duration)});
+    for (auto const *entry: sl) {
+        std::vector<std::string> fields{entry->second.row(entry->first)};
+        t.add_row(Table::Row_t(fields.begin(), fields.end()));
     }
     t.format()
             .font_style({FontStyle::bold})
@@ -453,108 +174,109 @@ void TCPConversation::printTable(std::map<std::string, TCPConversation> &tcl, co
  * @brief Update statistics counters
  *
  * Routine to update the statistic counters for a given TCP conversation (socket).
- * @param pkt                   Parsed packet
- * @param key                   TCP Conversation Key
- * @param ipHdr                 IP Header Layer
- * @param tcpHdr                TCP Header Layer
- * @param tcpCurrentAddress     TCP Socket address from packet
+ * @param view                  Decoded packet
+ * @param fromA                 True if the packet was sent from side A of the conversation key
  */
-void TCPConversation::updateCounters(const pcpp::Packet &pkt, pcpp::Layer &ipHdr, pcpp::Layer &tcpLayer,
-                                     const std::string &tcpCurrentAddress, int pc) {
-    std::vector<std::string> v{packetFormat(pkt)};
+void TCPConversation::updateCounters(const PacketView &view, bool fromA) {
     /**
      * ## Process Overview
      *
-     * ### Use raw pcpp packet to get timestamp of the packet.
+     * ### Use the packet timestamp.
      * ### Set conversation start and stop time. <b>Note: start time will be set to timestamp of first packet</b>
-     * ### Calculate and set duration
+     * ### Record the first and last packet times
      */
+    int pc{view.pc};
     if (debug) SPDLOG_INFO("Starting packet {}", pc);
-    auto *tcplayer = pkt.getLayerOfType<pcpp::TcpLayer>();
-    auto *ipLayer = pkt.getLayerOfType<pcpp::IPv4Layer>();
-    pcpp::tcphdr *tcpHdr = tcplayer->getTcpHeader();
-    pcpp::RawPacket *rawPkt = pkt.getRawPacketReadOnly();
-    timespec ts = rawPkt->getPacketTimeStamp();
-
-    std::string socket = ipLayer->getSrcIPAddress().toString() + ":" +
-                         std::to_string(tcpHdr->portSrc) + "<->" +
-                         ipLayer->getDstIPAddress().toString() + ":" +
-                         std::to_string(tcpHdr->portDst);
-    if (debug) SPDLOG_INFO("Packet {} Socket {}", pc, socket);
+    TimestampNs ts = view.tsNs;
+
+    std::string socket{};
+    if (debug) {
+        socket = view.ipLayer->getSrcIPAddress().toString() + ":" +
+                 std::to_string(pcpp::netToHost16(view.tcp->portSrc)) + "<->" +
+                 view.ipLayer->getDstIPAddress().toString() + ":" +
+                 std::to_string(pcpp::netToHost16(view.tcp->portDst));
+        SPDLOG_INFO("Packet {} Socket {}", pc, socket);
+    }
 
     if (!firstTS) {
-        firstTimeStamp = ts;
+        firstNs = ts;
         firstTS = true;
     }
-    duration = tsConSec(ts) - tsConSec(firstTimeStamp);
+    lastNs = ts;
 
     /**
      * ### Construct handshake flags
      */
     if (!syn) {
-        if ((tcpHdr->synFlag) != 0) {
+        if (view.syn) {
             syn = true;
             synTime = ts;
         }
     }
     if (syn && synAck && !ack) {
-        if ((tcpHdr->ackFlag) != 0) {
+        if (view.ack) {
             ack = true;
             ackTime = ts;
-            synAckAckTime = tsConSec(ackTime) - tsConSec(synAckTime);
+            synAckAckTime = nsToSeconds(ackTime - synAckTime);
         }
-        RST = (tcpHdr->rstFlag) != 0;
+        RST = view.rst;
     }
     if (syn && !synAck) {
-        synAck = ((tcpHdr->synFlag) != 0 && (tcpHdr->ackFlag) != 0);
+        synAck = view.syn && view.ack;
         if (synAck) {
             synAckTime = ts;
-            synSynAckTime = tsConSec(synAckTime) - tsConSec(synTime);
+            synSynAckTime = nsToSeconds(synAckTime - synTime);
 
             if (debug)
                 SPDLOG_INFO("socket {} synAck {}  synAckTime {}  synSynAckTime {}",
-                            socket, synAck, synAckTime.tv_nsec, synSynAckTime);
+                            socket, synAck, synAckTime, synSynAckTime);
         }
-        RST = (tcpHdr->rstFlag) != 0;
+        RST = view.rst;
     }
 
     // check for zero window
-    if (tcpHdr->synFlag == 0 && tcpHdr->rstFlag == 0 && pcpp::netToHost16(tcpHdr->windowSize) == 0) {
+    if (!view.syn && !view.rst && view.window == 0) {
         zeroWindow++;
     }
 
     /**
-     * ### Set packet Rate and packet counts
+     * ### Set packet counts. The rates are derived from the counts and the duration when reported.
      */
-    packetRate = (duration == 0.0) ? 0.0 : packetCount / duration;
     packetCount++;
-    if (tcpHdr->rstFlag) resetCount++;
+    if (view.rst) resetCount++;
+    if (view.fin) {
+        if (fromA == firstSpeaker) finSent = true;
+        else finRecv = true;
+    }
 
     /**
      * ###  Packet and Byte Counts
      */
-    int payloadLength{static_cast<int>(tcpLayer.getLayerPayloadSize())};
+    int payloadLength{static_cast<int>(view.payloadLength)};
     byteCount += payloadLength;
 
-    if (tcpCurrentAddress == firstSpeaker) {
+    if (fromA == firstSpeaker) {
         outputPacketCount++;
         if (payloadLength > 0) {
             sendDataPkt++;
             if (dataPacketRecv) {
                 firstDataPacketSent = false;
-                rspTime.push_back(currentRspTime);
-                iglist.push_back((tsConSec(ts) - tsConSec(igts)));
+                rspStats.add(currentRspTime);
+                if (quantiles) {
+                    if (!rspSketch) rspSketch.emplace();
+                    rspSketch->add(currentRspTime);
+                }
+                igStats.add(nsToSeconds(ts - igts));
             }
             if (!firstDataPacketSent) {
                 sendTime = ts;
                 dataPacketRecv = false;
                 firstDataPacketSent = true;
                 if (debug)
-                    SPDLOG_INFO("Data Packet Send {}  socket {} ns {}  pl {}", pc, socket, ts.tv_nsec, payloadLength);
+                    SPDLOG_INFO("Data Packet Send {}  socket {} ns {}  pl {}", pc, socket, ts, payloadLength);
             }
         }
         outputByteCount += payloadLength;
-        outputPacketRate = (duration == 0) ? 0.0 : outputPacketCount / duration;
 
     } else {
         inputPacketCount++;
@@ -563,73 +285,91 @@ void TCPConversation::updateCounters(const pcpp::Packet &pkt, pcpp::Layer &ipHdr
             if (firstDataPacketSent) {
                 if (debug)
                     SPDLOG_INFO("Data Recv: {}  socket {} rspTime {}  pl {} dpr {}",
-                                pc, socket, (ts.tv_nsec - sendTime.tv_nsec), payloadLength, dataPacketRecv);
-                currentRspTime = tsConSec(ts) - tsConSec(sendTime);
+                                pc, socket, ts - sendTime, payloadLength, dataPacketRecv);
+                currentRspTime = nsToSeconds(ts - sendTime);
                 dataPacketRecv = true;
                 igts = ts;
             }
         }
         inputByteCount += payloadLength;
-        inputPacketRate = (duration == 0) ? 0.0 : inputPacketCount / duration;
-    }
-}
-
-
-/**
- * @callgraph
- * @callergraph
- * @param vint      - Vector of pairs in the format <string,int>
- * @return          - string of HostPair keys in sorted order
- * @brief Sort Integers
- * sort a list of pairs by second element, in this case int
- */
-std::vector<std::string> TCPConversation::sortInt(std::vector<std::pair<std::string, int >> vint) {
-    std::vector<std::string> results{};
-    std::sort(vint.begin(), vint.end(), [](auto &left, auto &right) {
-        return left.second > right.second;
-    });
-    for (auto const &p: vint) {
-        results.emplace_back(p.first);
     }
-    return results;
 }
 
 /**
  * @callgraph
  * @callergraph
- * @param v     Vector of pairs. Each pair is of string,double
- * @return      string of HostPair keys in sort order
+ * @brief Merge the counters of another instance for the same conversation into this one
  *
- * Sort a list of pairs by the second element, in this case doubles.
+ * The pipeline routes every packet of a conversation to one worker, so this only runs if that is broken. Like
+ * HostPair::merge the first speaker and the handshake of the instance that saw the earliest packet are kept, and the
+ * send/receive counters of the other instance are swapped if it has the opposite first speaker. The counters and
+ * the response, inter-gap and ACK time statistics are added. The sequence state of this instance is kept.
+ * @param other     TCPConversation instance with the same key
  */
-std::vector<std::string> TCPConversation::sortDbl(std::vector<std::pair<std::string, double >> v) {
-    std::vector<std::string> results{};
-    std::sort(v.begin(), v.end(), [](auto &left, auto &right) {
-        return left.second > right.second;
-    });
-    for (auto const &p: v) {
-        results.emplace_back(p.first);
+void TCPConversation::merge(const TCPConversation &other) {
+    if (!other.firstTS) return;
+    if (!firstTS) {
+        auto position = lru;
+        bool wasClosing = closing;
+        *this = other;
+        lru = position;
+        closing = wasClosing;
+        return;
     }
-    return results;
-}
-
-/**
- * @callgraph
- * @callergraph
- * @param v     Vector of pairs. Each pair is of string,double
- * @return      string of HostPair keys in sort order
- *
- * Sort a list of pairs by the second element, in this case strings.
- */
-std::vector<std::string> TCPConversation::sortStr(std::vector<std::pair<std::string, std::string >> v) {
-    std::vector<std::string> results{};
-    std::sort(v.begin(), v.end(), [](auto &left, auto &right) {
-        return left.second > right.second;
-    });
-    for (auto const &p: v) {
-        results.emplace_back(p.first);
+    auto swapDirections = [this]() {
+        std::swap(inputPacketCount, outputPacketCount);
+        std::swap(inputByteCount, outputByteCount);
+        std::swap(recvDataPkt, sendDataPkt);
+        std::swap(inRetranCount, outRetransCount);
+        std::swap(recvDupAck, sendDupAck);
+        std::swap(recvWindowUpdates, sendWindowUpdates);
+        std::swap(finRecv, finSent);
+        std::swap(recvSeq, sendSeq);
+        std::swap(recvIds, sendIds);
+    };
+    lastNs = std::max(lastNs, other.lastNs);
+    if (other.firstNs < firstNs) {
+        firstNs = other.firstNs;
+        if (firstSpeaker != other.firstSpeaker) {
+            swapDirections();
+            firstSpeaker = other.firstSpeaker;
+        }
+        syn = other.syn;
+        synTime = other.synTime;
+        synAck = other.synAck;
+        synAckTime = other.synAckTime;
+        ack = other.ack;
+        ackTime = other.ackTime;
+        RST = other.RST;
+        synSynAckTime = other.synSynAckTime;
+        synAckAckTime = other.synAckAckTime;
+    }
+    bool same = (firstSpeaker == other.firstSpeaker);
+    auto add = [same](int &in, int &out, int otherIn, int otherOut) {
+        in += same ? otherIn : otherOut;
+        out += same ? otherOut : otherIn;
+    };
+    packetCount += other.packetCount;
+    byteCount += other.byteCount;
+    resetCount += other.resetCount;
+    totalRetrans += other.totalRetrans;
+    zeroWindow += other.zeroWindow;
+    add(inputPacketCount, outputPacketCount, other.inputPacketCount, other.outputPacketCount);
+    add(inputByteCount, outputByteCount, other.inputByteCount, other.outputByteCount);
+    add(recvDataPkt, sendDataPkt, other.recvDataPkt, other.sendDataPkt);
+    add(inRetranCount, outRetransCount, other.inRetranCount, other.outRetransCount);
+    add(recvDupAck, sendDupAck, other.recvDupAck, other.sendDupAck);
+    add(recvWindowUpdates, sendWindowUpdates, other.recvWindowUpdates, other.sendWindowUpdates);
+    finSent = finSent || (same ? other.finSent : other.finRecv);
+    finRecv = finRecv || (same ? other.finRecv : other.finSent);
+    sendSeq.ackTime.merge(same ? other.sendSeq.ackTime : other.recvSeq.ackTime);
+    recvSeq.ackTime.merge(same ? other.recvSeq.ackTime : other.sendSeq.ackTime);
+    rspStats.merge(other.rspStats);
+    igStats.merge(other.igStats);
+    if (other.rspSketch) {
+        if (rspSketch) rspSketch->merge(*other.rspSketch);
+        else rspSketch = other.rspSketch;
     }
-    return results;
 }
 
 /**
@@ -637,59 +377,64 @@ std::vector<std::string> TCPConversation::sortStr(std::vector<std::pair<std::str
  * @callgraph
  * @param tcl       TCP Conversation  map
  * @param colId     Column to sort
- * @return          Vector of TCPConversation keys in sorted order
+ * @param top       Number of rows to return. 0 returns all rows.
+ * @return          Vector of TCPConversation table entries in sorted order
  *
  * Routine will take a map of TCPConversation instances and sort it in descending order based on the column ID. The returned
- * string will be used index the TCP Conversation list to print the list in sorted order.
+ * entries point into the TCP Conversation list and are used to print the list in sorted order.
  */
-std::vector<std::string>
-TCPConversation::sortMap(const std::map<std::string, TCPConversation> &tcl, const std::string &colId) {
-    std::vector<std::pair<std::string, int >> vint{};
-    std::vector<std::pair<std::string, double >> vdouble{};
-    std::vector<std::pair<std::string, std::string >> vstring{};
-
-    for (auto const &[key, value]: tcl) {
-        if (colId == "id" || colId.starts_with("tcpc")) vstring.emplace_back(key, key);
-        if (colId == "sm" || colId.starts_with("srcm")) vstring.emplace_back(key, value.sourceMac);
-        if (colId == "dm" || colId.starts_with("dest")) vstring.emplace_back(key, value.destMac);
-
-        if (colId == "pc" || colId.starts_with("packetc")) vint.emplace_back(key, value.packetCount);
-        if (colId == "ipc" || colId.starts_with("inputpacketc")) vint.emplace_back(key, value.inputPacketCount);
-        if (colId == "opc" || colId.starts_with("outputpacketc")) vint.emplace_back(key, value.outputPacketCount);
-        if (colId == "bc" || colId.starts_with("bytec")) vint.emplace_back(key, value.byteCount);
-        if (colId == "ibc" || colId.starts_with("inbytec")) vint.emplace_back(key, value.inputByteCount);
-        if (colId == "obc" || colId.starts_with("outbytec")) vint.emplace_back(key, value.outputByteCount);
-        if (colId == "rst" || colId.starts_with("reset")) vint.emplace_back(key, value.resetCount);
-        if (colId == "ret" || colId.starts_with("retrans")) vint.emplace_back(key, value.totalRetrans);
-        if (colId == "irt" || colId.starts_with("inretrans")) vint.emplace_back(key, value.inRetranCount);
-        if (colId == "ort" || colId.starts_with("outretrans")) vint.emplace_back(key, value.outRetransCount);
-        if (colId == "sak" || colId.starts_with("senddup")) vint.emplace_back(key, value.sendDupAck);
-        if (colId == "rak" || colId.starts_with("recvdup")) vint.emplace_back(key, value.recvDupAck);
-        if (colId.starts_with("unackseq")) vint.emplace_back(key, value.seqUnacknowledged);
-        if (colId.starts_with("zero")) vint.emplace_back(key, value.zeroWindow);
-        if (colId.starts_with("senddatap")) vint.emplace_back(key, value.sendDataPkt);
-        if (colId.starts_with("recvdatap")) vint.emplace_back(key, value.recvDataPkt);
-        if (colId.starts_with("recvwindow")) vint.emplace_back(key, value.recvWindowUpdates);
-        if (colId.starts_with("sendwindow")) vint.emplace_back(key, value.sendWindowUpdates);
-
-        if (colId == "pr" || colId.starts_with("packetrate")) vdouble.emplace_back(key, value.packetRate);
-        if (colId == "pir" || colId.starts_with("recvpacketr")) vdouble.emplace_back(key, value.inputPacketRate);
-        if (colId == "opr" || colId.starts_with("sendpacketr")) vdouble.emplace_back(key, value.outputPacketRate);
-        if (colId == "dur" || colId.starts_with("dur")) vdouble.emplace_back(key, value.duration);
-        if (colId == "cts" || colId.starts_with("cts")) vdouble.emplace_back(key, value.synSynAckTime);
-        if (colId.starts_with("ctd")) vdouble.emplace_back(key, value.synAckAckTime);
-        if (colId == "sat" || colId.starts_with("sendackt")) vdouble.emplace_back(key, value.sendAckTimeAvg);
-        if (colId == "rat" || colId.starts_with("recvact")) vdouble.emplace_back(key, value.recvAckTimeAvg);
-        if (colId == "art" || colId.starts_with("avgrsp")) vstring.emplace_back(key, value.avgResponseTime);
-        if (colId.starts_with("intergaptime")) vstring.emplace_back(key, value.igAverageTime);
+std::vector<const TcpConversationEntry *>
+TCPConversation::sortMap(const TcpConversationTable &tcl, const std::string &colId, size_t top) {
+    std::vector<std::pair<const TcpConversationEntry *, int >> vint{};
+    std::vector<std::pair<const TcpConversationEntry *, double >> vdouble{};
+    std::vector<std::pair<const TcpConversationEntry *, std::string >> vstring{};
+
+    for (auto const &entry: tcl) {
+        auto const &[key, value] = entry;
+        if (colId == "id" || colId.starts_with("tcpc")) vstring.emplace_back(&entry, value.label(key));
+        if (colId == "sm" || colId.starts_with("srcm")) vstring.emplace_back(&entry, value.sourceMac.toString());
+        if (colId == "dm" || colId.starts_with("dest")) vstring.emplace_back(&entry, value.destMac.toString());
+
+        if (colId == "pc" || colId.starts_with("packetc")) vint.emplace_back(&entry, value.packetCount);
+        if (colId == "ipc" || colId.starts_with("inputpacketc")) vint.emplace_back(&entry, value.inputPacketCount);
+        if (colId == "opc" || colId.starts_with("outputpacketc")) vint.emplace_back(&entry, value.outputPacketCount);
+        if (colId == "bc" || colId.starts_with("bytec")) vint.emplace_back(&entry, value.byteCount);
+        if (colId == "ibc" || colId.starts_with("inbytec")) vint.emplace_back(&entry, value.inputByteCount);
+        if (colId == "obc" || colId.starts_with("outbytec")) vint.emplace_back(&entry, value.outputByteCount);
+        if (colId == "rst" || colId.starts_with("reset")) vint.emplace_back(&entry, value.resetCount);
+        if (colId == "ret" || colId.starts_with("retrans")) vint.emplace_back(&entry, value.totalRetrans);
+        if (colId == "irt" || colId.starts_with("inretrans")) vint.emplace_back(&entry, value.inRetranCount);
+        if (colId == "ort" || colId.starts_with("outretrans")) vint.emplace_back(&entry, value.outRetransCount);
+        if (colId == "sak" || colId.starts_with("senddup")) vint.emplace_back(&entry, value.sendDupAck);
+        if (colId == "rak" || colId.starts_with("recvdup")) vint.emplace_back(&entry, value.recvDupAck);
+        if (colId.starts_with("unackseq")) vint.emplace_back(&entry, value.result.seqUnacknowledged);
+        if (colId.starts_with("zero")) vint.emplace_back(&entry, value.zeroWindow);
+        if (colId.starts_with("senddatap")) vint.emplace_back(&entry, value.sendDataPkt);
+        if (colId.starts_with("recvdatap")) vint.emplace_back(&entry, value.recvDataPkt);
+        if (colId.starts_with("recvwindow")) vint.emplace_back(&entry, value.recvWindowUpdates);
+        if (colId.starts_with("sendwindow")) vint.emplace_back(&entry, value.sendWindowUpdates);
+
+        if (colId == "pr" || colId.starts_with("packetrate")) vdouble.emplace_back(&entry, value.result.packetRate);
+        if (colId == "pir" || colId.starts_with("recvpacketr")) vdouble.emplace_back(&entry, value.result.inputPacketRate);
+        if (colId == "opr" || colId.starts_with("sendpacketr")) vdouble.emplace_back(&entry, value.result.outputPacketRate);
+        if (colId == "dur" || colId.starts_with("dur")) vdouble.emplace_back(&entry, value.result.duration);
+        if (colId == "cts" || colId.starts_with("cts")) vdouble.emplace_back(&entry, value.synSynAckTime);
+        if (colId.starts_with("ctd")) vdouble.emplace_back(&entry, value.synAckAckTime);
+        if (colId == "sat" || colId.starts_with("sendackt")) vdouble.emplace_back(&entry, value.result.sendAckTimeAvg);
+        if (colId == "rat" || colId.starts_with("recvact")) vdouble.emplace_back(&entry, value.result.recvAckTimeAvg);
+        if (colId == "rspp50") vdouble.emplace_back(&entry, value.result.rspQuantiles[0]);
+        if (colId == "rspp95") vdouble.emplace_back(&entry, value.result.rspQuantiles[1]);
+        if (colId == "rspp99") vdouble.emplace_back(&entry, value.result.rspQuantiles[2]);
+        if (colId == "art" || colId.starts_with("avgrsp")) vdouble.emplace_back(&entry, value.result.avgResponseTime);
+        if (colId.starts_with("intergaptime")) vdouble.emplace_back(&entry, value.result.igAverageTime);
 
     }
-    std::vector<std::string> r{};
+    std::vector<const TcpConversationEntry *> r{};
 
     // Only one of the vector will have pairs. Figure out which one and sort it
-    if (!vint.empty()) return sortInt(vint);
-    if (!vdouble.empty()) return sortDbl(vdouble);
-    if (!vstring.empty()) return sortStr(vstring);
+    if (!vint.empty()) return sortRows(std::move(vint), top);
+    if (!vdouble.empty()) return sortRows(std::move(vdouble), top);
+    if (!vstring.empty()) return sortRows(std::move(vstring), top);
 
     return r;
 }
@@ -699,99 +444,145 @@ TCPConversation::sortMap(const std::map<std::string, TCPConversation> &tcl, cons
  * @callergraph
  * processIdnum will track Idnum values and use them to count retransmissions. This is done because idnum is unique for each IP packet
  * being sent.
+ * @param window    Recent IP IDs of the direction the packet was sent in
  * @param idnum     Ip Header Ip Id field
- * @return          Return true if this Id has been seen already, false otherwise.
- *
- * enhancement: Need a way to tell if id has wrapped. This routine will only be accurate if the id has not wrapped
+ * @param ipLength  Length of the IPv4 header and payload
+ * @return          Return true if this Id is in the window already, false otherwise.
  */
-bool TCPConversation::processIdNum(uint16_t idnum, const pcpp::Packet &pkt) {
+bool TCPConversation::processIdNum(IpIdWindow &window, uint16_t idnum, uint32_t ipLength) {
     if (debug) SPDLOG_INFO("IDNUM {}", idnum);
     if (idnum == 0) return false;
-    auto itr = idnumList.find(idnum);
 
     // check if the packet has data. We only care about data packets for retransmission
-    uint dl = pkt.getLayerOfType(pcpp::IPv4)->getDataLen();
-    if (dl == 0) return false;
+    if (ipLength == 0) return false;
+
+    if (window.seen(idnum)) return true;
+    window.add(idnum);
+    return false;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @param id        IP ID
+ * @return          True if id is one of the IDs in the window
+ */
+bool TCPConversation::IpIdWindow::seen(uint16_t id) const {
+    auto end = ids.begin() + static_cast<std::ptrdiff_t>(count);
+    return std::find(ids.begin(), end, id) != end;
+}
 
-    // check to see if idnum is in the map.
-    if (itr == idnumList.end()) {
-        idnumList[idnum] = true;
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Add an ID to the window, replacing the oldest one once the window is full
+ * @param id        IP ID
+ */
+void TCPConversation::IpIdWindow::add(uint16_t id) {
+    ids[next] = id;
+    next = (next + 1) % size;
+    if (count < size) count++;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Queue a data segment
+ *
+ * A segment that starts before the highest sequence number already seen is a retransmission (or arrived out of
+ * order). Only the part of it past the highest sequence number is queued.
+ * @param seq       Sequence number of the segment
+ * @param len       Payload length
+ * @param ts        Packet timestamp
+ * @return          True if the segment is a retransmission
+ */
+bool TCPConversation::SeqTracker::segment(uint32_t seq, uint32_t len, TimestampNs ts) {
+    uint32_t end = seq + len;
+    if (!started) {
+        started = true;
+        nextSeq = end;
+        unacked.push_back({seq, end, ts});
         return false;
-    } else {
-        return true;
     }
+    if (!seqBefore(seq, nextSeq)) {
+        nextSeq = end;
+        unacked.push_back({seq, end, ts});
+        return false;
+    }
+    if (seqBefore(nextSeq, end)) {
+        unacked.push_back({nextSeq, end, ts});
+        nextSeq = end;
+    }
+    return true;
 }
 
 /**
  * @callgraph
  * @callergraph
- * @param pkt           Parsed packet.
- * @return
+ * @brief Apply a cumulative ACK
  *
- *  * Track sequence numbers and use to check for retransmission
+ * Retires every queued segment that ends at or before the ACK number and adds its ACK time to the running sum.
+ * An ACK that repeats the last ACK number is a window update if the window grew, otherwise a duplicate ACK.
+ * @param ackNumber     ACK number of the packet
+ * @param window        Advertised window of the packet
+ * @param ts            Packet timestamp
+ * @return              What the ACK did
  */
-bool TCPConversation::processSequenceNumber(pcpp::Packet &pkt) {
-    if (debug) SPDLOG_INFO("Starting");
-    // Get TCPHeader and Sequence Number
-    auto *tcpLayer = pkt.getLayerOfType<pcpp::TcpLayer>();
-    pcpp::tcphdr *tcph = tcpLayer->getTcpHeader();
-    if (debug) SPDLOG_INFO("Sequence Number {}", pcpp::netToHost32(tcph->sequenceNumber));
-
-    // Get socket information for the current packet. Will use to determine direction,
-    // send or receive
-    std::string tcpCurrentAddress = getTcpConversationAddress(pkt, debug);
-
-    pcpp::RawPacket *rawPkt = pkt.getRawPacketReadOnly();
-    timespec t = rawPkt->getPacketTimeStamp();
-    if (tcpLayer->getLayerPayloadSize() > 0) {
-        seqRec sr{};
-        sr.ts = t;
-        // Determine send or receive direction, set sequence map and check for retransmission
-        if (tcpCurrentAddress == firstSpeaker) {  //Send Direction
-            auto itr = sendSequenceNumbers.find(pcpp::netToHost32(tcph->sequenceNumber));
-            if (itr == sendSequenceNumbers.end()) {
-                sr.ack = false;
-                sendSequenceNumbers[pcpp::netToHost32(tcph->sequenceNumber)] = sr;
-                return false;
-            } else {
-                return true;
-            }
-        } else {        // Receive Direction
-            auto itr = recvSequenceNumbers.find(pcpp::netToHost32(tcph->sequenceNumber));
-            if (itr == recvSequenceNumbers.end()) {
-                sr.ack = false;
-                recvSequenceNumbers[pcpp::netToHost32(tcph->sequenceNumber)] = sr;
-                return false;
-            } else {
-                return true;
-            }
+TCPConversation::SeqTracker::AckResult
+TCPConversation::SeqTracker::ack(uint32_t ackNumber, uint16_t window, TimestampNs ts) {
+    if (ackSeen && ackNumber == lastAck) {
+        if (window > lastWindow) {
+            lastWindow = window;
+            return windowUpdate;
         }
+        return duplicate;
     }
-    return false;
+    if (ackSeen && seqBefore(ackNumber, lastAck)) return none;   // old ACK arriving late
+
+    ackSeen = true;
+    lastAck = ackNumber;
+    lastWindow = window;
+    while (!unacked.empty() && !seqBefore(ackNumber, unacked.front().end)) {
+        ackTime.add(nsToSeconds(ts - unacked.front().ts));
+        unacked.pop_front();
+    }
+    return advanced;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @param view          Decoded packet
+ * @param fromA         True if the packet was sent from side A of the conversation key
+ * @return              True if the packet is a retransmission
+ *
+ *  * Track sequence numbers and use to check for retransmission
+ */
+bool TCPConversation::processSequenceNumber(const PacketView &view, bool fromA) {
+    ProfileScope scope(Stage::sequence);
+    if (debug) SPDLOG_INFO("Sequence Number {}", view.seq);
+    if (view.payloadLength == 0) return false;
+
+    // Determine send or receive direction and queue the segment
+    if (fromA == firstSpeaker) return sendSeq.segment(view.seq, view.payloadLength, view.tsNs);
+    return recvSeq.segment(view.seq, view.payloadLength, view.tsNs);
 }
 
 /**
  * @callergraph
  * @callgraph
- * @param p         Parsed Packet
+ * @param view      Decoded packet
+ * @param fromA     True if the packet was sent from side A of the conversation key
  *
  *  * Function will update retransmission counters for duplicate IP Id.
  */
-void TCPConversation::checkIpId(pcpp::Packet &p) {
+void TCPConversation::checkIpId(const PacketView &view, bool fromA) {
+    ProfileScope scope(Stage::ipId);
     if (debug) SPDLOG_INFO("Starting");
-    auto *ipLayer = p.getLayerOfType<pcpp::IPv4Layer>();
-    uint16_t idnum{pcpp::hostToNet16(ipLayer->getIPv4Header()->ipId)};
-    std::string key = getTcpConversationAddress(p, debug);
-    if (processIdNum(idnum, const_cast<pcpp::Packet &>(p))) {
+    if (processIdNum(fromA == getFirstSpeaker() ? sendIds : recvIds, view.ipId, view.ipLength)) {
         totalRetrans++;
-        totalRetransPercentage = double(totalRetrans) / double(packetCount);
-        if (key == getFirstSpeaker()) {
-            outRetransCount++;
-            sendRetranPercentage = double(outRetransCount) / double(packetCount);
-        } else {
-            inRetranCount++;
-            recvRetranPercentage = double(inRetranCount) / double(packetCount);
-        }
+        if (fromA == getFirstSpeaker()) outRetransCount++;
+        else inRetranCount++;
     }
 }
 
@@ -799,138 +590,208 @@ void TCPConversation::checkIpId(pcpp::Packet &p) {
 /**
  * @callgraph
  * @callergraph
- * \brief Get TCP Conversation Key
- * Routine to create a key for TCP Conversation Stats Table ( tcpConversationList ). It builds the key by first
- * calling getIpPair to get the hostPair key. Lastly is will use the pcpp::tcphdr to get the source and destination
- * port and append to the hostPair key to construct the tcpKey.
- * @param pkt       Parsed packet.
- * @return
+ * @param view      Decoded packet
+ * @param fromA     True if the packet was sent from side A of the conversation key
+ *
+ * Function to process Ack packets. The ACK retires the acknowledged segments of the other direction and is checked
+ * for duplicate ACKs and window updates. Note: ignoring data packet ACKs.
+ *
  */
-std::vector<std::string> TCPConversation::getTcpConversation(const pcpp::Packet &pkt, bool debug) {
-    std::vector<std::string> tcpKey{"", ""};
-
-    pcpp::Layer *ipv4 = pkt.getLayerOfType(pcpp::IPv4);
-    auto *ipv4hdr = dynamic_cast<pcpp::IPv4Layer *>(ipv4);
-    std::string src = ipv4hdr->getSrcIPAddress().toString();
-    std::string dst = ipv4hdr->getDstIPAddress().toString();
-
-    if (pcpp::Layer *tcp = pkt.getLayerOfType(pcpp::TCP); tcp != nullptr) {
-        auto *tcphdrlayer = dynamic_cast<pcpp::TcpLayer *>(tcp);
-        pcpp::tcphdr *tcpHdr = tcphdrlayer->getTcpHeader();
-        std::string sp = std::to_string(pcpp::hostToNet16(tcpHdr->portSrc));
-        std::string dp = std::to_string(pcpp::hostToNet16(tcpHdr->portDst));
-        std::string s1 = src + ":" + sp + "-" + dst + ":" + dp;
-        std::string s2 = dst + ":" + dp + "-" + src + ":" + sp;
-        tcpKey = {s1, s2};
+void TCPConversation::processAck(const PacketView &view, bool fromA) {
+    ProfileScope scope(Stage::ack);
+    if (view.tcp == nullptr) return;
+    if (debug) SPDLOG_INFO("Packet {} ACK Number {}", view.pc, view.ackNumber);
+
+    if (view.payloadLength != 0 || !view.ack || view.syn) return;
+
+    if (fromA == firstSpeaker) {
+        switch (recvSeq.ack(view.ackNumber, view.window, view.tsNs)) {
+            case SeqTracker::duplicate:
+                recvDupAck++;
+                break;
+            case SeqTracker::windowUpdate:
+                recvWindowUpdates++;
+                break;
+            default:
+                break;
+        }
+    } else {
+        switch (sendSeq.ack(view.ackNumber, view.window, view.tsNs)) {
+            case SeqTracker::duplicate:
+                sendDupAck++;
+                break;
+            case SeqTracker::windowUpdate:
+                sendWindowUpdates++;
+                break;
+            default:
+                break;
+        }
     }
-    if (debug) SPDLOG_INFO("tcp key {} {}", tcpKey[0], tcpKey[1]);
-    return tcpKey;
 }
 
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Column names of the TCP conversation tables
+ * @return      Names in the order of row(), with the quantile columns when they are collected
+ */
+std::vector<std::string> TCPConversation::columnNames() {
+    std::vector<std::string> names{columns};
+    if (quantiles) names.insert(names.end(), quantileColumns.begin(), quantileColumns.end());
+    return names;
+}
 
 /**
  * @callgraph
  * @callergraph
- * \brief Get TCP Socket
- * Function to construct a string with the TCP Socket information in the format:
- *
- * Source IP<-->Destination IP.Source Port.Destination Port <br>
- *      Example: \arg
- *          192.168.42.4<-->34.125.111.170.54487.47873
+ * @brief Send every column of this conversation to a row writer. finalize() must have been called.
  *
- * @param pkt       Parsed Packet
- * @return
+ * The text table, the CSV file and the evicted conversation file all use these fields. Numbers are passed as numbers
+ * so a csvfile formats them straight into its buffer.
+ * @param out       csvfile or RowStrings
+ * @param key       Key of this instance in the TCP conversation table
  */
-std::string TCPConversation::getTcpConversationAddress(const pcpp::Packet &pkt, bool debug) {
-    std::string tcpConversation;;
-
-    if (pcpp::Layer *tcp = pkt.getLayerOfType(pcpp::TCP); tcp != nullptr) {
-        pcpp::Layer *ipv4 = pkt.getLayerOfType(pcpp::IPv4);
-        auto *ipv4hdr = dynamic_cast<pcpp::IPv4Layer *>(ipv4);
-        std::string src = ipv4hdr->getSrcIPAddress().toString();
-        std::string dst = ipv4hdr->getDstIPAddress().toString();
-        auto *tcphdrlayer = dynamic_cast<pcpp::TcpLayer *>(tcp);
-        pcpp::tcphdr *tcpHdr = tcphdrlayer->getTcpHeader();
-        std::string sp = std::to_string(pcpp::hostToNet16(tcpHdr->portSrc));
-        std::string dp = std::to_string(pcpp::hostToNet16(tcpHdr->portDst));
-        tcpConversation = src + ":" + sp + "-" + dst + ":" + dp;
+template<typename Out>
+void TCPConversation::fields(Out &out, const FlowKey &key) const {
+    out << label(key) << sourceMac.toString() << destMac.toString() << result.handShake <<
+        synSynAckTime <<
+        synAckAckTime <<
+        result.sendAckTimeAvg <<
+        result.recvAckTimeAvg <<
+        Decimal{result.avgResponseTime, 5} <<
+        result.seqUnacknowledged <<
+        sendDupAck <<
+        recvDupAck <<
+        resetCount <<
+        zeroWindow <<
+        sendDataPkt <<
+        recvDataPkt <<
+        totalRetrans <<
+        result.retransRate <<
+        inRetranCount <<
+        outRetransCount <<
+        Decimal{result.igAverageTime, 5} <<
+        packetCount <<
+        inputPacketCount <<
+        outputPacketCount <<
+        byteCount <<
+        inputByteCount <<
+        outputByteCount <<
+        result.packetRate <<
+        result.inputPacketRate <<
+        result.outputPacketRate <<
+        recvWindowUpdates <<
+        sendWindowUpdates <<
+        result.duration;
+    if (quantiles) {
+        for (double q: result.rspQuantiles) out << Decimal{q, 5};
     }
-    if (debug) SPDLOG_INFO("Socket {}", tcpConversation);
-    return tcpConversation;
 }
 
 /**
+ * @callgraph
+ * @callergraph
+ * @brief Render this conversation as the cells of a text table row. finalize() must have been called.
+ * @param key       Key of this instance in the TCP conversation table
+ * @return          One string per column of columnNames(), formatted like the CSV fields
+ */
+std::vector<std::string> TCPConversation::row(const FlowKey &key) const {
+    RowStrings out;
+    fields(out, key);
+    return std::move(out.cells);
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Write the column names of the TCP conversation CSV table
+ */
+void TCPConversation::writeCsvHeader(csvfile &csv) {
+    for (auto const &name: columnNames()) csv << name;
+    csv << endrow;
+}
+
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Write this conversation as a row of the TCP conversation CSV table. finalize() must have been called.
+ * @param key       Key of this instance in the TCP conversation table
+ */
+void TCPConversation::writeCsvRow(csvfile &csv, const FlowKey &key) const {
+    fields(csv, key);
+    csv << endrow;
+}
+
+/**
+ * @callgraph
  * @callergraph
+ * @brief Handshake flags for the reports
+ * @return      S.SA.A for a complete handshake. R marks a reset during the handshake.
+ */
+std::string TCPConversation::handShakeString() const {
+    std::string handShake{"......"};
+    if (syn) handShake[0] = 'S';
+    if (ack) handShake[5] = 'A';
+    if (synAck) {
+        handShake[2] = 'S';
+        handShake[3] = 'A';
+    }
+    if (syn && !synAck && RST) {
+        handShake[2] = 'R';
+        handShake[3] = '.';
+    }
+    if (syn && synAck && RST) handShake[5] = 'R';
+    return handShake;
+}
+
+/**
  * @callgraph
+ * @callergraph
+ * @brief Compute the values that are only needed by the reports into the result record
  */
-bool checkAckList(uint32_t ackNumber, const std::map<uint32_t, uint16_t> &al) {
-    for (auto &[an, ws]: al) {
-        if (ackNumber == an) return true;
+void TCPConversation::finalize() {
+    result.handShake = handShakeString();
+    result.sendAckTimeAvg = sendSeq.ackTime.mean();
+    result.recvAckTimeAvg = recvSeq.ackTime.mean();
+    result.seqUnacknowledged = static_cast<int>(sendSeq.unacked.size() + recvSeq.unacked.size());
+    result.avgResponseTime = rspStats.mean();
+    result.igAverageTime = igStats.mean();
+    result.retransRate = packetCount == 0 ? 0.0 : double(totalRetrans) / double(packetCount);
+    result.packetRate = packetRate();
+    result.inputPacketRate = inputPacketRate();
+    result.outputPacketRate = outputPacketRate();
+    result.duration = duration();
+    if (rspSketch) {
+        result.rspQuantiles = {rspSketch->quantile(0.50), rspSketch->quantile(0.95), rspSketch->quantile(0.99)};
     }
-    return false;
 }
 
 /**
  * @callgraph
  * @callergraph
- * @param p         Parsed Packet
- *
- * Function to process Ack packets. Using the Ack number cycle over the proper sequence number map and
- * mark all instances that the Ack packet. Note: ignoring data packet ACKs.
+ * @brief Finalize every conversation of a table once before the reports are rendered
  *
+ * Large tables are split across threads. Each conversation is finalized by exactly one thread.
+ * @param tcl       TCP conversation table
+ * @param threads   Maximum number of threads
  */
-void TCPConversation::processAck(const pcpp::Packet &p, int pc) {
-    std::vector<std::string> v = packetFormat(p);
-    if (debug) SPDLOG_INFO("");
-    if (pcpp::Layer *tcp = p.getLayerOfType(pcpp::TCP); tcp != nullptr) {
-        auto *tcphdrlayer = dynamic_cast<pcpp::TcpLayer *>(tcp);
-        pcpp::tcphdr *tcpHdr = tcphdrlayer->getTcpHeader();
-        pcpp::RawPacket *rawPkt = p.getRawPacketReadOnly();
-        timespec t = rawPkt->getPacketTimeStamp();
-        if (debug) SPDLOG_INFO("ACK Number {}", pcpp::netToHost32(tcpHdr->ackNumber));
-
-        uint16_t dl = tcp->getLayerPayloadSize();
-        if (dl == 0 && tcpHdr->ackFlag == 1 && tcpHdr->synFlag == 0) {
-            uint16_t ws = pcpp::netToHost16(tcpHdr->windowSize);
-            if (TCPConversation::getTcpConversationAddress(p, debug) == firstSpeaker) {
-                // Check for duplicate ack
-                if (checkAckList(pcpp::netToHost32(tcpHdr->ackNumber), sendAckList)) {
-                    if (ws > sendAckList[pcpp::netToHost32(tcpHdr->ackNumber)]) {
-                        recvWindowUpdates++;
-                    } else {
-                        recvDupAck++;
-                    }
-                }
-                for (auto const &[k, v]: recvSequenceNumbers) {
-                    uint32_t kc = k;
-                    if (pcpp::netToHost32(tcpHdr->ackNumber) >= kc) {
-                        if (!recvSequenceNumbers[k].ack) {
-                            recvSequenceNumbers[k].ack = true;
-                            recvSequenceNumbers[k].ackTime = t;
-                            sendAckList[pcpp::netToHost32(tcpHdr->ackNumber)] = pcpp::netToHost16(tcpHdr->windowSize);
-                        }
-                    }
-                }
-            } else {
-                // receive
-                if (checkAckList(pcpp::netToHost32(tcpHdr->ackNumber), recvAckList)) {
-                    if (ws > recvAckList[pcpp::netToHost32(tcpHdr->ackNumber)]) {
-                        sendWindowUpdates++;
-                    } else {
-                        sendDupAck++;
-                    }
-                }
-                for (auto const &[k, v]: sendSequenceNumbers) {
-                    uint32_t kc = k;
-                    if (pcpp::netToHost32(tcpHdr->ackNumber) >= kc) {
-                        if (!sendSequenceNumbers[k].ack) {
-                            sendSequenceNumbers[k].ack = true;
-                            sendSequenceNumbers[k].ackTime = t;
-                            recvAckList[pcpp::netToHost32(tcpHdr->ackNumber)] = pcpp::netToHost16(tcpHdr->windowSize);
-                        }
-                    }
-                }
-            }
-        }
+void TCPConversation::finalizeTable(TcpConversationTable &tcl, int threads) {
+    std::vector<TCPConversation *> flows{};
+    flows.reserve(tcl.size());
+    for (auto &[key, value]: tcl) flows.push_back(&value);
+
+    auto work = [&flows](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) flows[i]->finalize();
+    };
+    size_t n = std::min(static_cast<size_t>(std::max(threads, 1)), flows.size() / finalizeChunk + 1);
+    if (n == 1) {
+        work(0, flows.size());
+        return;
     }
-}
\ No newline at end of file
+    size_t chunk = (flows.size() + n - 1) / n;
+    std::vector<std::thread> workers{};
+    for (size_t w = 0; w < n; w++) {
+        workers.emplace_back(work, w * chunk, std::min(flows.size(), (w + 1) * chunk));
+    }
+    for (auto &worker: workers) worker.join();
+}
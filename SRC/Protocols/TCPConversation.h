@@ -12,7 +12,8 @@
 
 #include <sys/time.h>
 #include <vector>
-#include <map>
+#include <array>
+#include <deque>
 #include <IPv4Layer.h>
 #include <Packet.h>
 #include <Layer.h>
@@ -27,34 +28,129 @@
 #include <regex>
 #include <numeric>
 #include "../include/csvfile.h"
+#include "FlowKey.h"
+#include "PacketView.h"
+#include "RunningStats.h"
+#include "SortRows.h"
+#include <optional>
+#include <unordered_map>
+#include <list>
 
+class TCPConversation;
+
+/**
+ * TCP conversation table. Key is the normalized 5-tuple of the conversation.
+ */
+using TcpConversationTable = std::unordered_map<FlowKey, TCPConversation, FlowKeyHash>;
+using TcpConversationEntry = TcpConversationTable::value_type;
 
 class TCPConversation {
 public:
     bool debug{false};
+    std::list<FlowKey>::iterator lru{};     ///< Position in the LRU list when flow eviction is on
+    bool closing{false};                    ///< Conversation has been moved to the closed list
+
+    /**
+     * When set, response time quantiles (p50, p95, p99) are collected and added to the reports
+     */
+    static inline bool quantiles{false};
+
+    /**
+     * @brief A data segment waiting for its ACK
+     */
+    struct Segment {
+        uint32_t seq{0};        ///< First sequence number of the segment
+        uint32_t end{0};        ///< Sequence number following the segment
+        TimestampNs ts{0};      ///< Time the segment was seen
+    };
+
+    /**
+     * @brief Sequence state of one direction of the conversation
+     *
+     * Unacknowledged segments are queued in sequence order. A cumulative ACK retires the segments at the front of
+     * the queue that it covers, so every segment is visited once. Sequence numbers are compared with serial number
+     * arithmetic so the state survives the sequence number wrapping.
+     */
+    struct SeqTracker {
+        enum AckResult {
+            none, advanced, duplicate, windowUpdate
+        };
+
+        std::deque<Segment> unacked;
+        bool started{false};
+        uint32_t nextSeq{0};            ///< Sequence number following the highest segment seen
+        bool ackSeen{false};
+        uint32_t lastAck{0};            ///< Highest ACK number seen for this direction's data
+        uint16_t lastWindow{0};         ///< Window advertised with lastAck
+        RunningStats ackTime;           ///< ACK times of the retired segments
+
+        bool segment(uint32_t seq, uint32_t len, TimestampNs ts);
+
+        AckResult ack(uint32_t ackNumber, uint16_t window, TimestampNs ts);
+    };
+
+    /**
+     * @brief The most recent IP IDs of one direction of the conversation
+     *
+     * A fixed ring of the last ipIdWindow IDs, so the state of a flow does not grow with its packet count. IDs older
+     * than the window are forgotten, which also keeps a long flow from counting every packet as a retransmission
+     * once its IP ID wraps.
+     */
+    struct IpIdWindow {
+        static constexpr size_t size{128};
+
+        std::array<uint16_t, size> ids{};
+        size_t count{0};                ///< Valid entries, at most size
+        size_t next{0};                 ///< Slot of the next ID
+
+        bool seen(uint16_t id) const;
+
+        void add(uint16_t id);
+    };
+
+    /**
+     * @return  True if sequence number a comes before b (RFC 1982 serial number arithmetic)
+     */
+    static bool seqBefore(uint32_t a, uint32_t b) {
+        return static_cast<int32_t>(a - b) < 0;
+    }
 
-    class seqRec {
-    public:
-        bool ack{false};
-        timespec ts{};
-        timespec ackTime{};
+    /**
+     * @brief Values derived from the counters for the reports
+     *
+     * finalize() computes the record once per report. The text table, the CSV file and the evicted conversation file
+     * are all rendered from it, and the report columns are sorted on it.
+     */
+    struct Result {
+        std::string handShake{"......"};
+        double sendAckTimeAvg{0.0};
+        double recvAckTimeAvg{0.0};
+        int seqUnacknowledged{0};
+        double avgResponseTime{0.0};
+        double igAverageTime{0.0};
+        double retransRate{0.0};
+        double packetRate{0.0};
+        double inputPacketRate{0.0};
+        double outputPacketRate{0.0};
+        double duration{0.0};
+        std::array<double, 3> rspQuantiles{};   ///< p50, p95 and p99 of the response time
     };
 
     /**
      * \callgraph
      * @callergraph
-     * @param s
+     * @param aFirst    True if side A of the conversation key is the first speaker
      */
-    void setFirstSpeaker(std::string &s) {
-        firstSpeaker = s;
+    void setFirstSpeaker(bool aFirst) {
+        firstSpeaker = aFirst;
     }
 
     /**
      * @callgraph
      * @callergraph
-     * @return
+     * @return          True if side A of the conversation key is the first speaker
      */
-    std::string getFirstSpeaker() {
+    [[nodiscard]] bool getFirstSpeaker() const {
         return firstSpeaker;
     }
 
@@ -63,56 +159,83 @@ public:
      * @callergraph
      * @callgraph
      */
-    void setMacAdress(std::vector<std::string> m) {
-        sourceMac = m[0];
-        destMac = m[1];
+    void setMacAdress(const pcpp::MacAddress &src, const pcpp::MacAddress &dst) {
+        sourceMac = src;
+        destMac = dst;
     }
 
+    /**
+     * @brief Socket label used in the reports
+     * @param key   Key of this instance in the TCP conversation table
+     * @return      String in the format sip:sport-dip:dport with the first speaker first
+     */
+    [[nodiscard]] std::string label(const FlowKey &key) const {
+        return key.toString(firstSpeaker);
+    }
+
+    void updateCounters(const PacketView &view, bool fromA);
 
-    void updateCounters(const pcpp::Packet &pkt, pcpp::Layer &ipHdr, pcpp::Layer &tcpLayer,
-                        const std::string &tcpCurrentAddress, int pc);
+    void merge(const TCPConversation &other);
 
-    static void printTable(std::map<std::string, TCPConversation> &tcl, const std::string &ss,
+    static void printTable(const TcpConversationTable &tcl, const std::string &ss, size_t top,
                            bool debug
     );
 
-    static void writeCsvTable(std::map<std::string, TCPConversation> &tcl, const std::string &ss,
+    static void writeCsvTable(const TcpConversationTable &tcl, const std::string &ss, size_t top,
                               bool debug
     );
 
-    static std::vector<std::string>
-    sortMap(const std::map<std::string, TCPConversation> &tcl, const std::string &colId);
+    static std::vector<std::string> columnNames();
+
+    [[nodiscard]] std::vector<std::string> row(const FlowKey &key) const;
+
+    static void writeCsvHeader(csvfile &csv);
 
-    static std::vector<std::string> sortInt(std::vector<std::pair<std::string, int >> vint);
+    void writeCsvRow(csvfile &csv, const FlowKey &key) const;
 
-    static std::vector<std::string> sortDbl(std::vector<std::pair<std::string, double >> v);
+    [[nodiscard]] std::string handShakeString() const;
 
-    static std::vector<std::string> sortStr(std::vector<std::pair<std::string, std::string >> v);
+    void finalize();
 
-    bool processIdNum(uint16_t idnum, const pcpp::Packet &pkt);
+    static void finalizeTable(TcpConversationTable &tcl, int threads);
 
-    bool processSequenceNumber(pcpp::Packet &pkt);
+    /**
+     * @return  True once a reset has been seen or both sides have sent a FIN
+     */
+    [[nodiscard]] bool isClosed() const {
+        return resetCount > 0 || (finSent && finRecv);
+    }
 
-    void checkIpId(pcpp::Packet &p);
+    static std::vector<const TcpConversationEntry *>
+    sortMap(const TcpConversationTable &tcl, const std::string &colId, size_t top);
 
-    static std::vector<std::string> getTcpConversation(const pcpp::Packet &pkt, bool debug);
+    bool processIdNum(IpIdWindow &window, uint16_t idnum, uint32_t ipLength);
 
-    static std::string getTcpConversationAddress(const pcpp::Packet &pkt, bool debug);
+    bool processSequenceNumber(const PacketView &view, bool fromA);
 
-    void processAck(const pcpp::Packet &p, int pc);
+    void checkIpId(const PacketView &view, bool fromA);
 
-    static long double tsConSec(timespec ts) {
-        return ((ts.tv_sec) * 1e9 + (ts.tv_nsec)) / 1e9L;
+    void processAck(const PacketView &view, bool fromA);
+
+    /**
+     * @return  Timestamp of the last packet
+     */
+    [[nodiscard]] TimestampNs lastSeen() const {
+        return lastNs;
     }
 
 
 private:
-    std::string sourceMac;
-    std::string destMac;
-    std::string firstSpeaker;
+    template<typename Out>
+    void fields(Out &out, const FlowKey &key) const;
+
+    Result result;
+    pcpp::MacAddress sourceMac;
+    pcpp::MacAddress destMac;
+    bool firstSpeaker{true};
     bool firstTS{false};
-    timespec firstTimeStamp{};
-    long double duration{0};
+    TimestampNs firstNs{0};
+    TimestampNs lastNs{0};
     int packetCount{0};
     int inputPacketCount{0};
     int outputPacketCount{0};
@@ -121,64 +244,59 @@ private:
     int byteCount{0};
     int inputByteCount{0};
     int outputByteCount{0};
-    double packetRate{0.0};
-    double inputPacketRate{0.0};
-    double outputPacketRate{0.0};
     int resetCount{0};
+    bool finSent{false};
+    bool finRecv{false};
 
     // The following flags are used to track conversation set up state
 
     bool syn{false};
-    timespec synTime{0};
+    TimestampNs synTime{0};
     bool synAck{false};
-    timespec synAckTime{0};
+    TimestampNs synAckTime{0};
     bool ack{false};
-    timespec ackTime{0};
+    TimestampNs ackTime{0};
     bool RST{false};
-    long double synSynAckTime{0.0L};
-    long double synAckAckTime{0.0L};
+    double synSynAckTime{0.0};
+    double synAckAckTime{0.0};
 
     // Response Time
     bool firstDataPacketSent{false};
     bool dataPacketRecv{false};
-    long double currentRspTime{0.0L};
-    std::vector<double> rspTime{};
-    timespec sendTime{};
-    std::string avgResponseTime{};
-    //long double stdResponseTime{0};
-    //long double maxResponseTime{0};
+    double currentRspTime{0.0};
+    RunningStats rspStats;
+    std::optional<QuantileSketch> rspSketch;
+    TimestampNs sendTime{0};
 
     // Inter-gap time - This is the time between a response to a request and the next request
-    timespec igts;
-    std::vector<double> iglist;
-    std::string igAverageTime{};
-    // long double igMaxTime{0};
-    // long double  igStdTime{0};
+    TimestampNs igts{0};
+    RunningStats igStats;
 
     // Sequence Number Analysis
-    std::map<uint32_t, seqRec> sendSequenceNumbers;
-    std::map<uint32_t, seqRec> recvSequenceNumbers;
-    long double sendAckTimeAvg{0.0};
-    long double recvAckTimeAvg{0.0};
-    std::map<uint16_t, bool> idnumList;
-    int seqUnacknowledged{0};
+    SeqTracker sendSeq;
+    SeqTracker recvSeq;
+    IpIdWindow sendIds;
+    IpIdWindow recvIds;
 
     // Retransmission Stats
     int totalRetrans{0};
     int inRetranCount{0};
     int outRetransCount{0};
-    double totalRetransPercentage{0.0};
-    double recvRetranPercentage{0.0};
-    double sendRetranPercentage{0.0};
 
     int recvDupAck{0};
     int sendDupAck{0};
 
-    std::map<uint32_t, uint16_t> sendAckList;
-    std::map<uint32_t, uint16_t> recvAckList;
     int sendWindowUpdates{0};
     int recvWindowUpdates{0};
     int zeroWindow{0};
+
+    [[nodiscard]] double duration() const { return nsToSeconds(lastNs - firstNs); }
+
+    [[nodiscard]] double packetRate() const { return perSecond(packetCount, lastNs - firstNs); }
+
+    [[nodiscard]] double inputPacketRate() const { return perSecond(inputPacketCount, lastNs - firstNs); }
+
+    [[nodiscard]] double outputPacketRate() const { return perSecond(outputPacketCount, lastNs - firstNs); }
 };
 
 #endif //MACPCAP_TCPCONVERSATION_H
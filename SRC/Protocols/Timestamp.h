@@ -0,0 +1,43 @@
+/**
+ * @file
+ * @brief Packet Timestamps
+ *
+ * The statistics classes keep packet times as 64 bit nanosecond counts. Durations are differences of two counts and
+ * are only converted to seconds, and divided into rates, when a report or export asks for them.
+ */
+
+#ifndef MACPCAP_TIMESTAMP_H
+#define MACPCAP_TIMESTAMP_H
+
+#include <cstdint>
+#include <ctime>
+
+/**
+ * Nanoseconds since the epoch, or a difference of two such times
+ */
+using TimestampNs = int64_t;
+
+constexpr TimestampNs nsPerSecond{1000000000};
+
+/**
+ * @return  ts in nanoseconds
+ */
+inline TimestampNs toNs(const timespec &ts) {
+    return static_cast<TimestampNs>(ts.tv_sec) * nsPerSecond + ts.tv_nsec;
+}
+
+/**
+ * @return  A nanosecond time or duration in seconds
+ */
+inline double nsToSeconds(TimestampNs ns) {
+    return static_cast<double>(ns) / static_cast<double>(nsPerSecond);
+}
+
+/**
+ * @return  count per second over a duration, 0 for an empty duration
+ */
+inline double perSecond(long count, TimestampNs duration) {
+    return duration == 0 ? 0.0 : static_cast<double>(count) / nsToSeconds(duration);
+}
+
+#endif //MACPCAP_TIMESTAMP_H
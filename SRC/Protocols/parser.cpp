@@ -6,6 +6,8 @@
 #include <iostream>
 #include <map>
 #include "HostPair.h"
+#include "FlowSink.h"
+#include "../Profile/Profiler.h"
 
 /**
  * @file
@@ -44,165 +46,131 @@
  * \callgraph
  * @callergraph
  * This routine is used to process the IP header and construct a HostPair instance if it is the  first packet.
- * @param pkt               - pcpp parsed packet
- * @param hostPairList      - map of HostPair instances
- * @return key              - key is a string of a source and destination IP pair: 1.1.1.1-2.2.2.2
- * - Returns a string key which is the IP host pair addresses in the format SRCIP<-->DSTIP
+ * @param view              - decoded packet
+ * @param tables            - statistics tables
+ * @return                  - HostPair instance for the packet
  *
  *  @vhdlflow
  */
-std::string getIPMapInstance(const pcpp::Packet &pkt,
-                             std::map<std::string,
-                                     HostPair> &hostPairList,
-                             bool debug
+HostPair &getIPMapInstance(const PacketView &view,
+                           StatsTables &tables,
+                           bool debug
 ) {
     /**
      * ## Process Overview
      *
      * ### Get IP Pair Key and Return to Caller
-     * - Call ipPairKey to get a vector that has two keys:
-     *   - Source and destination key as seen in the first packet
-     *   - Reverse key of the above.
-     *   - Example:
-     * 192.168.1.1-192.168.2.1
-     * 192.168.2.1-192.168.1.1
-     * - Using the keys search the map HostPair for a match. Return matching key.
-     *  - Exception: Create a HostPair instance using the first key
+     * - The normalized host pair key was built when the packet was decoded. Both directions of the host pair
+     *   produce the same key.
+     * - Using the key search the map HostPair for a match in a single lookup.
+     *  - Exception: Create a HostPair instance with the sender of this packet as the first speaker
+     * - When flow limits are set move the instance to the back of the LRU list and evict the least recently used
+     *   host pair if the table is full
      */
-    std::vector<std::string> ipPairkey{HostPair::getIpPair(pkt, debug)};
-    /**
-    *  #### allocate instance of hostPair if key is not in Master.hostpair, otherwise select appropriate key.
-    */
-    std::string key{};
-    std::string s1{ipPairkey[0]};
-    std::string s2{ipPairkey[1]};
-    std::map<std::string, HostPair>::iterator i1;
-    std::map<std::string, HostPair>::iterator i2;
-    i1 = hostPairList.find(s1);
-    i2 = hostPairList.find(s2);
-    if (debug) SPDLOG_INFO("S1 {}  s2 {}", s1, s2);
-    if (i1 == hostPairList.end() && i2 == hostPairList.end()) {
-        HostPair hp;
-        hp.setFirstSpeaker(s1);
-        hp.debug = debug;
-        hostPairList.try_emplace(s1, hp);
-        key = s1;
-    } else
-        key = (i1 == hostPairList.end()) ? s2 : s1;
-    if (debug) SPDLOG_INFO("key {}", key);
-    return key;
+    const FlowKey &key{view.ipPair};
+    auto [it, inserted] = tables.hostPairList.try_emplace(key);
+    if (inserted) {
+        it->second.setFirstSpeaker(view.ipFromA);
+        it->second.debug = debug;
+    }
+    if (tables.limits.enabled()) {
+        StatsTables::touch(tables.hostPairLru, it->second.lru, key, inserted);
+        if (tables.limits.maxFlows > 0 && tables.hostPairList.size() > tables.limits.maxFlows) {
+            FlowKey oldest = tables.hostPairLru.front();
+            tables.evict(oldest, tables.hostPairList.at(oldest));
+        }
+    }
+    if (debug) SPDLOG_INFO("key {}", it->second.label(key));
+    return it->second;
 }
 
 /**
  * \callgraph
  * @callergraph
- * ProcessTcpPacket is where most of the work is done for analyzing the TCP header. Note: in order for the SYN flag
- * too be used for the setting of first speaker this routine must be called before the processIpPacket.
+ * ProcessTcpPacket is where most of the work is done for analyzing the TCP header.
  *
- * @param pkt           - This is a parsed pcap plus plus (pcpp) packet
- * @param ipHdr         - This is the pcpp IP header
- * @param tcpl          - This is the map that maintains stats data for the TCP conversations
- * @param hostPairList  - This is the hostPair table (map)
+ * @param view          - Decoded packet
+ * @param tables        - Statistics tables. The TCP conversation table maintains stats data for the TCP conversations
  */
-int processTcpPacket(const pcpp::Packet &pkt,
-                     pcpp::IPv4Layer *ipHdr,
-                     std::map<std::string, TCPConversation> &tcpl,
-                     std::map<std::string, HostPair> &hostPairList,
-                     bool debug,
-                     int pc
+int processTcpPacket(const PacketView &view,
+                     StatsTables &tables,
+                     bool debug
 ) {
+    ProfileScope scope(Stage::tcp);
 
     /**
      * ## Process Overview
      *
     *
-    * ### Get TCP Layer and Header
+    * ### Check the TCP header
     * - Return 1 to caller if this packet does not have a TCP Header
     */
 
-    auto *tcplayer = pkt.getLayerOfType<pcpp::TcpLayer>();
-    if (tcplayer == nullptr) {
+    if (view.tcp == nullptr) {
         if (debug) SPDLOG_INFO("Packet does not have TCP layer");
         return 1;
     }
-    pcpp::tcphdr *tcpHdr = tcplayer->getTcpHeader();
-
-    if (tcplayer->getProtocol() == pcpp::TCP) {
-        /**
-         * ###  Construct a TCPConversation instance if this is the first packet. Set key to the conversation pair.
-         *
-         * - Call  Master::getTcpConversation(pkt) to get vector of TCP Conversation keys
-         *     - Example:
-         *     -# 192.168.1.1-192.168.2.1.5000.6000
-         *     -# 192.168.2.1-192.168.1.1.6000.5000
-         * - Search map TCP Conversations using the key vector.
-         */
 
-        std::vector<std::string> tcpKey = TCPConversation::getTcpConversation(pkt, debug);
-        std::string key{};
-        std::string s1{tcpKey[0]};
-        std::string s2{tcpKey[1]};
-        if (debug) SPDLOG_INFO("S1 {}  s2 {}", s1, s2);
+    /**
+     * ###  Construct a TCPConversation instance if this is the first packet.
+     *
+     * - The normalized conversation key was built when the packet was decoded
+     * - Search map TCP Conversations using the key. This is the only lookup done for the packet.
+     */
+    bool fromA{view.tcpFromA};
+    const FlowKey &key{view.tcpKey};
+    auto [it, inserted] = tables.tcpConversationList.try_emplace(key);
+    TCPConversation &tcpc = it->second;
 
-        std::map<std::string, TCPConversation>::iterator i1;
-        std::map<std::string, TCPConversation>::iterator i2;
-        i1 = tcpl.find(s1);
-        i2 = tcpl.find(s2);
+    if (inserted) {
         /**
-        *    -  Set firstSpeaker to the first packet or if the SYN bit is set. <B>Note: hostPair first speaker will
-        * also be set here</B>
+        * set source and destination Mac Address
         */
-        if (i1 == tcpl.end() && i2 == tcpl.end()) {
-            /**
-            *    - Construct an IP HostPair entry in the HostPairList map and set the first speaker. This will make sure
-            * the firstSpeaker in each class instance is the same IP pair
-            */
-            std::string ipKey{getIPMapInstance(pkt, hostPairList, debug)};
-
-            /**
-             * - Construct TCP Conversation Map Instance
-             */
-            TCPConversation tcpc;
-
-            /**
-            * set source and destination Mac Address
-            */
-            tcpc.setMacAdress(getMacAddress(const_cast<pcpp::Packet &>(pkt), debug));
-
-            /**
-            * - firstSpeaker will be set based on the following:
-            *    -# SYN Packet - will use s1
-            *    -#  SYN Ack - will use s2 (reverse key)
-            *    -#  First data packet seen
-            * - Add TCP Conversation instance to the TCP Conversation Map
-            */
-            if (tcpHdr->synFlag == 1 && tcpHdr->ackFlag == 1) {
-                s1 = s2;
-            }
-            tcpc.setFirstSpeaker(s1);
-            tcpc.debug = debug;
-            tcpl.try_emplace(s1, tcpc);
-            key = s1;
-        } else
-            key = (i1 == tcpl.end()) ? s2 : s1;
-        if (debug) SPDLOG_INFO("Key {}", key);
+        if (view.ethLayer != nullptr) {
+            tcpc.setMacAdress(view.ethLayer->getSourceMac(), view.ethLayer->getDestMac());
+        }
+
         /**
-         * Check for retransmissions
-         */
-        tcpl[key].checkIpId(const_cast<pcpp::Packet &>(pkt));
-        tcpl[key].processSequenceNumber(const_cast<pcpp::Packet &>(pkt));
-        if (tcpHdr->ackFlag == 1) tcpl[key].processAck((const_cast<pcpp::Packet &>(pkt)), pc);
+        * - firstSpeaker will be set based on the following:
+        *    -# SYN Packet - sender of the packet
+        *    -#  SYN Ack - receiver of the packet
+        *    -#  First data packet seen
+        */
+        bool aFirst{fromA};
+        if (view.syn && view.ack) {
+            aFirst = !fromA;
+        }
+        tcpc.setFirstSpeaker(aFirst);
+        tcpc.debug = debug;
+    }
+    if (debug) SPDLOG_INFO("Key {}", tcpc.label(key));
+    /**
+     * Check for retransmissions
+     */
+    tcpc.checkIpId(view, fromA);
+    tcpc.processSequenceNumber(view, fromA);
+    if (view.ack) tcpc.processAck(view, fromA);
 
-        // Check for retransmissions of sequence numbers.
+    /**
+     * ### USe key from previous step to update counters for the TCP Conversation
+     */
+    tcpc.updateCounters(view, fromA);
 
-        /**
-         * ### USe key from previous step to update counters for the TCP Conversation
-         */
-        std::string tcpCurrentAddress = tcpl[key].getTcpConversationAddress(pkt, debug);
-        if (debug) SPDLOG_INFO("TCP Socket: {}", tcpCurrentAddress);
-        tcpl[key].updateCounters(pkt, *ipHdr, *tcplayer, tcpCurrentAddress, pc);
+    /**
+     * ### Flow limits: keep the LRU order, move closed conversations to the closed list, enforce the table size
+     */
+    if (tables.limits.enabled()) {
+        StatsTables::touch(tcpc.closing ? tables.tcpClosedLru : tables.tcpLru, tcpc.lru, key, inserted);
+        if (tables.limits.closeWait > 0 && !tcpc.closing && tcpc.isClosed()) {
+            tables.tcpClosedLru.splice(tables.tcpClosedLru.end(), tables.tcpLru, tcpc.lru);
+            tcpc.closing = true;
+        }
+        if (tables.limits.maxFlows > 0 && tables.tcpConversationList.size() > tables.limits.maxFlows) {
+            FlowKey oldest = tables.tcpClosedLru.empty() ? tables.tcpLru.front() : tables.tcpClosedLru.front();
+            tables.evict(oldest, tables.tcpConversationList.at(oldest));
+        }
+    }
 
-    } // end if tcp
     return 0;
 }
 
@@ -211,158 +179,91 @@ int processTcpPacket(const pcpp::Packet &pkt,
  * the TCP header.
  * @callgraph
  * @callergraph
- * @param master            Master Class
- * @param pkt               Parsed PCPP Packet
- * @param ipHdr             PCPP Layer for the IP Header
- * @param hostPairList      Map of HostPair instances
- * @param tcpl              Map of TCPConversation instances
+ * @param view              Decoded packet
+ * @param tables            Statistics tables
  */
-void processIpPacket(const pcpp::Packet &pkt,
-                     pcpp::Layer *ipHdr,
-                     std::map<std::string, HostPair> &hostPairList,
-                     std::map<std::string,
-                             TCPConversation> &tcpl,
-                     int pc,
+void processIpPacket(const PacketView &view,
+                     StatsTables &tables,
                      bool debug
 ) {
-    std::vector<std::string> ipPairkey{HostPair::getIpPair(pkt, debug)};
+    ProfileScope scope(Stage::ip);
     /**
      * ## Process Overview
      *
+     * ### Look up or construct the HostPair instance. The first packet of the host pair sets the first speaker.
+     *
      * ### Check to see if this is a TCP packet, if so go process it
      *
      * ### Process counters for the IP packet and update HostPair instance
+     *
+     * Each step is skipped when its table is not in the stage mask.
      */
-    auto *ipv4 = pkt.getLayerOfType<pcpp::IPv4Layer>();
-    processTcpPacket(pkt, ipv4, tcpl, hostPairList, debug, pc);
-
-    std::string key = getIPMapInstance(pkt, hostPairList, debug);
-    if (debug) SPDLOG_INFO("Key {}", key);
-
-    std::string currentPacketIpAddress = HostPair::getIpAddress(pkt, debug);
-    if (debug) SPDLOG_INFO("Current IP Address {}", currentPacketIpAddress);
-
-    hostPairList[key].updateCounters(pkt, *ipHdr, currentPacketIpAddress);
-
-
+    if (tables.stages & hostPairStage) {
+        HostPair &hp = getIPMapInstance(view, tables, debug);
+        if (tables.stages & tcpStage) processTcpPacket(view, tables, debug);
+        hp.updateCounters(view, view.ipFromA);
+    } else if (tables.stages & tcpStage) {
+        processTcpPacket(view, tables, debug);
+    }
 }
 
 /**
  * @callergraph
  * @callgraph
- * @param pkt
+ * @param view      Decoded packet
  * Process an Ethernet header and set up an ethernetStats instance
  */
-void processEthernet(pcpp::Packet &pkt, std::map<std::string, EthernetStats> &ethernetStatsList, bool debug) {
-    auto *ethLayer = dynamic_cast<pcpp::EthLayer *>(pkt.getLayerOfType(pcpp::Ethernet));
-    std::string sourceMac = ethLayer->getSourceMac().toString();
-    std::string destMac = ethLayer->getDestMac().toString();
-    std::string key = sourceMac + "<->" + destMac;
-    std::string rkey = destMac + "<->" + sourceMac;
-    if (debug) SPDLOG_INFO("key {}  Rkey {}", key, rkey);
-
-    std::string s1;
-
-    std::map<std::string, EthernetStats>::iterator i1;
-    std::map<std::string, EthernetStats>::iterator i2;
-    i1 = ethernetStatsList.find(key);
-    i2 = ethernetStatsList.find(rkey);
-    if (i1 == ethernetStatsList.end() && i2 == ethernetStatsList.end()) {
-        // no entry in list. Create an EtherStats instance and place in list
-        EthernetStats es;
-        es.setFs(key);
-        es.debug = debug;
-        ethernetStatsList.try_emplace(key, es);
-        s1 = key;
-    } else {
-        s1 = (i1 == ethernetStatsList.end()) ? rkey : key;
+void processEthernet(const PacketView &view, StatsTables &tables, bool debug) {
+    ProfileScope scope(Stage::ethernet);
+    bool fromA{true};
+    MacPairKey key{MacPairKey::make(view.eth->srcMac, view.eth->dstMac, fromA)};
+
+    auto [it, inserted] = tables.ethernetStatsList.try_emplace(key);
+    if (inserted) {
+        // no entry in list. Set up the EtherStats instance with this sender as the first speaker
+        it->second.setFs(fromA);
+        it->second.debug = debug;
+    }
+    if (tables.limits.enabled() && tables.limits.macPairs) {
+        StatsTables::touch(tables.ethernetLru, it->second.lru, key, inserted);
+        if (tables.limits.maxFlows > 0 && tables.ethernetStatsList.size() > tables.limits.maxFlows) {
+            MacPairKey oldest = tables.ethernetLru.front();
+            tables.evict(oldest, tables.ethernetStatsList.at(oldest));
+        }
     }
 
-    if (debug) SPDLOG_INFO("S1 {}", s1);
-    ethernetStatsList[s1].updateCounters(pkt);
+    if (debug) SPDLOG_INFO("key {}", it->second.label(key));
+    it->second.updateCounters(view, fromA);
 }
 
 /**
  * Routine to get mac addresses of a packet
  * @callergraph
  * @callgraph
- * @param pkt       Parsed Packet
- * @return
+ * @param view      Decoded packet
+ * @param p         protocol type of first layer of packet
  */
-std::vector<std::string> getMacAddress(pcpp::Packet &pkt, bool debug) {
-    if (debug) SPDLOG_INFO("");
-    std::vector<std::string> macAddresses{};
-    auto *ethlayer = pkt.getLayerOfType<pcpp::EthLayer>();
-    std::string srcMac{ethlayer->getSourceMac().toString()};
-    macAddresses.emplace_back(srcMac);
-    std::string dstMac{ethlayer->getDestMac().toString()};
-    macAddresses.emplace_back(dstMac);
-    return macAddresses;
+void
+processProtocol(const PacketView &view, pcpp::ProtocolType p, ProtocolStatsTable &pl, bool debug) {
+    ProfileScope scope(Stage::protocol);
+    if (debug) SPDLOG_INFO("P {}", p);
+    if (p == pcpp::Ethernet) pl.add(view, debug);
 }
 
 /**
- * Routine to get mac addresses of a packet
- * @callergraph
  * @callgraph
- * @param pkt       Parsed Packet
- * @param p         protocol type of first layer of packet
+ * @callergraph
+ * @brief Stage mask for a --report option
+ * @param reportType    prot, eth, hp, tcp or all
+ * @return              ParseStage mask with only the engine that fills the report. All stages for all or an
+ *                      unknown report type.
  */
-void
-processProtocol(const pcpp::Packet &pkt, pcpp::ProtocolType p, std::map<std::string, ProtocolStats> &pl, bool debug) {
-    std::map<uint16_t, std::string> etherTypeTable{
-            {0x0806, "ARP"},
-            {0x0800, "IpV4"},
-            {0x8100, "Vlan"},
-            {0x86dd, "IpV6"},
-            {0x8035, "RevArp"},
-    };
-    std::map<uint8_t, std::string> ipProtocolTable{
-            {pcpp::PACKETPP_IPPROTO_TCP,      "TCP"},
-            {pcpp::PACKETPP_IPPROTO_EGP,      "EGP"},
-            {pcpp::PACKETPP_IPPROTO_ICMP,     "ICMP"},
-            {pcpp::PACKETPP_IPPROTO_ICMPV6,   "ICMPV6"},
-            {pcpp::PACKETPP_IPPROTO_FRAGMENT, "FRAGMENT"},
-            {pcpp::PACKETPP_IPPROTO_UDP,      "UDP"},
-            {pcpp::PACKETPP_IPPROTO_GRE,      "GRE"},
-    };
-    if (debug) SPDLOG_INFO("P {}", p);
-    if (p == pcpp::Ethernet) {
-        auto *ethLayer = dynamic_cast<pcpp::EthLayer *>(pkt.getLayerOfType(pcpp::Ethernet));
-        if (ethLayer != nullptr) {
-            pcpp::ether_header *eh = ethLayer->getEthHeader();
-            uint16_t et = pcpp::hostToNet16(eh->etherType);
-            std::string ets{};
-            try {
-                ets = "(" + etherTypeTable[et] + ")";
-            }
-            catch (...) {
-                if (debug) SPDLOG_INFO("Unknown EtherType: {}", et);
-                ets = "";
-            }
-            std::string s = fmt::format("ethType:{:#04X}{}", et, ets);
-            if (debug) SPDLOG_INFO("S {}", s);
-            pl[s].debug = debug;
-            pl[s].updateCounters(pkt);
-        }
-
-        auto *ip = dynamic_cast<pcpp::IPv4Layer *>(pkt.getLayerOfType(pcpp::IPv4));
-        if (ip != nullptr) {
-            pcpp::iphdr *iph = ip->getIPv4Header();
-            std::string pts{};
-            try {
-                pts = "(" + ipProtocolTable[(iph->protocol)] + ")";
-            }
-            catch (...) {
-                if (debug) SPDLOG_INFO("Unknown IP  Protocol {}", iph->protocol);
-                pts = "";
-            }
-            std::string s = fmt::format("IpProt:{}{}", iph->protocol, pts);
-            if (debug) SPDLOG_INFO("S {}", s);
-            pl[s].debug = debug;
-            pl[s].updateCounters(pkt);
-        }
-    }
-
+unsigned stagesForReport(const std::string &reportType) {
+    if (reportType == "prot") return protocolStage;
+    if (reportType == "eth") return ethernetStage;
+    if (reportType == "hp") return hostPairStage;
+    if (reportType == "tcp") return tcpStage;
+    return allStages;
 }
 
 /**
@@ -370,38 +271,177 @@ processProtocol(const pcpp::Packet &pkt, pcpp::ProtocolType p, std::map<std::str
  * @callgraph
  * @callergraph
  * @param pkt                   Parsed PCPP Packet
- * @param hostPairList          Map of HostPair instances
- * @param tcpConversationList   Map of TCPConversation instances
+ * @param tables                Statistics tables to update
  */
-void parser(pcpp::Packet &pkt, std::map<std::string, HostPair> &hostPairList,
-            std::map<std::string, TCPConversation> &tcpConversationList,
-            std::map<std::string, EthernetStats> &ethernetStatsList,
-            std::map<std::string, ProtocolStats> &pl,
-            int pc, bool debug) {
+void parser(pcpp::Packet &pkt, StatsTables &tables, int pc, bool debug) {
+    /**
+     * ### Decode the headers once. Every stage below reads the view instead of the packet layers.
+     */
+    PacketView view(pkt, pc);
+
+    if (tables.limits.enabled()) {
+        tables.age(view.tsNs);
+    }
 
     pcpp::Layer *hdr{pkt.getFirstLayer()};
     pcpp::ProtocolType protocol{hdr->getProtocol()};
-    processProtocol(pkt, protocol, pl, debug);
+    if (tables.stages & protocolStage) processProtocol(view, protocol, tables.protocolStatsList, debug);
     if (protocol == pcpp::Ethernet) {
         if (debug) SPDLOG_INFO("Protocol {}", protocol);
-        processEthernet(pkt, ethernetStatsList, debug);
+        if (tables.stages & ethernetStage) processEthernet(view, tables, debug);
+        /*
+         * Only the host pair and TCP tables read the IP layer. Without them the packet may be parsed no further than
+         * Ethernet and has no next layer.
+         */
         pcpp::Layer *ipHdr{hdr->getNextLayer()};
-        switch (ipHdr->getProtocol()) {
+        if (ipHdr != nullptr && (tables.stages & (hostPairStage | tcpStage))) {
+            switch (ipHdr->getProtocol()) {
+
+                case pcpp::IPv4: {
+                    processIpPacket(view, tables, debug);
+                    break;
+                }
+
+                case pcpp::VLAN: {
+                    break;
+                }
+
+                default: {
+                    if (debug) SPDLOG_INFO("Protocol {} is not handled", (ipHdr->getProtocol()));
+                    break;
+                }
+            } //endSwitch
+        }
+    }// endif
+    if (Profiler::enabled) {
+        tables.peaks.update(tables.hostPairList.size(), tables.tcpConversationList.size(),
+                            tables.ethernetStatsList.size());
+    }
+}//endFunc
 
-            case pcpp::IPv4: {
-                processIpPacket(pkt, ipHdr, hostPairList, tcpConversationList, pc, debug);
-                break;
+/**
+ * Merge the tables of another StatsTables instance into this one. The other instance is left empty.
+ * @callgraph
+ * @callergraph
+ * @param other                 Tables of a pipeline worker
+ *
+ * The pipeline shards packets by host pair, so host pairs and TCP conversations are only ever seen by one worker
+ * and are moved across. An entry found in both is merged all the same. Ethernet and protocol entries are shared by
+ * many host pairs and their counters are merged.
+ */
+void StatsTables::merge(StatsTables &other) {
+    bool lru = limits.enabled();
+    for (auto &[key, value]: other.hostPairList) {
+        auto [it, inserted] = hostPairList.try_emplace(key, std::move(value));
+        if (!inserted) it->second.merge(value);
+        else if (lru) it->second.lru = hostPairLru.insert(hostPairLru.end(), key);
+    }
+    for (auto &[key, value]: other.tcpConversationList) {
+        auto [it, inserted] = tcpConversationList.try_emplace(key, std::move(value));
+        if (!inserted) {
+            if (it->second.debug) {
+                SPDLOG_INFO("TCP conversation {} seen by more than one worker", it->second.label(key));
             }
+            it->second.merge(value);
+        } else if (lru) {
+            // A conversation closed in the worker stays on the close wait list
+            std::list<FlowKey> &list{it->second.closing ? tcpClosedLru : tcpLru};
+            it->second.lru = list.insert(list.end(), key);
+        }
+    }
+    for (auto &[key, value]: other.ethernetStatsList) {
+        auto [it, inserted] = ethernetStatsList.try_emplace(key, value);
+        if (!inserted) it->second.merge(value);
+        else if (lru) it->second.lru = ethernetLru.insert(ethernetLru.end(), key);
+    }
+    protocolStatsList.merge(other.protocolStatsList);
+    other.hostPairList.clear();
+    other.tcpConversationList.clear();
+    other.ethernetStatsList.clear();
+    other.protocolStatsList.clear();
+    other.hostPairLru.clear();
+    other.tcpLru.clear();
+    other.tcpClosedLru.clear();
+    other.ethernetLru.clear();
+    evicted += other.evicted;
+    other.evicted = 0;
+    peaks.add(other.peaks);
+    other.peaks = {};
+}
 
-            case pcpp::VLAN: {
-                break;
-            }
+/**
+ * Evict the entries that have timed out
+ * @callgraph
+ * @callergraph
+ * @param now                   Current time. The packet time when reading a file, the clock when live.
+ *
+ * Only the front of each LRU list has to be checked: the entries behind it have seen a packet more recently.
+ */
+void StatsTables::age(TimestampNs now) {
+    auto idleTimeout = static_cast<TimestampNs>(limits.idleTimeout * nsPerSecond);
+    auto closeWait = static_cast<TimestampNs>((limits.closeWait > 0 ? limits.closeWait : limits.idleTimeout) *
+                                              nsPerSecond);
+    if (idleTimeout > 0) {
+        while (!hostPairLru.empty()) {
+            HostPair &hp = hostPairList.at(hostPairLru.front());
+            if (now - hp.lastSeen() <= idleTimeout) break;
+            evict(hostPairLru.front(), hp);
+        }
+        while (!tcpLru.empty()) {
+            TCPConversation &tcpc = tcpConversationList.at(tcpLru.front());
+            if (now - tcpc.lastSeen() <= idleTimeout) break;
+            evict(tcpLru.front(), tcpc);
+        }
+        while (limits.macPairs && !ethernetLru.empty()) {
+            EthernetStats &es = ethernetStatsList.at(ethernetLru.front());
+            if (now - es.lastSeen() <= idleTimeout) break;
+            evict(ethernetLru.front(), es);
+        }
+    }
+    if (closeWait > 0) {
+        while (!tcpClosedLru.empty()) {
+            TCPConversation &tcpc = tcpConversationList.at(tcpClosedLru.front());
+            if (now - tcpc.lastSeen() <= closeWait) break;
+            evict(tcpClosedLru.front(), tcpc);
+        }
+    }
+}
 
-            default: {
-                if (debug) SPDLOG_INFO("Protocol {} is not handled", (ipHdr->getProtocol()));
-                break;
-            }
-        } //endSwitch
-    }// endif
-}//endFunc
+/**
+ * Write a host pair to the sink and remove it from the table
+ * @callgraph
+ * @callergraph
+ */
+void StatsTables::evict(const FlowKey &key, HostPair &hp) {
+    FlowKey k{key};     // key may refer to the LRU node being erased
+    if (sink != nullptr) sink->write(k, hp);
+    hostPairLru.erase(hp.lru);
+    hostPairList.erase(k);
+    evicted++;
+}
 
+/**
+ * Finalize a TCP conversation, write it to the sink and remove it from the table
+ * @callgraph
+ * @callergraph
+ */
+void StatsTables::evict(const FlowKey &key, TCPConversation &tcpc) {
+    FlowKey k{key};
+    if (sink != nullptr) sink->write(k, tcpc);
+    (tcpc.closing ? tcpClosedLru : tcpLru).erase(tcpc.lru);
+    tcpConversationList.erase(k);
+    evicted++;
+}
+
+/**
+ * Write a MAC pair to the sink and remove it from the table
+ * @callgraph
+ * @callergraph
+ */
+void StatsTables::evict(const MacPairKey &key, EthernetStats &es) {
+    MacPairKey k{key};
+    if (sink != nullptr) sink->write(k, es);
+    ethernetLru.erase(es.lru);
+    ethernetStatsList.erase(k);
+    evicted++;
+}
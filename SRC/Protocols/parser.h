@@ -19,42 +19,111 @@
 #include "HostPair.h"
 #include "EthernetStats.h"
 #include "ProtocolStats.h"
+#include "PacketView.h"
+#include "../Profile/Profiler.h"
+#include <list>
 
-void parser(pcpp::Packet &pkt, std::map<std::string, HostPair> &hostPairList,
-            std::map<std::string, TCPConversation> &tcpConversationList,
-            std::map<std::string, EthernetStats> &ethernetStatsList,
-            std::map<std::string, ProtocolStats> &pl,
-            int pc,
-            bool debug
-);
+class FlowSink;
 
-static std::string getIPMapInstance(const pcpp::Packet &pkt,
-                                    std::map<std::string,
-                                            HostPair> &hostPairList,
-                                    bool debug);
-
-static int processTcpPacket(const pcpp::Packet &pkt,
-                            pcpp::IPv4Layer *ipHdr,
-                            std::map<std::string, TCPConversation> &tcpl,
-                            std::map<std::string, HostPair> &hostPairList,
-                            bool debug,
-                            int pc
-);
+/**
+ * @brief Statistics engines run by parser()
+ *
+ * The mask is computed once from the requested reports. An engine that is not in the mask is skipped for every
+ * packet, including its table lookup, and its table stays empty.
+ */
+enum ParseStage : unsigned {
+    protocolStage = 1u << 0,    ///< ProtocolStatsTable
+    ethernetStage = 1u << 1,    ///< Ethernet statistics table
+    hostPairStage = 1u << 2,    ///< Host pair table
+    tcpStage = 1u << 3,         ///< TCP conversation table
+    allStages = protocolStage | ethernetStage | hostPairStage | tcpStage
+};
+
+unsigned stagesForReport(const std::string &reportType);
+
+/**
+ * @brief Limits on the host pair, TCP conversation and MAC pair tables
+ *
+ * Entries that hit a limit are evicted: written to the FlowSink and removed from their table. All limits are off by
+ * default, which keeps every entry until the reports are generated.
+ */
+struct FlowLimits {
+    long double idleTimeout{0.0L};  ///< Evict entries with no packet for this many seconds. 0 = never
+    long double closeWait{0.0L};    ///< Evict TCP conversations this many seconds after FIN/RST. 0 = never
+    size_t maxFlows{0};             ///< Maximum entries per table. The least recently used entry is evicted. 0 = no limit
+    bool macPairs{true};            ///< Also evict MAC pairs. Off in the workers of a pipeline, see runPipeline
+
+    [[nodiscard]] bool enabled() const {
+        return idleTimeout > 0 || closeWait > 0 || maxFlows > 0;
+    }
+};
+
+/**
+ * @brief The four statistics tables filled by the parser
+ *
+ * Each worker thread of the pipeline owns one instance. The instances are merged before the reports are generated.
+ *
+ * When flow limits are set, the entries of the host pair, TCP conversation and MAC pair tables are also kept in
+ * least recently used order. Each entry holds its position in the LRU list, so a packet moves its entries to the
+ * back of the lists in constant time and idle entries are found at the front. Closed TCP conversations are moved to
+ * a separate list so they can age out on the shorter close wait.
+ */
+struct StatsTables {
+    HostPairTable hostPairList;
+    TcpConversationTable tcpConversationList;
+    EthernetStatsTable ethernetStatsList;
+    ProtocolStatsTable protocolStatsList;
 
-static void processIpPacket(const pcpp::Packet &pkt,
-                            pcpp::Layer *ipHdr,
-                            std::map<std::string, HostPair> &hostPairList,
-                            std::map<std::string, TCPConversation> &tcpl,
-                            int pc,
+    unsigned stages{allStages};     ///< ParseStage mask of the engines to run
+    FlowLimits limits;
+    FlowSink *sink{nullptr};        ///< Receives evicted entries. Evicted entries are dropped when not set
+    std::list<FlowKey> hostPairLru;
+    std::list<FlowKey> tcpLru;
+    std::list<FlowKey> tcpClosedLru;
+    std::list<MacPairKey> ethernetLru;
+    size_t evicted{0};
+    TablePeaks peaks;               ///< Peak table sizes, recorded with --profile
+
+    void merge(StatsTables &other);
+
+    void age(TimestampNs now);
+
+    void evict(const FlowKey &key, HostPair &hp);
+
+    void evict(const FlowKey &key, TCPConversation &tcpc);
+
+    void evict(const MacPairKey &key, EthernetStats &es);
+
+    /**
+     * @brief Move an entry to the back of its LRU list, or add it if it is new
+     */
+    template<typename K>
+    static void touch(std::list<K> &lru, typename std::list<K>::iterator &pos, const K &key, bool inserted) {
+        if (inserted) pos = lru.insert(lru.end(), key);
+        else lru.splice(lru.end(), lru, pos);
+    }
+};
+
+void parser(pcpp::Packet &pkt, StatsTables &tables, int pc, bool debug);
+
+static HostPair &getIPMapInstance(const PacketView &view,
+                                  StatsTables &tables,
+                                  bool debug);
+
+static int processTcpPacket(const PacketView &view,
+                            StatsTables &tables,
                             bool debug
 );
 
-static std::vector<std::string> getMacAddress(pcpp::Packet &pkt, bool debug);
+static void processIpPacket(const PacketView &view,
+                            StatsTables &tables,
+                            bool debug
+);
 
 void
-processProtocol(const pcpp::Packet &pkt, pcpp::ProtocolType p, std::map<std::string, ProtocolStats> &pl, bool debug);
+processProtocol(const PacketView &view, pcpp::ProtocolType p, ProtocolStatsTable &pl, bool debug);
 
-void processEthernet(pcpp::Packet &pkt, std::map<std::string, EthernetStats> &ethernetStatsList, bool debug);
+void processEthernet(const PacketView &view, StatsTables &tables, bool debug);
 
 
 #endif //MACPCAP_PARSER_H
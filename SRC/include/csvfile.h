@@ -1,12 +1,32 @@
 //
 // Created by Scott Roberts on 4/20/23.
 //
+/**
+ * @file
+ * @brief Buffered Table File Writer
+ *
+ * Writes the report tables as CSV, TSV or JSON lines through one API. Fields are formatted with fmt::format_to into
+ * a reusable buffer that is written to the file in large blocks, so no row flushes the stream and numbers are never
+ * converted to intermediate strings. Strings are scanned once and copied whole when they need no escaping.
+ *
+ * - csv    Strings are quoted and embedded quotes doubled. Numbers are written bare.
+ * - tsv    Fields are written bare. Tab, newline, carriage return and backslash are written as \t, \n, \r and \\.
+ * - jsonl  The first row is the header and gives the keys. Every following row is written as one JSON object.
+ * - arrow  Arrow IPC file. The first row gives the column names and the rows are collected as typed columns
+ *          (see ColumnTable.h) that are written as a record batch every ColumnFileWriter::batchRows rows.
+ * - parquet    Parquet file, collected the same way as arrow and written as row groups.
+ */
 #pragma once
 
+#include <cmath>
+#include <concepts>
 #include <string>
-#include <iostream>
+#include <string_view>
+#include <vector>
 #include <fstream>
-#include <sstream>
+#include <memory>
+#include <fmt/format.h>
+#include "../Export/ColumnTable.h"
 
 class csvfile;
 
@@ -14,31 +34,127 @@ inline static csvfile &endrow(csvfile &file);
 
 inline static csvfile &flush(csvfile &file);
 
+enum class TableFormat {
+    csv, tsv, jsonl, arrow, parquet
+};
+
+/**
+ * @brief A floating point field written with a fixed number of decimal places
+ */
+struct Decimal {
+    double value;
+    int places;
+};
+
 class csvfile {
-    std::ofstream fs_;
-    bool is_first_;
-    const std::string separator_;
-    const std::string escape_seq_;
-    const std::string special_chars_;
 public:
-    csvfile(const std::string filename, const std::string separator = ",")
-            : fs_(), is_first_(true), separator_(separator), escape_seq_("\""), special_chars_("\"") {
+    /**
+     * Format of the files opened without an explicit format. Set once from the command line.
+     */
+    static inline TableFormat format{TableFormat::csv};
+
+    /**
+     * Prepended to the name of every file opened. Set while the reports of one of several filters are written.
+     */
+    static inline std::string prefix{};
+
+    /**
+     * @param name      File name without extension. The prefix is prepended and the extension of the format appended.
+     * @param fmt       Output format
+     * @throws std::ios_base::failure if the file can not be opened or written
+     */
+    explicit csvfile(const std::string &name, TableFormat fmt = format) : format_(fmt),
+                                                                           path_(prefix + name + extension(fmt)) {
+        if (fmt == TableFormat::arrow || fmt == TableFormat::parquet) {
+            table_ = std::make_unique<ColumnTable>();
+            writer_ = std::make_unique<ColumnFileWriter>(path_, fmt == TableFormat::parquet);
+            return;
+        }
         fs_.exceptions(std::ios::failbit | std::ios::badbit);
-        fs_.open(filename);
+        fs_.open(path_, std::ios::binary | std::ios::trunc);
+        buf_.reserve(blockSize + blockSize / 4);
     }
 
     ~csvfile() {
+        try {
+            close();
+        }
+        catch (const std::exception &e) {
+            fmt::print(stderr, "Could not write {}: {}\n", path_, e.what());
+        }
+    }
+
+    csvfile(const csvfile &) = delete;
+
+    csvfile &operator=(const csvfile &) = delete;
+
+    /**
+     * @return  File name extension of a format, including the dot
+     */
+    static const char *extension(TableFormat fmt) {
+        switch (fmt) {
+            case TableFormat::tsv:
+                return ".tsv";
+            case TableFormat::jsonl:
+                return ".jsonl";
+            case TableFormat::arrow:
+                return ".arrow";
+            case TableFormat::parquet:
+                return ".parquet";
+            default:
+                return ".csv";
+        }
+    }
+
+    /**
+     * @brief Write the buffered rows, or the last batch of a columnar file, and close the file
+     * @throws std::exception if the file can not be written
+     */
+    void close() {
+        if (closed_) return;
+        closed_ = true;
+        if (table_) {
+            if (table_->rows() != 0 || !batchWritten_) writeBatch();
+            writer_->close();
+            return;
+        }
         flush();
         fs_.close();
     }
 
+    /**
+     * @brief Write the buffered rows. Columnar files are written a batch at a time by endrow() and close().
+     */
     void flush() {
+        if (table_) return;
+        if (buf_.size() != 0) fs_.write(buf_.data(), static_cast<std::streamsize>(buf_.size()));
+        buf_.clear();
         fs_.flush();
     }
 
     void endrow() {
-        fs_ << std::endl;
-        is_first_ = true;
+        if (inHeader()) {
+            if (table_) table_->setNames(header_);
+            else keys_ = std::move(header_);
+            header_.clear();
+            headerDone_ = true;
+            field_ = 0;
+            return;
+        }
+        if (table_) {
+            table_->endrow();
+            if (table_->rows() >= ColumnFileWriter::batchRows) writeBatch();
+            return;
+        }
+        if (format_ == TableFormat::jsonl) {
+            buf_.append(field_ == 0 ? std::string_view("{}") : std::string_view("}"));
+        }
+        buf_.push_back('\n');
+        field_ = 0;
+        if (buf_.size() >= blockSize) {
+            fs_.write(buf_.data(), static_cast<std::streamsize>(buf_.size()));
+            buf_.clear();
+        }
     }
 
     csvfile &operator<<(csvfile &(*val)(csvfile &)) {
@@ -46,41 +162,177 @@ public:
     }
 
     csvfile &operator<<(const char *val) {
-        return write(escape(val));
+        return text(std::string_view(val));
     }
 
     csvfile &operator<<(const std::string &val) {
-        return write(escape(val));
+        return text(val);
+    }
+
+    csvfile &operator<<(std::string_view val) {
+        return text(val);
+    }
+
+    template<std::integral T>
+    csvfile &operator<<(T val) {
+        if (!number()) return *this;
+        if (table_) table_->add(static_cast<int64_t>(val));
+        else fmt::format_to(std::back_inserter(buf_), "{}", val);
+        return *this;
     }
 
-    template<typename T>
-    csvfile &operator<<(const T &val) {
-        return write(val);
+    /**
+     * Written with six decimal places, the same as std::to_string
+     */
+    csvfile &operator<<(double val) {
+        return *this << Decimal{val, 6};
+    }
+
+    csvfile &operator<<(Decimal val) {
+        if (!number()) return *this;
+        if (table_) table_->add(val.value);
+        else if (format_ == TableFormat::jsonl && !std::isfinite(val.value)) buf_.append(std::string_view("null"));
+        else fmt::format_to(std::back_inserter(buf_), "{:.{}f}", val.value, val.places);
+        return *this;
     }
 
 private:
-    template<typename T>
-    csvfile &write(const T &val) {
-        if (!is_first_) {
-            fs_ << separator_;
-        } else {
-            is_first_ = false;
+    static constexpr size_t blockSize{1 << 20};
+
+    std::ofstream fs_;
+    TableFormat format_;
+    std::string path_;
+    std::unique_ptr<ColumnTable> table_;    ///< Columns of the batch of an arrow or parquet file being collected
+    std::unique_ptr<ColumnFileWriter> writer_;
+    bool batchWritten_{false};
+    fmt::memory_buffer buf_;
+    size_t field_{0};
+    bool headerDone_{false};
+    bool closed_{false};
+    std::vector<std::string> keys_;     ///< JSON keys, from the header row
+    std::vector<std::string> header_;   ///< Header row being collected for the JSON keys or the column names
+
+    /**
+     * @return  true while the first row is collected as names instead of written
+     */
+    [[nodiscard]] bool inHeader() const {
+        return !headerDone_ && (table_ || format_ == TableFormat::jsonl);
+    }
+
+    /**
+     * @brief Write the collected rows of a columnar file as one batch and drop them
+     */
+    void writeBatch() {
+        writer_->write(*table_);
+        table_->clear();
+        batchWritten_ = true;
+    }
+
+    /**
+     * @brief Start the next field of the row
+     * @return  false if the field is collected as a JSON key instead of written
+     */
+    bool next() {
+        if (inHeader()) return false;
+        if (table_) return true;
+        if (format_ == TableFormat::jsonl) {
+            buf_.push_back(field_ == 0 ? '{' : ',');
+            std::string_view key{field_ < keys_.size() ? std::string_view(keys_[field_]) : std::string_view()};
+            if (key.empty()) fmt::format_to(std::back_inserter(buf_), "\"{}\":", field_);
+            else {
+                jsonString(key);
+                buf_.push_back(':');
+            }
+        } else if (field_ != 0) {
+            buf_.push_back(format_ == TableFormat::tsv ? '\t' : ',');
+        }
+        field_++;
+        return true;
+    }
+
+    bool number() {
+        if (next()) return true;
+        header_.emplace_back();
+        return false;
+    }
+
+    csvfile &text(std::string_view val) {
+        if (!next()) {
+            header_.emplace_back(val);
+            return *this;
+        }
+        switch (format_) {
+            case TableFormat::arrow:
+            case TableFormat::parquet:
+                table_->add(val);
+                break;
+            case TableFormat::csv:
+                csvString(val);
+                break;
+            case TableFormat::tsv:
+                tsvString(val);
+                break;
+            case TableFormat::jsonl:
+                jsonString(val);
+                break;
         }
-        fs_ << val;
         return *this;
     }
 
-    std::string escape(const std::string &val) {
-        std::ostringstream result;
-        result << '"';
-        std::string::size_type to, from = 0u, len = val.length();
-        while (from < len &&
-               std::string::npos != (to = val.find_first_of(special_chars_, from))) {
-            result << val.substr(from, to - from) << escape_seq_ << val[to];
+    /**
+     * @brief Copy the runs between the characters that need escaping whole
+     * @param special   Characters that need escaping
+     * @param escape    Appends the escaped form of one special character
+     */
+    template<typename Escape>
+    void escaped(std::string_view val, std::string_view special, Escape escape) {
+        size_t from{0};
+        for (size_t to = val.find_first_of(special); to != std::string_view::npos;
+             to = val.find_first_of(special, from)) {
+            buf_.append(val.substr(from, to - from));
+            escape(val[to]);
             from = to + 1;
         }
-        result << val.substr(from) << '"';
-        return result.str();
+        buf_.append(val.substr(from));
+    }
+
+    void csvString(std::string_view val) {
+        buf_.push_back('"');
+        escaped(val, "\"", [this](char) { buf_.append(std::string_view("\"\"")); });
+        buf_.push_back('"');
+    }
+
+    void tsvString(std::string_view val) {
+        escaped(val, std::string_view("\t\n\r\\"), [this](char c) {
+            buf_.push_back('\\');
+            buf_.push_back(c == '\t' ? 't' : c == '\n' ? 'n' : c == '\r' ? 'r' : '\\');
+        });
+    }
+
+    void jsonString(std::string_view val) {
+        static constexpr std::string_view special{
+                "\"\\\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+                "\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f", 34};
+        buf_.push_back('"');
+        escaped(val, special, [this](char c) {
+            switch (c) {
+                case '"':
+                    buf_.append(std::string_view("\\\""));
+                    break;
+                case '\\':
+                    buf_.append(std::string_view("\\\\"));
+                    break;
+                case '\n':
+                    buf_.append(std::string_view("\\n"));
+                    break;
+                case '\t':
+                    buf_.append(std::string_view("\\t"));
+                    break;
+                default:
+                    fmt::format_to(std::back_inserter(buf_), "\\u{:04x}", static_cast<unsigned>(c));
+            }
+        });
+        buf_.push_back('"');
     }
 };
 
@@ -93,4 +345,4 @@ inline static csvfile &endrow(csvfile &file) {
 inline static csvfile &flush(csvfile &file) {
     file.flush();
     return file;
-}
\ No newline at end of file
+}
@@ -16,15 +16,47 @@
  *  - macpcap --filename pcapfile.pcap
  *        - Displays all statistics table for the trace file pcapfile.pcap
  *  - nacpcap --filename file.pcap --report tcp --sorttcp packcount
- *        - Displays just the statistics table for TCP conversations and sorts it based on the table header packetcount
+ *        - Displays just the statistics table for TCP conversations and sorts it based on the table header packetcount.
+ *          Only the tables of the requested report are collected.
+ *  - macpcap --filename file.pcap --report tcp --sorttcp bytecount --top 20
+ *        - Displays the 20 TCP conversations with the most bytes
  *  - macpcap --filename file.pcap --list 192.168.42.4:58018-54.144.73.197:443
  *        - filters the capture on the supplied socket and then does the following:
  *            - Display a list of the packets on the trace file
  *            - displays the stgit push
  *            atistics for the filtered packets, that is the TCP conversation specified
  *        - Note: the filter options is ignored of the list options is used.
+ *   - macpcap --filename lb.pcap --list 10.1.0.20/32 --list 192.168.42.4:58018-54.144.73.197:443
+ *        - Lists every flow of the VIP 10.1.0.20 and the socket in one pass, each flow to its own List_*.txt file.
+ *          A --list value can also be a host pair x.x.x.x-y.y.y.y
  *   - mackpcap --filename file.pcap --filter bpf:tcp
  *        - Filters out all packets that do not have a TCP header. The text after the : in bpf: can be any Berkley Packet Filter syntax.
+ *   - macpcap --filename big.pcap --filter port:443
+ *        - The ip:, hp:, port:, socket:, mac: and common prot: filters are tested on the raw frame bytes instead of
+ *          with a libpcap BPF program
+ *   - macpcap --filename big.pcap --filter socket:10.0.0.1:5000-10.0.0.2:443 --filter hp:10.0.0.3-10.0.0.4
+ *        - Reads big.pcap once and produces one report per filter. The report files are prefixed Filter1, Filter2...
+ *          --filters file reads the filters from a file, one per line
+ *   - macpcap --filename file.pcap --threads 8
+ *        - Reads the file on one thread and parses the packets on 8 worker threads. Packets are sharded by host pair.
+ *   - macpcap --interface eth0 --interval 10 --idle 60
+ *        - Captures on eth0, prints the reports every 10 seconds and evicts entries idle for more than 60 seconds
+ *   - macpcap --filename day.pcap --idle 120 --closewait 5 --maxflows 100000
+ *        - Bounds the flow tables. Evicted entries are written to the Evicted*.csv files as they are evicted
+ *   - macpcap --filename file.pcap --profile
+ *        - Prints the calls and time of each processing stage and the peak table sizes after the reports
+ *   - macpcap --filename file.pcap --reportType jsonl
+ *        - Writes the tables as JSON lines files (one object per row). tsv writes tab separated files
+ *   - macpcap --filename file.pcap --reportType parquet
+ *        - Writes the tables as Parquet files with typed columns. arrow writes Arrow IPC files. Needs Apache Arrow
+ *   - macpcap --filename file.pcap --index
+ *        - Also writes the flow index file.pcap.flowidx. Later --list and --filter socket: runs on file.pcap read
+ *          only the packets of the socket
+ *   - macpcap --filename day.pcap --start "2023-04-20 10:15:00" --end +30
+ *        - Analyzes only the packets from 10:15:00 until 30 seconds after the first packet. The timestamp index
+ *          day.pcap.tsidx is built on first use and lets later runs seek straight to the window
+ *   - macpcap --filename file.pcap --nommap
+ *        - Reads the file with the PcapPlusPlus reader instead of the memory mapped reader
  *
  * \section Author Experience
  * I retired from a large retailer as a lead network engineer five years ago. I have worked in the network troubleshooting business for 45 years.
@@ -119,10 +151,14 @@
 #include <IPv4Layer.h>
 #include <Packet.h>
 #include <PcapFileDevice.h>
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <fstream>
 #include <fmt/format.h>
 #include <iostream>
 #include <regex>
+#include <unordered_map>
 #include <string>
 #include "Protocols/parser.h"
 #include "Protocols/EthernetStats.h"
@@ -132,6 +168,15 @@
 #include <boost/program_options.hpp>
 #include "../myColor.h"
 #include "Protocols/ProtocolStats.h"
+#include "Pipeline/Pipeline.h"
+#include "Capture/PacketSource.h"
+#include "Capture/LiveCapture.h"
+#include "Capture/FlowIndex.h"
+#include "Capture/TimeIndex.h"
+#include "Capture/FramePredicate.h"
+#include "Capture/MappedPcapReader.h"
+#include "Protocols/FlowSink.h"
+#include "Profile/Profiler.h"
 #include <PcapFilter.h>
 #include <PcapPlusPlusVersion.h>
 #include "SystemUtils.h"
@@ -147,33 +192,51 @@ std::string softwareVersion = "1.1.0";
  * @callergraph
  * @callgraph
  * @brief hexdump
- * Function to dump out a raw packet in hex and ascii formats
+ * Function to dump out a raw packet in hex and ascii formats. Each row of 16 bytes is built from a lookup table in a
+ * fixed size buffer and appended to the output in one piece.
  * @param data         - This is a uint8_t pointer ti the raw packets data
  * @param dataLength   - This is the length of the buffer
- * @return             - string containing the hex dump output
+ * @param out          - Receives the hex dump output
  */
-std::string hexdump(const uint8_t *data, int dataLength) {
-    std::string line{};
-    std::string al{};
-    std::string results{};
-    uint8_t c;
-
-    for (size_t i = 0; i < dataLength; ++i) {
-        if ((i % 16) == 0) {
-            al.append("\n");
-            results.append(line.append("  " + al));
-            line = fmt::format("     {:>5d}: ", i);
-            al = {};
-        }
-        c = data[i];
-        line.append(fmt::format("{:02x} ", c));
-        if (std::isprint(c)) {
-            al.append(fmt::format("{:1c}", c));
-        } else {
-            al.append(".");
+void hexdump(const uint8_t *data, int dataLength, fmt::memory_buffer &out) {
+    static constexpr char hexDigits[] = "0123456789abcdef";
+    constexpr size_t rowBytes{16};
+    constexpr size_t asciiColumn{rowBytes * 3 + 2};
+    char row[asciiColumn + rowBytes + 1];
+
+    out.push_back('\n');
+    auto len = static_cast<size_t>(dataLength);
+    for (size_t i = 0; i < len; i += rowBytes) {
+        size_t n{std::min(rowBytes, len - i)};
+        std::fill(row, row + asciiColumn, ' ');
+        for (size_t j = 0; j < n; j++) {
+            uint8_t c{data[i + j]};
+            row[j * 3] = hexDigits[c >> 4];
+            row[j * 3 + 1] = hexDigits[c & 0x0f];
+            row[asciiColumn + j] = c >= 0x20 && c < 0x7f ? static_cast<char>(c) : '.';
         }
+        row[asciiColumn + n] = '\n';
+        fmt::format_to(std::back_inserter(out), "     {:>5d}: ", i);
+        out.append(row, row + asciiColumn + n + 1);
+    }
+}
+
+/**
+ * @brief Append the local time of a packet, strftime %c and the nanoseconds. The text of the second is cached, as the
+ * packets of a listing mostly share their second with the packet before.
+ */
+void packetTime(const timespec &ts, fmt::memory_buffer &out) {
+    static time_t second{-1};
+    static char text[100];
+    static size_t textLen{0};
+    if (ts.tv_sec != second) {
+        std::tm t{};
+        localtime_r(&ts.tv_sec, &t);
+        textLen = std::strftime(text, sizeof(text), "%c", &t);
+        second = ts.tv_sec;
     }
-    return results;
+    out.append(text, text + textLen);
+    fmt::format_to(std::back_inserter(out), ".{:09}", ts.tv_nsec);
 }
 
 /**
@@ -240,6 +303,75 @@ void print(const pcpp::Packet &p, int pc, bool debug) {
     }
 }
 
+/**
+ * @brief Data segments sent in one direction of the listed socket, by the sequence number of their end
+ *
+ * Sequence and acknowledgement numbers are unwrapped to 64 bit positions relative to the first segment, so a
+ * connection that crosses the 32 bit wrap keeps its order. A segment is covered by an acknowledgement number once it
+ * ends at or before it. Responses and ACKs are cumulative, so each keeps a cursor at the newest segment it has covered.
+ * A packet is matched with one lookup of the newest covered segment. Only that segment can be matched by later
+ * packets of either kind, so the segments before it are dropped and the map only holds the segments still in flight.
+ */
+class PendingSegments {
+public:
+    struct Segment {
+        int pc{0};              ///< Packet number
+        TimestampNs ns{0};      ///< Packet time
+    };
+
+    void add(uint32_t seq, size_t length, int pc, TimestampNs ns) {
+        if (!started) {
+            reference = uint64_t{1} << 32 | seq;
+            started = true;
+        }
+        uint64_t begin{unwrap(seq)};
+        reference = std::max(reference, begin);
+        segments[begin + length] = {pc, ns};
+    }
+
+    /**
+     * @brief A data packet with acknowledgement number ack was sent the other way
+     * @return      The newest segment it answers, or nullptr if it answers no segment not already answered
+     */
+    const Segment *respond(uint32_t ack) {
+        return advance(ack, responded);
+    }
+
+    /**
+     * @brief A pure ACK with acknowledgement number ack was sent the other way
+     * @return      The newest segment it acknowledges, or nullptr if every segment up to ack was already acknowledged
+     */
+    const Segment *acknowledge(uint32_t ack) {
+        return advance(ack, acked);
+    }
+
+private:
+    /**
+     * @return      Position of a sequence number, the one nearest to the newest segment sent
+     */
+    [[nodiscard]] uint64_t unwrap(uint32_t seq) const {
+        auto delta = static_cast<int32_t>(seq - static_cast<uint32_t>(reference));
+        return reference + static_cast<uint64_t>(static_cast<int64_t>(delta));
+    }
+
+    const Segment *advance(uint32_t ack, uint64_t &cursor) {
+        if (!started) return nullptr;
+        auto it = segments.upper_bound(unwrap(ack));
+        if (it == segments.begin()) return nullptr;
+        --it;
+        segments.erase(segments.begin(), it);
+        if (it->first <= cursor) return nullptr;
+        cursor = it->first;
+        return &it->second;
+    }
+
+    std::map<uint64_t, Segment> segments;   ///< By the position of the end of the segment
+    uint64_t reference{0};                  ///< Position of the newest segment sent
+    bool started{false};
+    uint64_t responded{0};                  ///< End of the newest segment answered
+    uint64_t acked{0};                      ///< End of the newest segment acknowledged
+};
+
 /**
  * @callgraph
  * @callergraph
@@ -247,34 +379,31 @@ void print(const pcpp::Packet &p, int pc, bool debug) {
  * @param p             - Parsed packet
  * @param ipIdList      - Map used to track IpId for the purpose of checking for retransmitted packets
  * @param pc            - Packet number
- * @param sendSeqList   - Map of send sequence numbers. Key is the sequence number and the value is a vector containing
- *                        packet number, ack flag ( 1 indicates ack processed),timestamp of packet
- * @param recvSeqList   - Map of receive sequence numbers. Key is the sequence number and the value is a vector containing
- *                        packet number, ack flag ( 1 indicates ack processed),timestamp of packet
+ * @param sent          - Data segments sent by the first sender of the socket, waiting for a response or ACK
+ * @param received      - Data segments sent to the first sender of the socket, waiting for a response or ACK
  * @param ls            - Socket string used to determine first sender for response time calculations
+ * @param out           - Receives the listing of the packet
  */
 void pp(pcpp::Packet &p, int pc,
         std::map<uint16_t, int> &ipIdList,
-        std::map<uint32_t, std::vector<long>> &sendSeqList,
-        std::map<uint32_t, std::vector<long>> &recvSeqList,
-        std::string &ls
+        PendingSegments &sent,
+        PendingSegments &received,
+        const std::string &ls,
+        fmt::memory_buffer &out
 ) {
     /*
      * Use raw packet to get timestamp and convert to a local time string
      */
     pcpp::RawPacket *rawPkt = p.getRawPacketReadOnly();
     timespec ts = rawPkt->getPacketTimeStamp();
-    std::tm *t = std::localtime(&ts.tv_sec);
-    char mbstr[100];
-    std::strftime(mbstr, sizeof(mbstr), "%c", t);
-    std::string m{mbstr};
-    m = m + "." + std::to_string(ts.tv_nsec);
+    auto o = std::back_inserter(out);
+    fmt::format_to(o, "Packet: {}    ", pc);
+    packetTime(ts, out);
+    out.push_back('\n');
 
     /*
-     * Loop through and process each layer of the packet
+     * Loop through and process each layer of the packet. Every line is formatted straight into the output buffer.
      */
-    std::string s{fmt::format("Packet: {}    {}\n", pc, m)};
-    std::vector<std::string> v{s};
     std::string sip{};
     std::string dip{};
     for (pcpp::Layer *curLayer = p.getFirstLayer(); curLayer != nullptr; curLayer = curLayer->getNextLayer()) {
@@ -284,13 +413,11 @@ void pp(pcpp::Packet &p, int pc,
              * Process ethernet layer
              */
             case pcpp::Ethernet: {
-                auto *ethLayer = dynamic_cast<pcpp::EthLayer *>(p.getLayerOfType(pcpp::Ethernet));
-                s = fmt::format("{}     Protocol {}  Payload Length {}\n",
-                                curLayer->toString(),
-                                std::to_string(ethLayer->getProtocol()),
-                                std::to_string(ethLayer->getLayerPayloadSize())
+                fmt::format_to(o, "{}     Protocol {}  Payload Length {}\n",
+                               curLayer->toString(),
+                               static_cast<uint64_t>(curLayer->getProtocol()),
+                               curLayer->getLayerPayloadSize()
                 );
-                v.push_back(s);
             }
                 break;
 
@@ -299,11 +426,10 @@ void pp(pcpp::Packet &p, int pc,
                  * data packets with duplicate IPId.
                  */
             case pcpp::IPv4: {
-                auto *ipLayer = dynamic_cast<pcpp::IPv4Layer *>(p.getLayerOfType(pcpp::IPv4));
+                auto *ipLayer = static_cast<pcpp::IPv4Layer *>(curLayer);
                 auto *ipHdr = ipLayer->getIPv4Header();
                 uint16_t ipIdNum{pcpp::hostToNet16(ipHdr->ipId)};
-                //uint16_t payloadLength(pcpp::hostToNet16(ipLayer->getNextLayer()->getLayerPayloadSize()));
-                uint16_t payloadLength(ipLayer->getNextLayer()->getLayerPayloadSize());
+                uint16_t payloadLength(ipLayer->getNextLayer() ? ipLayer->getNextLayer()->getLayerPayloadSize() : 0);
 
                 /*  determine if this is a retransmitted packet. The idea here is that if this is a data packet
                  *  and we have already seen the IPId then it is a retransmission. The only problem with this technique
@@ -312,24 +438,23 @@ void pp(pcpp::Packet &p, int pc,
                  */
 
                 std::string retran{};
-                std::map<uint16_t, int>::iterator i1;
-                i1 = ipIdList.find(ipIdNum);
+                auto i1 = ipIdList.find(ipIdNum);
                 if (i1 == ipIdList.end()) {
                     if (ipIdNum > 0 && payloadLength > 0) ipIdList[ipIdNum] = pc;
                 } else {
-                    retran = fmt::format("Retransmitted packet. Original {}}", ipIdList[ipIdNum]);
+                    retran = fmt::format("Retransmitted packet. Original {}", i1->second);
                 }
 
                 sip = ipLayer->getSrcIPAddress().toString();
                 dip = ipLayer->getDstIPAddress().toString();
-                s = curLayer->toString() + fmt::format("     Protocol {}   PL {}   IPID {}   TTL {}  {}\n",
-                                                       std::to_string(ipLayer->getProtocol()),
-                                                       std::to_string(ipLayer->getLayerPayloadSize()),
-                                                       std::to_string(ipIdNum),
-                                                       std::to_string(ipHdr->timeToLive),
-                                                       retran
+                fmt::format_to(o, "{}     Protocol {}   PL {}   IPID {}   TTL {}  {}\n",
+                               curLayer->toString(),
+                               static_cast<uint64_t>(ipLayer->getProtocol()),
+                               ipLayer->getLayerPayloadSize(),
+                               ipIdNum,
+                               ipHdr->timeToLive,
+                               retran
                 );
-                v.push_back(s);
             }
                 break;
 
@@ -338,98 +463,85 @@ void pp(pcpp::Packet &p, int pc,
                  * sequence and ack numbers. Will also calculate response time and ack time.
                  */
             case pcpp::TCP: {
-                auto *tcpL = dynamic_cast<pcpp::TcpLayer *>(p.getLayerOfType(pcpp::TCP));
+                auto *tcpL = static_cast<pcpp::TcpLayer *>(curLayer);
                 auto *tcpHdr = tcpL->getTcpHeader();
 
                 uint32_t sn{pcpp::netToHost32(tcpHdr->sequenceNumber)};
                 uint32_t an{pcpp::netToHost32(tcpHdr->ackNumber)};
                 uint16_t ws{pcpp::netToHost16(tcpHdr->windowSize)};
                 size_t pl{tcpL->getLayerPayloadSize()};
-                std::string skt =
-                        sip + ":" + std::to_string(tcpL->getSrcPort()) + "-" + dip + ":" +
-                        std::to_string(tcpL->getDstPort());
+                std::string skt{fmt::format("{}:{}-{}:{}", sip, tcpL->getSrcPort(), dip, tcpL->getDstPort())};
                 std::string reqrsp{};
-                std::string dir{">>>"};
                 std::string acks{};
 
-                //
-                if (ls == skt) {
-                    /*
-                     * Process send packet as determined by the socket passed on the list option
-                     */
-                    dir = ">>>";
-                    if (pl > 0) {
-                        long sec{static_cast<long>(ts.tv_sec) * 1000000000 + static_cast<long>(ts.tv_nsec)};
-                        sendSeqList[sn] = {pc, 0, sec};
-                    }
-                    if (!recvSeqList.empty()) {
-                        for (auto [k, v]: recvSeqList) {
-                            long r = static_cast<long>(ts.tv_sec) * 1000000000 + static_cast<long>(ts.tv_nsec);
-                            if (an >= k && pl > 0 && v[1] == 0) {
-                                v[1] = 1;
-                                double rt{(r - v[2]) / 1000000000.0};
-                                reqrsp = fmt::format("RSP to {}   RspTime {}", v[0], rt);
-                            } else {
-                                if (tcpHdr->ackFlag && pl == 0 && an >= k) {
-                                    double ackTime = (r - v[2]) / 1000000000.0;
-                                    acks = fmt::format("ACK for {}  Ack Time {}", v[0], ackTime);
-                                }
-                            }
-                        }
-                    }
-                } else {
-                    /*
-                     * Process a receive packet
-                     */
-                    dir = "<<<";
-                    if (pl > 0) {
-                        long sec{static_cast<long>(ts.tv_sec) * 1000000000 + static_cast<long>(ts.tv_nsec)};
-                        recvSeqList[sn] = {pc, 0, sec};
+                /*
+                 * Packets of the socket passed on the list option are sends, the others receives. A data packet is the
+                 * response to the segments of the other direction it acknowledges, a pure ACK acknowledges them.
+                 */
+                bool send{ls == skt};
+                PendingSegments &own{send ? sent : received};
+                PendingSegments &other{send ? received : sent};
+                TimestampNs now{toNs(ts)};
+                if (pl > 0) {
+                    own.add(sn, pl, pc, now);
+                    if (const PendingSegments::Segment *req = other.respond(an)) {
+                        reqrsp = fmt::format("RSP to {}   RspTime {}", req->pc, nsToSeconds(now - req->ns));
                     }
-                    if (!sendSeqList.empty()) {
-                        for (auto [k, v]: sendSeqList) {
-                            long r = static_cast<long>(ts.tv_sec) * 1000000000 + static_cast<long>(ts.tv_nsec);
-                            if (an >= k && pl > 0 && v[1] == 0) {
-                                v[1] = 1;
-                                double rt{(r - v[2]) / 1000000000.0};
-                                reqrsp = fmt::format("RSP to {}   RspTime {}", v[0], rt);
-                            } else {
-                                if (tcpHdr->ackFlag && pl == 0 && an >= k) {
-                                    double ackTime = (r - v[2]) / 1000000000.0;
-                                    acks = fmt::format("ACK for {}  Ack Time {}", v[0], ackTime);
-                                }
-                            }
-                        }
+                } else if (tcpHdr->ackFlag) {
+                    if (const PendingSegments::Segment *req = other.acknowledge(an)) {
+                        acks = fmt::format("ACK for {}  Ack Time {}", req->pc, nsToSeconds(now - req->ns));
                     }
                 }
 
-                s = dir + curLayer->toString() +
-                    fmt::format("     Protocol {}   PL {}  seq {}   Ack {}    ws {}     {} {}\n",
-                                std::to_string(tcpL->getProtocol()),
-                                std::to_string(pl),
-                                std::to_string(sn),
-                                std::to_string(an),
-                                std::to_string(ws),
-                                reqrsp, acks
-                    );
-                v.push_back(s);
+                fmt::format_to(o, "{}{}     Protocol {}   PL {}  seq {}   Ack {}    ws {}     {} {}\n",
+                               send ? ">>>" : "<<<",
+                               curLayer->toString(),
+                               static_cast<uint64_t>(tcpL->getProtocol()),
+                               pl, sn, an, ws,
+                               reqrsp, acks
+                );
             }
                 break;
 
             default:
-                v.push_back((curLayer->toString() + "\n"));
+                fmt::format_to(o, "{}\n", curLayer->toString());
         }
     }
-    v.push_back(hexdump(rawPkt->getRawData(), rawPkt->getRawDataLen()));
+    hexdump(rawPkt->getRawData(), rawPkt->getRawDataLen(), out);
+    out.push_back('\n');
+}
 
-    /*
-     * The above processing stuffs the results into a vector of strings. Now it's time to display the results
-     */
-    for (auto &l: v) {
-        fmt::print("{}", l);
+/**
+ * @brief Packet listing of one flow of several --list values, written to its own file
+ *
+ * The listing is buffered and appended to the file in blocks, so no file is held open and any number of flows can be
+ * listed in one pass.
+ */
+struct FlowListing {
+    static constexpr size_t flushBytes{1 << 16};
+
+    std::string socket;         ///< sip:sport-dip:dport of the first packet, the send direction of the listing
+    std::string fileName;
+    std::map<uint16_t, int> ipIdList;
+    PendingSegments sent;
+    PendingSegments received;
+    fmt::memory_buffer out;
+    int firstPacket{0};
+    int packets{0};
+    bool started{false};        ///< The file was created
+
+    void flush() {
+        std::FILE *file = std::fopen(fileName.c_str(), started ? "ab" : "wb");
+        if (file == nullptr) {
+            if (!started) fmt::print(stderr, "Could not create {}\n", fileName);
+        } else {
+            std::fwrite(out.data(), 1, out.size(), file);
+            std::fclose(file);
+        }
+        started = true;
+        out.clear();
     }
-    fmt::print("\n");
-}
+};
 
 /**
  * @callgraph
@@ -445,27 +557,29 @@ void pp(pcpp::Packet &p, int pc,
  * @param el         - List of ethernet mac address pairs
  * @param reportType - Used to display a specific report and skip the others
  * @param ss         - sortstring used to sort stats based on a column heading
+ * @param top        - Number of rows of each table to print. 0 prints all rows
  */
-void report(std::map<std::string, HostPair> hpl,
-            std::map<std::string, TCPConversation> tcl,
-            std::map<std::string, std::string> ss,
-            std::map<std::string, EthernetStats> el,
-            std::map<std::string, ProtocolStats> pl,
+void report(const HostPairTable &hpl,
+            const TcpConversationTable &tcl,
+            const std::map<std::string, std::string> &ss,
+            const EthernetStatsTable &el,
+            const ProtocolStatsTable &pl,
             bool debug,
-            const std::string &reportType
+            const std::string &reportType,
+            size_t top
 ) {
 
     if ((reportType == "all" || reportType == "prot") && !pl.empty()) {
-        ProtocolStats::printTable(pl, ss["prot"], debug);
+        ProtocolStats::printTable(pl, ss.at("prot"), top, debug);
     }
     if ((reportType == "all" || reportType == "eth") && !el.empty()) {
-        EthernetStats::printTable(el, ss["eth"], debug);
+        EthernetStats::printTable(el, ss.at("eth"), top, debug);
     }
     if ((reportType == "all" || reportType == "hp") && !hpl.empty()) {
-        HostPair::printTable(hpl, ss["hp"], debug);
+        HostPair::printTable(hpl, ss.at("hp"), top, debug);
     }
     if ((reportType == "all" || reportType == "tcp") && !tcl.empty()) {
-        TCPConversation::printTable(tcl, ss["tcp"], debug);
+        TCPConversation::printTable(tcl, ss.at("tcp"), top, debug);
     }
 }
 
@@ -481,34 +595,157 @@ void report(std::map<std::string, HostPair> hpl,
  * @param el         - List of ethernet mac address pairs
  * @param reportType - Used to display a specific report and skip the others
  * @param ss         - sortstring used to sort stats based on a column heading
+ * @param top        - Number of rows of each table to write. 0 writes all rows
  */
-void writeCsv(std::map<std::string, HostPair> hpl,
-              std::map<std::string, TCPConversation> tcl,
-              std::map<std::string, std::string> ss,
-              std::map<std::string, EthernetStats> el,
-              std::map<std::string, ProtocolStats> pl,
+void writeCsv(const HostPairTable &hpl,
+              const TcpConversationTable &tcl,
+              const std::map<std::string, std::string> &ss,
+              const EthernetStatsTable &el,
+              const ProtocolStatsTable &pl,
               bool debug,
-              const std::string &reportType
+              const std::string &reportType,
+              size_t top
 ) {
 
     std::filesystem::path cwd = std::filesystem::current_path();
-    fmt::print("Creating CSV files to directory {}\n", cwd.string());
+    fmt::print("Creating {} files to directory {}\n", csvfile::extension(csvfile::format) + 1, cwd.string());
 
     if ((reportType == "all" || reportType == "prot") && !pl.empty()) {
-        ProtocolStats::writeCsvTable(pl, ss["prot"], debug);
+        ProtocolStats::writeCsvTable(pl, ss.at("prot"), top, debug);
     }
     if ((reportType == "all" || reportType == "eth") && !el.empty()) {
-        EthernetStats::writeCsvTable(el, ss["eth"], debug);
+        EthernetStats::writeCsvTable(el, ss.at("eth"), top, debug);
     }
     if ((reportType == "all" || reportType == "hp") && !hpl.empty()) {
-        HostPair::writeCsvTable(hpl, ss["hp"], debug);
+        HostPair::writeCsvTable(hpl, ss.at("hp"), top, debug);
     }
     if ((reportType == "all" || reportType == "tcp") && !tcl.empty()) {
-        TCPConversation::writeCsvTable(tcl, ss["tcp"], debug);
+        TCPConversation::writeCsvTable(tcl, ss.at("tcp"), top, debug);
     }
 }
 
 
+/**
+ * @callgraph
+ * @callergraph
+ * @brief Turn a --filter value into a BPF string and, where it can be, a predicate that tests the raw frame
+ *  - ip:x.x.x.x         - filter on IPaddress
+ *  - hp:x.x.x.x-y.y.y.y - filter oon a host pair
+ *  - port:p              - filter on TCP port
+ *  - socket: x.x.x.x:srcport-y.y.y.y:dstport
+ *  - mac:hh-hh-hh-hh-hh-hh
+ *  - prot:tcp|udp...
+ *  - bpf: BOF string - use any of the BPF commands. Put filter at end of command line or enclose in quotes
+ *
+ * @param filter     - Value of --filter
+ * @param bpf        - Receives the BPF string. Left empty when the value is not a filter
+ * @param predicate  - Receives the compiled filter. Left invalid when the filter can only run as BPF
+ * @param socket     - Receives sip, sport, dip and dport of a socket: filter
+ */
+void compileFilter(const std::string &filter, std::string &bpf, FramePredicate &predicate,
+                   std::array<std::string, 4> &socket) {
+    if (filter.starts_with("ip:")) {
+        size_t pos{};
+        std::string s1{}, s2{};
+        std::string delimiter = ":";
+        pos = filter.find(delimiter);
+        s2 = filter.substr(pos + delimiter.length());
+        pcpp::IPFilter gf(s2, pcpp::SRC_OR_DST);
+        gf.parseToString(bpf);
+        predicate = FramePredicate::ipHost(s2);
+    }
+
+    if (filter.starts_with("socket:")) {
+        std::string sip{}, dip{};
+        std::string sport{}, dport{};
+        const std::string &s{filter};
+        std::regex rgx(R"(^.*:(\d+\.\d+\.\d+\.\d+):(\d+)\-(\d+\.\d+\.\d+\.\d+):(\d+))");
+        std::smatch match;
+        if (std::regex_search(s.begin(), s.end(), match, rgx)) {
+            sip = match[1];
+            sport = match[2];
+            dip = match[3];
+            dport = match[4];
+            bpf = fmt::format("port {} and port {} and host {} and host {}", sport, dport, sip, dip);
+            socket = {sip, sport, dip, dport};
+            predicate = FramePredicate::socket(sip, sport, dip, dport);
+        }
+    }
+
+    if (filter.starts_with("hp:")) {
+        std::string sip{}, dip{};
+        const std::string &shp{filter};
+        std::regex rgxhp(R"(^.*:(\d+\.\d+\.\d+\.\d+)\-(\d+\.\d+\.\d+\.\d+))");
+        std::smatch match;
+        if (std::regex_search(shp.begin(), shp.end(), match, rgxhp)) {
+            sip = match[1];
+            dip = match[2];
+            bpf = fmt::format("(host {}) and (host {})", sip, dip);
+            predicate = FramePredicate::hostPair(sip, dip);
+        }
+    }
+
+    if (filter.starts_with("port:")) {
+        std::string port{};
+        const std::string &s{filter};
+        std::regex rgxhp(R"(^.*:(\d+))");
+        std::smatch match;
+        if (std::regex_search(s.begin(), s.end(), match, rgxhp)) {
+            port = match[1];
+            bpf = fmt::format("port {}", port);
+            predicate = FramePredicate::port(port);
+        }
+    }
+
+    if (filter.starts_with("prot:")) {
+        std::string prot{};
+        const std::string &s{filter};
+        std::regex rgxhp(R"(^.*:(.*))");
+        std::smatch match;
+        if (std::regex_search(s.begin(), s.end(), match, rgxhp)) {
+            prot = match[1];
+            bpf = fmt::format("{}", prot);
+            predicate = FramePredicate::protocol(prot);
+        }
+    }
+
+    if (filter.starts_with("mac:")) {
+        std::string mac{};
+        const std::string &s{filter};
+        std::regex rgxhp(R"(^.*:(..:..:..:..:..:..))");
+        std::smatch match;
+        if (std::regex_search(s.begin(), s.end(), match, rgxhp)) {
+            mac = match[1];
+            bpf = fmt::format("ether host {}", mac);
+            predicate = FramePredicate::mac(mac);
+        }
+    }
+
+    if (filter.starts_with("bpf:")) {
+        const std::string &s{filter};
+        std::regex rgxhp(R"(^.*:(.*)$)");
+        std::smatch match;
+        if (std::regex_search(s.begin(), s.end(), match, rgxhp)) {
+            bpf = match[1];
+        }
+    }
+}
+
+/**
+ * @brief Tables and report of one of several --filter values read in the same pass
+ */
+struct FilterReport {
+    FilterReport(std::string text, const FramePredicate &predicate, const std::string &bpf, const std::string &prefix)
+            : text(std::move(text)), prefix(prefix), filter(predicate, bpf), sink(prefix) {}
+
+    std::string text;       ///< --filter value
+    std::string prefix;     ///< Prepended to the names of the report files
+    FrameFilter filter;
+    StatsTables tables;
+    FlowSink sink;
+    int packets{0};
+};
+
 /*!
  * @callergraph
  * @callgraph
@@ -566,26 +803,59 @@ int main(int argc, char **argv) {
     desc.add_options()
             ("help", "produce help message")
             ("reportType", po::value<std::string>(), "Report type"
-                                                     "text - Output goes to screen and is default"
-                                                     "csv  - CSV file is created"
+                                                     "text  - Output goes to screen and is default"
+                                                     "csv   - CSV file is created"
+                                                     "tsv   - Tab separated file is created"
+                                                     "jsonl - JSON lines file, one object per row, is created"
+                                                     "arrow - Arrow IPC file with typed columns is created"
+                                                     "parquet - Parquet file with typed columns is created"
             )
             ("filename", po::value<std::string>(), "PCAP file name")
+            ("interface", po::value<std::string>(), "Capture live on an interface (name or IP address) instead of "
+                                                    "reading a file")
+            ("interval", po::value<int>(), "Live capture: seconds between reports (default 10)")
+            ("idle", po::value<int>(), "Evict host pairs, TCP conversations and MAC pairs idle for this many seconds.\n"
+                                       "Default 60 for live capture, never for files. 0 = never")
+            ("closewait", po::value<int>(), "Evict TCP conversations this many seconds after a FIN from both sides or a RST")
+            ("maxflows", po::value<int>(), "Maximum entries per table. The least recently used entry is evicted.\n"
+                                           "Evicted entries are written to EvictedTcpConversationStatsTable.csv,\n"
+                                           "EvictedHostPairTable.csv and EvictedEtherStatsTable.csv.\n"
+                                           "MAC pairs are only evicted with one thread")
             ("log", "Turn on logging")
-            ("list", po::value<std::string>(), "packet list: --list socket-id\n"
+            ("threads", po::value<int>(), "Number of worker threads used to parse packets (default 1).\n"
+                                          "Packets are sharded across the workers by host pair.\n"
+                                          "Ignored when --list is used")
+            ("nommap", "Do not memory map the pcap file. Use the PcapPlusPlus file reader")
+            ("start", po::value<std::string>(), "Analyze only the packets at or after this time:\n"
+                                                "YYYY-MM-DD HH:MM:SS[.frac] (local time), epoch seconds\n"
+                                                "or +seconds from the first packet")
+            ("end", po::value<std::string>(), "Analyze only the packets at or before this time. Same formats as --start")
+            ("index", "Write a flow index (<file>.flowidx) while reading the file. Later --list and\n"
+                      "--filter socket: runs on the same file read only the packets of the socket")
+            ("quantiles", "Add response time p50, p95 and p99 columns to the TCP conversation table")
+            ("profile", "Print the time spent in each processing stage and the peak table sizes at exit")
+            ("list", po::value<std::vector<std::string>>(), "packet list: --list socket-id\n"
                                                "socket-id is sip:sport-dip:dport\n"
                                                "sip   - Source IP\n"
                                                "dip   - Destination IP\n"
                                                "sport - Source TCP port\n"
-                                               "dport - Destination TCP Port")
-            ("filter", po::value<std::string>(), "Filter packets from capture file\n\n"
+                                               "dport - Destination TCP Port\n\n"
+                                               "Repeat --list, or list a host pair x.x.x.x-y.y.y.y or a\n"
+                                               "subnet x.x.x.x/len, to write the packets of every matching\n"
+                                               "TCP and UDP flow to its own List_*.txt file in one pass")
+            ("filter", po::value<std::vector<std::string>>(), "Filter packets from capture file\n\n"
                                                  "ip:x.x.x.x         - filter on IPaddress\n"
                                                  "hp:x.x.x.x-y.y.y.y - filter oon a host pair\n"
                                                  "port:p              - filter on TCP port\n"
                                                  "socket: x.x.x.x:srcport-y.y.y.y:dstport\n"
                                                  "mac:hh-hh-hh-hh-hh-hh\n"
                                                  "prot:protocol\n"
-                                                 "bpf:create your own raw bpf filter\n"
+                                                 "bpf:create your own raw bpf filter\n\n"
+                                                 "Repeat --filter to get one report per filter\n"
+                                                 "from a single read of the file"
             )
+            ("filters", po::value<std::string>(), "File of --filter values, one per line. Lines starting\n"
+                                                  "with # are ignored. One report per filter")
             ("report", po::value<std::string>(), "Report Option: One of\n\n"
                                                  "prot  - Protocol Report\n"
                                                  "eth   - Ethernet Report\n"
@@ -593,6 +863,7 @@ int main(int argc, char **argv) {
                                                  "hp    - Host Pair Report\n"
                                                  "all   - All Reports (Default)\n"
             )
+            ("top", po::value<int>(), "Print or write only the first N rows of each table, in sort order")
             ("sorteth", po::value<std::string>(), "Sort Option: One of\n\n"
                                                   "Ethernet Stats Table\n\n"
                                                   "\tUse column header name for sorting\n"
@@ -625,6 +896,27 @@ int main(int argc, char **argv) {
     if (vm.count("reportType")) {
         std::string s{vm["reportType"].as<std::string>()};
         if (s == "csv") rt = csv;
+        if (s == "tsv") {
+            rt = csv;
+            csvfile::format = TableFormat::tsv;
+        }
+        if (s == "jsonl") {
+            rt = csv;
+            csvfile::format = TableFormat::jsonl;
+        }
+        if (s == "arrow" || s == "parquet") {
+#if !defined(MACPCAP_WITH_ARROW)
+            fmt::print(stderr, "--reportType {} needs macpcap built with Apache Arrow\n", s);
+            return 1;
+#elif !defined(MACPCAP_WITH_PARQUET)
+            if (s == "parquet") {
+                fmt::print(stderr, "--reportType parquet needs macpcap built with Parquet\n");
+                return 1;
+            }
+#endif
+            rt = csv;
+            csvfile::format = s == "arrow" ? TableFormat::arrow : TableFormat::parquet;
+        }
     }
 
     if (vm.count("help")) {
@@ -632,8 +924,8 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    if (!vm.count("filename")) {
-        fmt::print("{}No filename passed. Must provide a name of a pcap file{}\n", red, reset);
+    if (!vm.count("filename") && !vm.count("interface")) {
+        fmt::print("{}No filename passed. Must provide a name of a pcap file or an interface{}\n", red, reset);
         return 1;
     }
 
@@ -680,10 +972,17 @@ int main(int argc, char **argv) {
     if (vm.count("report")) {
         reportType = vm["report"].as<std::string>();
     }
+    size_t top{0};
+    if (vm.count("top") && vm["top"].as<int>() > 0) top = static_cast<size_t>(vm["top"].as<int>());
     std::string listSocket;
     std::string bpf{};
-    if (vm.count("list")) {
-        std::string list{vm["list"].as<std::string>()};
+    std::array<std::string, 4> socket{};    // sip, sport, dip, dport of --list or --filter socket:
+    FramePredicate predicate;               // bpf compiled to a test on the raw frame, when it can be
+    std::vector<std::string> lists;
+    if (vm.count("list")) lists = vm["list"].as<std::vector<std::string>>();
+    ListSelector listSelector;              // several --list values, or a host pair or subnet
+    if (lists.size() == 1) {
+        std::string list{lists.front()};
         std::string sip{}, dip{};
         std::string sport{}, dport{};
         const std::string &s{list};
@@ -696,121 +995,141 @@ int main(int argc, char **argv) {
             dport = match[4];
             listSocket = fmt::format("{}:{}-{}:{}", sip, sport, dip, dport);
             bpf = fmt::format("port {} and port {} and host {} and host {}", sport, dport, sip, dip);
+            socket = {sip, sport, dip, dport};
+        }
+    }
+    for (size_t i = 0; listSocket.empty() && i < lists.size(); i++) {
+        if (!listSelector.add(lists[i])) {
+            fmt::print("{}--list {} is not a socket, host pair or subnet{}\n", red, lists[i], reset);
+            return 1;
         }
     }
     if (debug) SPDLOG_INFO("Sort options: Host Pair={}   TCP Conversation={}", sortString["hp"], sortString["tcp"]);
 
-    std::string filename{vm["filename"].as<std::string>()};
-    fmt::print("\nProcessing file name:{}{}{}.\n\n", green, filename, reset);
-    if (debug) SPDLOG_INFO("Processing file name:{}.", filename);
-
     /**
-     * ### Open passed pcap file for reading packets
+     * ### Open the live interface, or the passed pcap file for reading packets
      */
 
-    pcpp::IFileReaderDevice *reader = pcpp::IFileReaderDevice::getReader(filename);
-    if (!reader->open()) {
-        std::cerr << "Error opening the pcap file\n" << std::endl;
-        if (debug) SPDLOG_INFO("PCPP Reader failed to open file");
-        return 1;
+    std::unique_ptr<PacketSource> reader;
+    std::unique_ptr<LiveCapture> live;
+    std::string filename{};
+    if (vm.count("interface")) {
+        std::string interfaceName{vm["interface"].as<std::string>()};
+        fmt::print("\nCapturing on interface:{}{}{}.\n\n", green, interfaceName, reset);
+        live = std::make_unique<LiveCapture>(interfaceName, debug);
+        if (!live->open()) {
+            std::cerr << "Error opening interface " << interfaceName << std::endl;
+            return 1;
+        }
+    } else {
+        filename = vm["filename"].as<std::string>();
+        fmt::print("\nProcessing file name:{}{}{}.\n\n", green, filename, reset);
+        if (debug) SPDLOG_INFO("Processing file name:{}.", filename);
+
+        reader = PacketSource::getSource(filename, !vm.count("nommap"), debug);
+        if (!reader->open()) {
+            std::cerr << "Error opening the pcap file\n" << std::endl;
+            if (debug) SPDLOG_INFO("PCPP Reader failed to open file");
+            return 1;
+        }
     }
 
     /**
-     * process filter if supplied
-     *  ip:x.x.x.x         - filter on IPaddress
-     *  hp:x.x.x.x-y.y.y.y - filter oon a host pair
-     *  port:p              - filter on TCP port
-     *  socket: x.x.x.x:srcport-y.y.y.y:dstport
-     *  mac:hh-hh-hh-hh-hh-hh
-     *  prot:tcp|udp...
-     *  bpf: BOF string - use any of the BPF commands. Put filter at end of command line or enclose in quotes
+     * process filter if supplied (see compileFilter). One filter limits the whole run to its packets. Several, from
+     * repeated --filter options or a --filters file, each get their own tables and report from the same pass.
      */
-    if (listSocket.empty()) {
-        if (vm.count("filter")) {
-            std::string filter{vm["filter"].as<std::string>()};
-
-            if (filter.starts_with("ip:")) {
-                size_t pos{};
-                std::string s1{}, s2{};
-                std::string delimiter = ":";
-                pos = filter.find(delimiter);
-                s2 = filter.substr(pos + delimiter.length());
-                pcpp::IPFilter gf(s2, pcpp::SRC_OR_DST);
-                gf.parseToString(bpf);
-            }
+    std::vector<std::string> filters;
+    if (vm.count("filter")) filters = vm["filter"].as<std::vector<std::string>>();
+    if (vm.count("filters")) {
+        std::ifstream file(vm["filters"].as<std::string>());
+        if (!file) {
+            fmt::print("{}Could not read the filter file {}{}\n", red, vm["filters"].as<std::string>(), reset);
+            return 1;
+        }
+        std::string line;
+        while (std::getline(file, line)) {
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            line.erase(0, line.find_first_not_of(" \t"));
+            if (!line.empty() && line[0] != '#') filters.push_back(line);
+        }
+    }
+    bool listing{!listSocket.empty() || !listSelector.empty()};
+    bool multiFilter{!listing && filters.size() > 1};
+    if ((multiFilter || !listSelector.empty()) && live) {
+        fmt::print("{}Several filters or listed flows can only be used on a capture file{}\n", red, reset);
+        return 1;
+    }
+    if (!listing && filters.size() == 1) compileFilter(filters.front(), bpf, predicate, socket);
 
-            if (filter.starts_with("socket:")) {
-                std::string sip{}, dip{};
-                std::string sport{}, dport{};
-                const std::string &s{filter};
-                std::regex rgx(R"(^.*:(\d+\.\d+\.\d+\.\d+):(\d+)\-(\d+\.\d+\.\d+\.\d+):(\d+))");
-                std::smatch match;
-                if (std::regex_search(s.begin(), s.end(), match, rgx)) {
-                    sip = match[1];
-                    sport = match[2];
-                    dip = match[3];
-                    dport = match[4];
-                    bpf = fmt::format("port {} and port {} and host {} and host {}", sport, dport, sip, dip);
-                }
-            }
+    if (!listSocket.empty()) predicate = FramePredicate::socket(socket[0], socket[1], socket[2], socket[3]);
 
-            if (filter.starts_with("hp:")) {
-                std::string sip{}, dip{};
-                const std::string &shp{filter};
-                std::regex rgxhp(R"(^.*:(\d+\.\d+\.\d+\.\d+)\-(\d+\.\d+\.\d+\.\d+))");
-                std::smatch match;
-                if (std::regex_search(shp.begin(), shp.end(), match, rgxhp)) {
-                    sip = match[1];
-                    dip = match[2];
-                    bpf = fmt::format("(host {}) and (host {})", sip, dip);
-                }
-            }
+    /**
+     * ### Read only the packets of the socket when the file has a current flow index
+     */
+    bool indexed{false};
+    if (reader && !socket[0].empty() && !vm.count("nommap")) {
+        FlowIndex index;
+        auto mapped = std::make_unique<MappedPcapReader>(filename);
+        if (index.open(filename) && mapped->open()) {
+            std::vector<uint64_t> offsets{index.socketOffsets(
+                    pcpp::IPv4Address(socket[0]).toInt(), static_cast<uint16_t>(std::stoi(socket[1])),
+                    pcpp::IPv4Address(socket[2]).toInt(), static_cast<uint16_t>(std::stoi(socket[3])))};
+            fmt::print("Reading {} packets from the flow index {}\n", offsets.size(), FlowIndex::fileName(filename));
+            reader = std::make_unique<IndexedSource>(std::move(mapped), std::move(offsets));
+            bpf.clear();
+            indexed = true;
+        }
+    }
 
-            if (filter.starts_with("port:")) {
-                std::string port{};
-                const std::string &s{filter};
-                std::regex rgxhp(R"(^.*:(\d+))");
-                std::smatch match;
-                if (std::regex_search(s.begin(), s.end(), match, rgxhp)) {
-                    port = match[1];
-                    bpf = fmt::format("port {}", port);
-                }
+    /**
+     * ### Limit the file to the --start/--end time range. The timestamp index is built on first use.
+     */
+    bool timeRange{false};
+    if (reader && (vm.count("start") || vm.count("end"))) {
+        TimeBound start, end;
+        for (auto const &[option, bound]: {std::pair<const char *, TimeBound *>{"start", &start}, {"end", &end}}) {
+            if (vm.count(option) && !TimeBound::parse(vm[option].as<std::string>(), *bound)) {
+                fmt::print("{}--{} {} is not a time{}\n", red, option, vm[option].as<std::string>(), reset);
+                return 1;
             }
-
-            if (filter.starts_with("prot:")) {
-                std::string prot{};
-                const std::string &s{filter};
-                std::regex rgxhp(R"(^.*:(.*))");
-                std::smatch match;
-                if (std::regex_search(s.begin(), s.end(), match, rgxhp)) {
-                    prot = match[1];
-                    bpf = fmt::format("{}", prot);
-                }
+        }
+        auto ranged = std::make_unique<TimeRangeSource>(std::move(reader), start, end);
+        TimeIndex index;
+        if (!vm.count("nommap") && index.load(filename, debug) && ranged->useIndex(index)) {
+            if (debug) SPDLOG_INFO("Time range read with the timestamp index {}", TimeIndex::fileName(filename));
+        } else {
+            fmt::print("No timestamp index for {}. The whole file is read for the time range\n", filename);
+            if (!ranged->resolve(filename, !vm.count("nommap"), debug)) {
+                if (debug) SPDLOG_INFO("No packet in {} to resolve the time range from", filename);
             }
+        }
+        if (ranged->inverted()) {
+            fmt::print("{}--end is before --start{}\n", red, reset);
+            return 1;
+        }
+        reader = std::move(ranged);
+        timeRange = true;
+    }
 
-            if (filter.starts_with("mac:")) {
-                std::string mac{};
-                const std::string &s{filter};
-                std::regex rgxhp(R"(^.*:(..:..:..:..:..:..))");
-                std::smatch match;
-                if (std::regex_search(s.begin(), s.end(), match, rgxhp)) {
-                    mac = match[1];
-                    bpf = fmt::format("ether host {}", mac);
-                }
-            }
+    FlowIndexWriter *indexWriter{nullptr};
+    if (reader && vm.count("index") && !indexed && !timeRange) {
+        auto writer = std::make_unique<FlowIndexWriter>(std::move(reader));
+        indexWriter = writer.get();
+        reader = std::move(writer);
+    }
 
-            if (filter.starts_with("bpf:")) {
-                const std::string &s{filter};
-                std::regex rgxhp(R"(^.*:(.*)$)");
-                std::smatch match;
-                if (std::regex_search(s.begin(), s.end(), match, rgxhp)) {
-                    bpf = match[1];
-                }
-            }
-        }
+    /**
+     * ### Test the structured filters on the raw frame bytes instead of running the BPF program on every frame. Live
+     * captures keep the BPF program, which the kernel runs before the packet is copied.
+     */
+    if (reader && predicate.valid() && !bpf.empty()) {
+        if (debug) SPDLOG_INFO("Filter {} compiled to a frame predicate", bpf);
+        reader = std::make_unique<FilteredSource>(std::move(reader), predicate, bpf);
+        bpf.clear();
     }
+
     if (debug) SPDLOG_INFO(bpf);
-    if (!reader->setFilter(bpf)) {
+    if (!(live ? live->setFilter(bpf) : reader->setFilter(bpf))) {
         fmt::print("Could not set up filter on file");
     }
 
@@ -818,29 +1137,200 @@ int main(int argc, char **argv) {
      * ### Loop over file reading a packet, sending it to the parser, until EOF
      */
 
-    std::map<std::string, HostPair> hostPairList;
-    std::map<std::string, TCPConversation> tcpConversationList;
-    std::map<std::string, EthernetStats> ethernetStatsList;
-    std::map<std::string, ProtocolStats> protocolStatsList;
+    StatsTables tables;
 
     std::map<uint16_t, int> ipIdList{};
-    std::map<uint32_t, std::vector<long>> ssl{};
-    std::map<uint32_t, std::vector<long>> rsl{};
+    PendingSegments ssl{};
+    PendingSegments rsl{};
+
+    int threads{1};
+    if (vm.count("threads")) threads = vm["threads"].as<int>();
+    if (listing) threads = 1;               // packet list must be printed in capture order
+    if (multiFilter) threads = 1;           // every packet goes to the tables of each filter it matches
+    TCPConversation::quantiles = vm.count("quantiles") > 0;
+    Profiler::enabled = vm.count("profile") > 0;
+    if (debug || listing) parseUntilLayer = pcpp::OsiModelLayerUnknown;
+
+    /**
+     * ### Only run the statistics engines of the requested report. Without the TCP table the packet is parsed to the
+     * IPv4 layer, and to the Ethernet layer when no IP table is wanted either.
+     */
+    tables.stages = stagesForReport(reportType);
+    if (parseUntilLayer == pcpp::OsiModelTransportLayer && !(tables.stages & tcpStage)) {
+        parseUntilLayer = (tables.stages & (hostPairStage | protocolStage)) ? pcpp::OsiModelNetworkLayer
+                                                                            : pcpp::OsiModelDataLinkLayer;
+    }
+
+    FlowSink flowSink;
+    for (const char *option: {"idle", "closewait", "maxflows"}) {
+        if (vm.count(option) && vm[option].as<int>() < 0) {
+            fmt::print("{}--{} {} can not be negative{}\n", red, option, vm[option].as<int>(), reset);
+            return 1;
+        }
+    }
+    if (vm.count("idle")) tables.limits.idleTimeout = vm["idle"].as<int>();
+    else if (live) tables.limits.idleTimeout = 60;
+    if (vm.count("closewait")) tables.limits.closeWait = vm["closewait"].as<int>();
+    if (vm.count("maxflows")) tables.limits.maxFlows = static_cast<size_t>(vm["maxflows"].as<int>());
+    if (tables.limits.enabled()) tables.sink = &flowSink;
+
+    /**
+     * ### With several filters every frame is tested against each filter and added to the tables of the ones it
+     * matches. The packet is parsed once.
+     */
+    std::vector<std::unique_ptr<FilterReport>> filterReports;
+    for (size_t i = 0; multiFilter && i < filters.size(); i++) {
+        std::string filterBpf{};
+        FramePredicate filterPredicate;
+        std::array<std::string, 4> filterSocket{};
+        compileFilter(filters[i], filterBpf, filterPredicate, filterSocket);
+        if (filterBpf.empty()) {
+            fmt::print("{}--filter {} is not a filter{}\n", red, filters[i], reset);
+            return 1;
+        }
+        auto f = std::make_unique<FilterReport>(filters[i], filterPredicate, filterBpf,
+                                                fmt::format("Filter{}", i + 1));
+        if (!filterPredicate.valid() && !f->filter.compile()) {
+            fmt::print("{}Could not set up filter {}{}\n", red, filters[i], reset);
+            return 1;
+        }
+        f->tables.stages = tables.stages;
+        f->tables.limits = tables.limits;
+        if (f->tables.limits.enabled()) f->tables.sink = &f->sink;
+        if (debug) SPDLOG_INFO("{}: {} ({})", f->prefix, f->text, filterBpf);
+        filterReports.push_back(std::move(f));
+    }
+
+    auto generateReports = [&](StatsTables &t) {
+        ProfileScope scope(Stage::report);
+        // One finalize pass feeds the sort and the rendering of the TCP conversation table
+        if (reportType == "all" || reportType == "tcp") {
+            TCPConversation::finalizeTable(t.tcpConversationList, threads);
+        }
+        switch (rt) {
+            case text :
+                report(t.hostPairList, t.tcpConversationList, sortString, t.ethernetStatsList,
+                       t.protocolStatsList, debug, reportType, top);
+                break;
+            case csv :
+                writeCsv(t.hostPairList, t.tcpConversationList, sortString, t.ethernetStatsList,
+                         t.protocolStatsList, debug, reportType, top);
+                break;
+        }
+    };
 
-    pcpp::RawPacket rawPacket;
     int packetCount{0};
+    fmt::memory_buffer listOut;
+    auto listPacket = [&](pcpp::Packet &p, int pc) {
+        pp(p, pc, ipIdList, ssl, rsl, listSocket, listOut);
+        std::fwrite(listOut.data(), 1, listOut.size(), stdout);
+        listOut.clear();
+    };
+    std::unordered_map<FlowKey, FlowListing, FlowKeyHash> listings;
+    auto readFrame = [&reader](RawFrame &f) {
+        ProfileScope scope(Stage::read);
+        return reader->getNextPacket(f);
+    };
     if (debug) SPDLOG_INFO("processing pckets");
-    while (reader->getNextPacket(rawPacket)) {
-        packetCount++;
-        pcpp::Packet parsedPacket(&rawPacket);
-        print(parsedPacket, packetCount, debug);
-        if (!listSocket.empty()) pp(parsedPacket, packetCount, ipIdList, ssl, rsl, listSocket);
-        parser(parsedPacket,
-               hostPairList,
-               tcpConversationList,
-               ethernetStatsList,
-               protocolStatsList,
-               packetCount, debug);
+    if (live) {
+        int interval{10};
+        if (vm.count("interval")) interval = vm["interval"].as<int>();
+        packetCount = live->run(tables, interval, [&](pcpp::Packet &p, int pc, StatsTables &t) {
+            print(p, pc, debug);
+            if (!listSocket.empty()) listPacket(p, pc);
+            parser(p, t, pc, debug);
+        }, generateReports);
+    } else if (threads > 1) {
+        try {
+            packetCount = runPipeline(reader.get(), threads, tables, [debug](pcpp::Packet &p, int pc, StatsTables &t) {
+                print(p, pc, debug);
+                parser(p, t, pc, debug);
+            }, debug);
+        } catch (const std::exception &e) {
+            fmt::print("{}Processing the capture failed: {}{}\n", red, e.what(), reset);
+            return 1;
+        }
+    } else if (!filterReports.empty()) {
+        RawFrame frame;
+        std::vector<FilterReport *> matched;
+        while (readFrame(frame)) {
+            packetCount++;
+            matched.clear();
+            for (auto &f: filterReports) {
+                if (f->filter.match(frame)) matched.push_back(f.get());
+            }
+            if (matched.empty()) continue;
+            pcpp::RawPacket rawPacket(frame.data, frame.length, frame.ts, false, frame.linkType);
+            ProfileScope construct(Stage::packet);
+            pcpp::Packet parsedPacket(&rawPacket, parseUntilLayer);
+            construct.stop();
+            print(parsedPacket, packetCount, debug);
+            for (FilterReport *f: matched) {
+                f->packets++;
+                parser(parsedPacket, f->tables, packetCount, debug);
+            }
+        }
+    } else if (!listSelector.empty()) {
+        /*
+         * Every flow of the listed sockets, host pairs and subnets is listed to its own file. The statistics cover
+         * the packets of all listed flows.
+         */
+        RawFrame frame;
+        FlowKey key;
+        bool fromA;
+        while (readFrame(frame)) {
+            packetCount++;
+            if (!listSelector.match(frame, key, fromA)) continue;
+            pcpp::RawPacket rawPacket(frame.data, frame.length, frame.ts, false, frame.linkType);
+            ProfileScope construct(Stage::packet);
+            pcpp::Packet parsedPacket(&rawPacket, parseUntilLayer);
+            construct.stop();
+            print(parsedPacket, packetCount, debug);
+            auto [it, inserted] = listings.try_emplace(key);
+            FlowListing &l{it->second};
+            if (inserted) {
+                std::string sip{pcpp::IPv4Address(fromA ? key.ipA : key.ipB).toString()};
+                std::string dip{pcpp::IPv4Address(fromA ? key.ipB : key.ipA).toString()};
+                uint16_t sport{fromA ? key.portA : key.portB};
+                uint16_t dport{fromA ? key.portB : key.portA};
+                l.socket = fmt::format("{}:{}-{}:{}", sip, sport, dip, dport);
+                l.fileName = fmt::format("List_{}_{}-{}_{}{}.txt", sip, sport, dip, dport,
+                                         key.protocol == 17 ? "_udp" : "");
+                l.firstPacket = packetCount;
+            }
+            l.packets++;
+            pp(parsedPacket, packetCount, l.ipIdList, l.sent, l.received, l.socket, l.out);
+            if (l.out.size() >= FlowListing::flushBytes) l.flush();
+            parser(parsedPacket, tables, packetCount, debug);
+        }
+        std::vector<FlowListing *> flows;
+        for (auto &[k, l]: listings) {
+            l.flush();
+            flows.push_back(&l);
+        }
+        std::sort(flows.begin(), flows.end(), [](auto *a, auto *b) { return a->firstPacket < b->firstPacket; });
+        for (auto const *l: flows) fmt::print("{:<47} {:>9} packets  {}\n", l->socket, l->packets, l->fileName);
+        fmt::print("{} flows listed to {}\n", listings.size(), fs::current_path().string());
+    } else {
+        RawFrame frame;
+        while (readFrame(frame)) {
+            packetCount++;
+            pcpp::RawPacket rawPacket(frame.data, frame.length, frame.ts, false, frame.linkType);
+            ProfileScope construct(Stage::packet);
+            pcpp::Packet parsedPacket(&rawPacket, parseUntilLayer);
+            construct.stop();
+            print(parsedPacket, packetCount, debug);
+            if (!listSocket.empty()) listPacket(parsedPacket, packetCount);
+            parser(parsedPacket, tables, packetCount, debug);
+        }
+    }
+
+    if (indexWriter) {
+        if (indexWriter->write(filename, debug)) {
+            fmt::print("Flow index written to {}\n", FlowIndex::fileName(filename));
+        } else {
+            fmt::print("{}Flow index not written. It needs the memory mapped reader and no BPF filter{}\n", red, reset);
+        }
     }
 
     /**
@@ -849,20 +1339,27 @@ int main(int argc, char **argv) {
 
     if (debug) SPDLOG_INFO("Processing report");
 
-    switch (rt) {
-        case text :
-            report(hostPairList, tcpConversationList, sortString, ethernetStatsList, protocolStatsList, debug,
-                   reportType);
-            break;
-        case csv :
-            writeCsv(hostPairList, tcpConversationList, sortString, ethernetStatsList, protocolStatsList, debug,
-                     reportType);
-            break;
+    if (filterReports.empty()) {
+        generateReports(tables);
+    } else {
+        // Packet numbers in the reports are the numbers in the capture file
+        for (auto &f: filterReports) {
+            fmt::print("\n{}{}: {}{}   {} packets\n", green, f->prefix, f->text, reset, f->packets);
+            csvfile::prefix = f->prefix;
+            generateReports(f->tables);
+            tables.evicted += f->tables.evicted;
+            tables.peaks.add(f->tables.peaks);
+        }
+        csvfile::prefix.clear();
+    }
+    if (tables.evicted > 0) {
+        fmt::print("\n{} entries were evicted before the end of the capture and written to the Evicted*.csv files\n",
+                   tables.evicted);
     }
 
     // close the packet reader
 
-    reader->close();
+    if (reader) reader->close();
 
     // closing stats
 
@@ -873,6 +1370,7 @@ int main(int argc, char **argv) {
     SPDLOG_INFO("Packets processed: {} in {} ms", packetCount, elapsed_time_ms);
     fmt::print("\n\nPackets processed: {} in {} ms {} seconds\n\n", packetCount, elapsed_time_ms,
                elapsed_time_ms / 1000.0);
+    if (Profiler::enabled) Profiler::printSummary(elapsed_time_ms, tables.peaks);
     SPDLOG_INFO("Complete...Exiting");
     return 0;
 